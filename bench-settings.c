@@ -0,0 +1,1321 @@
+/*
+ * Xfconf GSettings backend - benchmark driver
+ *
+ * Copyright 2015-2016 Stephan Haller <nomad@froevel.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+// TODO: #include "config.h"
+
+#define G_SETTINGS_ENABLE_BACKEND
+#include <gio/gsettingsbackend.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <gmodule.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/* Definitions */
+#define BENCH_SCHEMA_SCALAR			"org.xfce.bench.scalar"
+#define BENCH_SCHEMA_WIDE			"org.xfce.bench.wide"
+#define BENCH_SCHEMA_COMPLEX		"org.xfce.bench.complex"
+
+#define BENCH_SCALAR_KEYS_PER_TYPE	25			/* Keys per type in scalar schema, 4 types */
+#define BENCH_SCALAR_KEYS			(4*BENCH_SCALAR_KEYS_PER_TYPE)
+#define BENCH_WIDE_KEYS				10000
+#define BENCH_MAX_READ_OBJECTS		100			/* Settings objects used for reads and writes */
+
+#define BENCH_PATH_SCALAR			"/org/xfce/bench/s%u/"
+#define BENCH_PATH_WIDE				"/org/xfce/bench/wide/"
+#define BENCH_PATH_COMPLEX			"/org/xfce/bench/complex/"
+
+#define BENCH_MODULE_NAME			"libxfconfsettings.so"
+
+#define BENCH_MAX_REQUESTS			1			/* Requests allowed for a read, reset or writability check */
+
+/* Paths searched for xfconfd if not given */
+static const gchar		*_xfconfdPaths[]=
+							{
+								"/usr/lib/xfce4/xfconf/xfconfd",
+								"/usr/lib/x86_64-linux-gnu/xfce4/xfconf/xfconfd",
+								"/usr/lib/aarch64-linux-gnu/xfce4/xfconf/xfconfd",
+								"/usr/libexec/xfce4/xfconf/xfconfd",
+								"/usr/local/lib/xfce4/xfconf/xfconfd",
+								NULL
+							};
+
+/* Sizes of channel to run the scenarios with */
+static const guint		_channelSizes[]={ 100, 1000, 10000, 100000, 0 };
+
+/* Number of keys written by one tree write */
+static const guint		_treeSizes[]={ 10, 100, 1000, 10000, 0 };
+
+/* Number of elements of arrays written and read */
+static const guint		_arraySizes[]={ 10, 1000, 100000, 0 };
+
+
+/* IMPLEMENTATION: Private variables and methods */
+typedef struct _BenchResult		BenchResult;
+struct _BenchResult
+{
+	gchar			*scenario;
+	guint			channelKeys;
+	guint			size;
+	guint			ops;
+	gdouble			opsPerSecond;
+	gint64			p50;		/* Latencies in nanoseconds */
+	gint64			p99;
+	gint64			p999;
+	gint			requests;	/* Requests made to xfconf, -1 if unknown */
+};
+
+/* Request counters exported by backend module */
+typedef guint (*BenchGetRoundTripsFunc)(GSettingsBackend *inBackend, const gchar *inVFuncName);
+typedef void (*BenchResetRoundTripsFunc)(GSettingsBackend *inBackend);
+
+/* Command-line options */
+static gchar		*_optionMode=NULL;
+static gchar		*_optionModuleDir=NULL;
+static gchar		*_optionXfconfd=NULL;
+static gchar		*_optionOutput=NULL;
+static gchar		*_optionBaseline=NULL;
+static gdouble		_optionTolerance=10.0;
+static gint			_optionMaxKeys=100000;
+static gint			_optionChannelKeys=0;
+static gint			_optionIterations=100000;
+static gboolean		_optionKeepData=FALSE;
+static gboolean		_optionCheckRequests=FALSE;
+
+/* Request counters of backend module, NULL if module does not export them */
+static BenchGetRoundTripsFunc		_getRoundTrips=NULL;
+static BenchResetRoundTripsFunc		_resetRoundTrips=NULL;
+
+static GOptionEntry	_options[]=
+{
+	{ "module-dir", 'm', 0, G_OPTION_ARG_FILENAME, &_optionModuleDir, "Directory containing libxfconfsettings.so (default: current directory)", "DIR" },
+	{ "xfconfd", 'x', 0, G_OPTION_ARG_FILENAME, &_optionXfconfd, "Path to xfconfd (default: search common locations)", "PATH" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &_optionOutput, "Write results as JSON to file instead of standard output", "FILE" },
+	{ "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &_optionBaseline, "Compare results against results saved before and fail on regressions", "FILE" },
+	{ "tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &_optionTolerance, "Allowed regression against baseline in percent (default: 10)", "PERCENT" },
+	{ "max-keys", 'k', 0, G_OPTION_ARG_INT, &_optionMaxKeys, "Largest channel size to run scenarios with (default: 100000)", "N" },
+	{ "iterations", 'i', 0, G_OPTION_ARG_INT, &_optionIterations, "Number of reads per scenario, writes are a tenth (default: 100000)", "N" },
+	{ "keep", 0, 0, G_OPTION_ARG_NONE, &_optionKeepData, "Do not remove temporary directory", NULL },
+	{ "check-requests", 'c', 0, G_OPTION_ARG_NONE, &_optionCheckRequests, "Only check that a read, reset or writability check makes at most one request to xfconfd", NULL },
+	{ "mode", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &_optionMode, NULL, NULL },
+	{ "channel-keys", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &_optionChannelKeys, NULL, NULL },
+	{ NULL }
+};
+
+/* Get monotonic time in nanoseconds */
+static gint64 _now(void)
+{
+	struct timespec		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return(((gint64)now.tv_sec*G_GINT64_CONSTANT(1000000000))+now.tv_nsec);
+}
+
+/* Dispatch all pending events, e.g. change notifications */
+static void _dispatch_pending(void)
+{
+	while(g_main_context_iteration(NULL, FALSE));
+}
+
+/* Look up request counters exported by backend module. The module was
+ * loaded by GIO already, so opening it again only returns its handle which
+ * is kept open as long as the process runs.
+ */
+static void _load_request_counters(void)
+{
+	GModule				*module;
+	gchar				*filename;
+	gpointer			getFunc;
+	gpointer			resetFunc;
+
+	if(!g_getenv("GIO_EXTRA_MODULES")) return;
+
+	filename=g_build_filename(g_getenv("GIO_EXTRA_MODULES"), BENCH_MODULE_NAME, NULL);
+	module=g_module_open(filename, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+	g_free(filename);
+	if(!module)
+	{
+		g_warning("Could not open backend module to count requests: %s", g_module_error());
+		return;
+	}
+
+	if(g_module_symbol(module, "xfconf_settings_backend_get_round_trips", &getFunc) &&
+		g_module_symbol(module, "xfconf_settings_backend_reset_round_trips", &resetFunc))
+	{
+		_getRoundTrips=(BenchGetRoundTripsFunc)getFunc;
+		_resetRoundTrips=(BenchResetRoundTripsFunc)resetFunc;
+	}
+		else g_warning("Backend module does not count requests");
+}
+
+/* Get number of requests made by backend since counters were reset, by all
+ * virtual functions if none is given. Returns -1 if requests are not counted.
+ */
+static gint _get_requests(GSettingsBackend *inBackend, const gchar *inVFuncName)
+{
+	if(!_getRoundTrips) return(-1);
+
+	return((gint)_getRoundTrips(inBackend, inVFuncName));
+}
+
+/* Reset request counters of backend */
+static void _reset_requests(GSettingsBackend *inBackend)
+{
+	if(_resetRoundTrips) _resetRoundTrips(inBackend);
+}
+
+/* Free a result */
+static void _bench_result_free(gpointer inData)
+{
+	BenchResult			*result=(BenchResult*)inData;
+
+	g_free(result->scenario);
+	g_free(result);
+}
+
+/* Compare latencies for sorting */
+static gint _compare_latency(gconstpointer inLeft, gconstpointer inRight)
+{
+	gint64				left=*((const gint64*)inLeft);
+	gint64				right=*((const gint64*)inRight);
+
+	return(left<right ? -1 : (left>right ? 1 : 0));
+}
+
+/* Print result of a scenario as JSON object in one line. The parent process
+ * collects these lines and the baseline is parsed by the same format. The
+ * number of requests is only printed if backend counts them.
+ */
+static void _print_result(const gchar *inScenario,
+							guint inChannelKeys,
+							guint inSize,
+							GArray *inLatencies,
+							gint inRequests)
+{
+	gchar				requests[32];
+	gint64				*latencies;
+	gint64				total;
+	guint				count;
+	guint				i;
+
+	count=inLatencies->len;
+	if(count==0) return;
+
+	/* Sort latencies to get percentiles */
+	latencies=(gint64*)inLatencies->data;
+	qsort(latencies, count, sizeof(gint64), (int (*)(const void*, const void*))_compare_latency);
+
+	total=0;
+	for(i=0; i<count; i++) total+=latencies[i];
+
+	requests[0]=0;
+	if(inRequests>=0) g_snprintf(requests, sizeof(requests), ", \"requests\": %d", inRequests);
+
+	g_print("{\"scenario\": \"%s\", \"channel_keys\": %u, \"size\": %u, \"ops\": %u, \"ops_per_sec\": %.1f, \"p50_ns\": %" G_GINT64_FORMAT ", \"p99_ns\": %" G_GINT64_FORMAT ", \"p999_ns\": %" G_GINT64_FORMAT "%s}\n",
+			inScenario,
+			inChannelKeys,
+			inSize,
+			count,
+			total>0 ? ((gdouble)count*1e9)/(gdouble)total : 0.0,
+			latencies[((count-1)*50)/100],
+			latencies[((count-1)*99)/100],
+			latencies[((count-1)*999)/1000],
+			requests);
+}
+
+/* Print result of a scenario with only one operation */
+static void _print_single_result(const gchar *inScenario,
+									guint inChannelKeys,
+									gint64 inLatency,
+									gint inRequests)
+{
+	GArray				*latencies;
+
+	latencies=g_array_new(FALSE, FALSE, sizeof(gint64));
+	g_array_append_val(latencies, inLatency);
+	_print_result(inScenario, inChannelKeys, 0, latencies, inRequests);
+	g_array_unref(latencies);
+}
+
+/* Get settings of scalar schema at n-th path */
+static GSettings* _get_scalar_settings(GSettingsBackend *inBackend, guint inIndex)
+{
+	GSettings			*settings;
+	gchar				*path;
+
+	path=g_strdup_printf(BENCH_PATH_SCALAR, inIndex);
+	settings=g_settings_new_with_backend_and_path(BENCH_SCHEMA_SCALAR, inBackend, path);
+	g_free(path);
+
+	return(settings);
+}
+
+/* Write all keys of scalar schemas to fill channel with requested number of keys */
+static gint _run_populate(guint inChannelKeys)
+{
+	GSettingsBackend	*backend;
+	GSettings			*settings;
+	guint				objects;
+	guint				i, j;
+	gchar				key[32];
+	gchar				*value;
+
+	backend=g_settings_backend_get_default();
+
+	objects=MAX(1, inChannelKeys/BENCH_SCALAR_KEYS);
+	for(i=0; i<objects; i++)
+	{
+		settings=_get_scalar_settings(backend, i);
+
+		g_settings_delay(settings);
+		for(j=0; j<BENCH_SCALAR_KEYS_PER_TYPE; j++)
+		{
+			g_snprintf(key, sizeof(key), "i%u", j);
+			g_settings_set_int(settings, key, (gint)(i+j+1));
+
+			g_snprintf(key, sizeof(key), "s%u", j);
+			value=g_strdup_printf("value-%u-%u", i, j);
+			g_settings_set_string(settings, key, value);
+			g_free(value);
+
+			g_snprintf(key, sizeof(key), "d%u", j);
+			g_settings_set_double(settings, key, (gdouble)(i+j)+0.5);
+
+			g_snprintf(key, sizeof(key), "b%u", j);
+			g_settings_set_boolean(settings, key, TRUE);
+		}
+		g_settings_apply(settings);
+
+		g_object_unref(settings);
+		_dispatch_pending();
+	}
+
+	g_settings_sync();
+	g_object_unref(backend);
+
+	return(0);
+}
+
+/* Measure loading of module, creating backend and first read. The first read
+ * of a process always misses the cache as it is not seeded yet.
+ */
+static GSettingsBackend* _run_startup(const gchar *inSuffix, guint inChannelKeys)
+{
+	GSettingsBackend	*backend;
+	GSettings			*settings;
+	gint64				start;
+	gchar				*scenario;
+
+	/* Load module and create backend */
+	start=_now();
+	backend=g_settings_backend_get_default();
+	start=_now()-start;
+
+	_load_request_counters();
+
+	scenario=g_strconcat("module_load", inSuffix, NULL);
+	_print_single_result(scenario, inChannelKeys, start, _get_requests(backend, NULL));
+	g_free(scenario);
+
+	/* First read */
+	settings=_get_scalar_settings(backend, 0);
+	_reset_requests(backend);
+
+	start=_now();
+	g_settings_get_int(settings, "i0");
+	start=_now()-start;
+
+	scenario=g_strconcat("first_read", inSuffix, NULL);
+	_print_single_result(scenario, inChannelKeys, start, _get_requests(backend, NULL));
+	g_free(scenario);
+
+	g_object_unref(settings);
+
+	return(backend);
+}
+
+/* Run all scenarios at a populated channel */
+static gint _run_scenarios(guint inChannelKeys)
+{
+	GSettingsBackend	*backend;
+	GSettings			*objects[BENCH_MAX_READ_OBJECTS];
+	guint				objectsCount;
+	GSettings			*settings;
+	GArray				*latencies;
+	GRand				*rand;
+	gint64				start;
+	guint				iterations;
+	guint				i, j;
+	const guint			*sizeIter;
+	gchar				key[32];
+	gchar				*value;
+	GVariant			*variant;
+	GVariantBuilder		builder;
+	gint32				*elements;
+
+	rand=g_rand_new_with_seed(42);
+	latencies=g_array_new(FALSE, FALSE, sizeof(gint64));
+
+	/* Startup with running xfconfd and cold cache */
+	backend=_run_startup("_warm_xfconfd", inChannelKeys);
+
+	objectsCount=MIN(BENCH_MAX_READ_OBJECTS, MAX(1, inChannelKeys/BENCH_SCALAR_KEYS));
+	for(i=0; i<objectsCount; i++) objects[i]=_get_scalar_settings(backend, i);
+
+	/* Cold scalar reads of each key not read before */
+	_reset_requests(backend);
+	for(i=0; i<objectsCount; i++)
+	{
+		for(j=0; j<BENCH_SCALAR_KEYS_PER_TYPE; j++)
+		{
+			g_snprintf(key, sizeof(key), "i%u", j);
+
+			start=_now();
+			g_settings_get_int(objects[i], key);
+			start=_now()-start;
+			g_array_append_val(latencies, start);
+		}
+	}
+	_print_result("read_cold", inChannelKeys, 0, latencies, _get_requests(backend, NULL));
+	g_array_set_size(latencies, 0);
+
+	/* Warm scalar reads of random keys */
+	iterations=(guint)_optionIterations;
+	_reset_requests(backend);
+	for(i=0; i<iterations; i++)
+	{
+		settings=objects[g_rand_int_range(rand, 0, objectsCount)];
+		j=(guint)g_rand_int_range(rand, 0, BENCH_SCALAR_KEYS);
+
+		g_snprintf(key, sizeof(key), "%c%u", "isdb"[j/BENCH_SCALAR_KEYS_PER_TYPE], j%BENCH_SCALAR_KEYS_PER_TYPE);
+
+		start=_now();
+		switch(j/BENCH_SCALAR_KEYS_PER_TYPE)
+		{
+			case 0:
+				g_settings_get_int(settings, key);
+				break;
+
+			case 1:
+				g_free(g_settings_get_string(settings, key));
+				break;
+
+			case 2:
+				g_settings_get_double(settings, key);
+				break;
+
+			default:
+				g_settings_get_boolean(settings, key);
+				break;
+		}
+		start=_now()-start;
+		g_array_append_val(latencies, start);
+	}
+	_print_result("read_warm", inChannelKeys, 0, latencies, _get_requests(backend, NULL));
+	g_array_set_size(latencies, 0);
+
+	/* Typed writes of random keys */
+	iterations=MAX(1, (guint)_optionIterations/10);
+	_reset_requests(backend);
+	for(i=0; i<iterations; i++)
+	{
+		settings=objects[g_rand_int_range(rand, 0, objectsCount)];
+		j=(guint)g_rand_int_range(rand, 0, BENCH_SCALAR_KEYS);
+
+		g_snprintf(key, sizeof(key), "%c%u", "isdb"[j/BENCH_SCALAR_KEYS_PER_TYPE], j%BENCH_SCALAR_KEYS_PER_TYPE);
+		value=g_strdup_printf("written-%u", i);
+
+		start=_now();
+		switch(j/BENCH_SCALAR_KEYS_PER_TYPE)
+		{
+			case 0:
+				g_settings_set_int(settings, key, (gint)i);
+				break;
+
+			case 1:
+				g_settings_set_string(settings, key, value);
+				break;
+
+			case 2:
+				g_settings_set_double(settings, key, (gdouble)i);
+				break;
+
+			default:
+				g_settings_set_boolean(settings, key, (i & 1));
+				break;
+		}
+		start=_now()-start;
+		g_array_append_val(latencies, start);
+
+		g_free(value);
+		if((i % 100)==99) _dispatch_pending();
+	}
+	_dispatch_pending();
+	_print_result("write_typed", inChannelKeys, 0, latencies, _get_requests(backend, NULL));
+	g_array_set_size(latencies, 0);
+
+	/* Complex type round trips */
+	settings=g_settings_new_with_backend_and_path(BENCH_SCHEMA_COMPLEX, backend, BENCH_PATH_COMPLEX);
+
+	iterations=MAX(1, (guint)_optionIterations/100);
+	_reset_requests(backend);
+	for(i=0; i<iterations; i++)
+	{
+		g_variant_builder_init(&builder, G_VARIANT_TYPE("a{ss}"));
+		for(j=0; j<10; j++)
+		{
+			g_snprintf(key, sizeof(key), "key%u", j);
+			value=g_strdup_printf("value-%u-%u", i, j);
+			g_variant_builder_add(&builder, "{ss}", key, value);
+			g_free(value);
+		}
+
+		start=_now();
+		g_settings_set_value(settings, "dict", g_variant_builder_end(&builder));
+		g_settings_set(settings, "tuple", "(iisd)", (gint)i, (gint)(i*2), "tuple", (gdouble)i);
+		variant=g_settings_get_value(settings, "dict");
+		g_variant_unref(variant);
+		variant=g_settings_get_value(settings, "tuple");
+		g_variant_unref(variant);
+		start=_now()-start;
+		g_array_append_val(latencies, start);
+
+		if((i % 100)==99) _dispatch_pending();
+	}
+	_dispatch_pending();
+	_print_result("complex_roundtrip", inChannelKeys, 0, latencies, _get_requests(backend, NULL));
+	g_array_set_size(latencies, 0);
+
+	/* Writes and reads of fixed-width arrays */
+	for(sizeIter=_arraySizes; *sizeIter; sizeIter++)
+	{
+		elements=g_new(gint32, *sizeIter);
+		for(j=0; j<*sizeIter; j++) elements[j]=(gint32)j;
+
+		iterations=(*sizeIter>=100000 ? 5 : 100);
+		_reset_requests(backend);
+		for(i=0; i<iterations; i++)
+		{
+			elements[0]=(gint32)i;
+			variant=g_variant_new_fixed_array(G_VARIANT_TYPE_INT32, elements, *sizeIter, sizeof(gint32));
+
+			start=_now();
+			g_settings_set_value(settings, "numbers", variant);
+			start=_now()-start;
+			g_array_append_val(latencies, start);
+
+			_dispatch_pending();
+		}
+		_print_result("array_write", inChannelKeys, *sizeIter, latencies, _get_requests(backend, NULL));
+		g_array_set_size(latencies, 0);
+
+		_reset_requests(backend);
+		for(i=0; i<iterations; i++)
+		{
+			start=_now();
+			variant=g_settings_get_value(settings, "numbers");
+			start=_now()-start;
+			g_array_append_val(latencies, start);
+
+			g_variant_unref(variant);
+		}
+		_print_result("array_read", inChannelKeys, *sizeIter, latencies, _get_requests(backend, NULL));
+		g_array_set_size(latencies, 0);
+
+		g_free(elements);
+	}
+
+	g_object_unref(settings);
+
+	/* Tree writes by delayed settings. These add keys to the channel so they
+	 * run last.
+	 */
+	settings=g_settings_new_with_backend_and_path(BENCH_SCHEMA_WIDE, backend, BENCH_PATH_WIDE);
+	for(sizeIter=_treeSizes; *sizeIter; sizeIter++)
+	{
+		iterations=5;
+		_reset_requests(backend);
+		for(i=0; i<iterations; i++)
+		{
+			g_settings_delay(settings);
+			for(j=0; j<*sizeIter; j++)
+			{
+				g_snprintf(key, sizeof(key), "k%u", j);
+				g_settings_set_int(settings, key, (gint)(i+j+1));
+			}
+
+			start=_now();
+			g_settings_apply(settings);
+			start=_now()-start;
+			g_array_append_val(latencies, start);
+
+			_dispatch_pending();
+		}
+		_print_result("tree_write", inChannelKeys, *sizeIter, latencies, _get_requests(backend, NULL));
+		g_array_set_size(latencies, 0);
+	}
+	g_object_unref(settings);
+
+	g_settings_sync();
+
+	/* Release allocated resources */
+	for(i=0; i<objectsCount; i++) g_object_unref(objects[i]);
+	g_object_unref(backend);
+	g_array_unref(latencies);
+	g_rand_free(rand);
+
+	return(0);
+}
+
+/* Check number of requests made by a virtual function against limit */
+static gboolean _check_requests(GSettingsBackend *inBackend,
+								const gchar *inCheck,
+								const gchar *inVFuncName)
+{
+	gint				requests;
+
+	requests=_get_requests(inBackend, inVFuncName);
+	if(requests>BENCH_MAX_REQUESTS)
+	{
+		g_printerr("FAILED: %s made %d requests by %s, at most %d allowed\n",
+					inCheck,
+					requests,
+					inVFuncName,
+					BENCH_MAX_REQUESTS);
+		return(FALSE);
+	}
+
+	g_printerr("OK: %s made %d requests by %s\n", inCheck, requests, inVFuncName);
+	return(TRUE);
+}
+
+/* Check that reading, resetting and checking writability of a key makes at
+ * most one request to xfconfd, whether the key is set or not and whether its
+ * path was loaded before or not. Each check uses a path not used before.
+ */
+static gint _run_check_requests(guint inChannelKeys)
+{
+	GSettingsBackend	*backend;
+	GSettings			*settings;
+	GSettings			*unsetSettings;
+	guint				unsetIndex;
+	gboolean			success;
+
+	backend=g_settings_backend_get_default();
+
+	_load_request_counters();
+	if(!_getRoundTrips)
+	{
+		g_critical("Cannot check requests as backend does not count them");
+		g_object_unref(backend);
+
+		return(1);
+	}
+
+	/* Scalar settings at first paths are populated, the ones behind are not */
+	unsetIndex=MAX(1, inChannelKeys/BENCH_SCALAR_KEYS);
+	success=TRUE;
+
+	settings=_get_scalar_settings(backend, 0);
+	unsetSettings=_get_scalar_settings(backend, unsetIndex);
+
+	_reset_requests(backend);
+	g_settings_get_int(settings, "i0");
+	success&=_check_requests(backend, "read of set key at unloaded path", "read");
+
+	_reset_requests(backend);
+	g_settings_get_int(settings, "i1");
+	success&=_check_requests(backend, "read of set key at loaded path", "read");
+
+	_reset_requests(backend);
+	g_settings_get_int(unsetSettings, "i0");
+	success&=_check_requests(backend, "read of unset key", "read");
+
+	_reset_requests(backend);
+	g_settings_is_writable(settings, "s0");
+	success&=_check_requests(backend, "writability check of key", "get_writable");
+
+	_reset_requests(backend);
+	g_settings_reset(settings, "d0");
+	success&=_check_requests(backend, "reset of set key", "reset");
+
+	_reset_requests(backend);
+	g_settings_reset(unsetSettings, "d0");
+	success&=_check_requests(backend, "reset of unset key", "reset");
+
+	_dispatch_pending();
+	g_settings_sync();
+
+	/* Release allocated resources */
+	g_object_unref(unsetSettings);
+	g_object_unref(settings);
+	g_object_unref(backend);
+
+	return(success ? 0 : 1);
+}
+
+/* Write schemas used by benchmark and compile them */
+static gboolean _create_schemas(const gchar *inSchemaDir)
+{
+	GString				*xml;
+	gchar				*filename;
+	gchar				*argv[3];
+	gint				exitStatus;
+	GError				*error;
+	guint				i;
+
+	xml=g_string_new("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<schemalist>\n");
+
+	/* Relocatable schema of scalar keys */
+	g_string_append(xml, "  <schema id=\"" BENCH_SCHEMA_SCALAR "\">\n");
+	for(i=0; i<BENCH_SCALAR_KEYS_PER_TYPE; i++)
+	{
+		g_string_append_printf(xml, "    <key name=\"i%u\" type=\"i\"><default>0</default></key>\n", i);
+		g_string_append_printf(xml, "    <key name=\"s%u\" type=\"s\"><default>''</default></key>\n", i);
+		g_string_append_printf(xml, "    <key name=\"d%u\" type=\"d\"><default>0.0</default></key>\n", i);
+		g_string_append_printf(xml, "    <key name=\"b%u\" type=\"b\"><default>false</default></key>\n", i);
+	}
+	g_string_append(xml, "  </schema>\n");
+
+	/* Relocatable schema of many keys for tree writes */
+	g_string_append(xml, "  <schema id=\"" BENCH_SCHEMA_WIDE "\">\n");
+	for(i=0; i<BENCH_WIDE_KEYS; i++)
+	{
+		g_string_append_printf(xml, "    <key name=\"k%u\" type=\"i\"><default>0</default></key>\n", i);
+	}
+	g_string_append(xml, "  </schema>\n");
+
+	/* Relocatable schema of complex keys */
+	g_string_append(xml, "  <schema id=\"" BENCH_SCHEMA_COMPLEX "\">\n");
+	g_string_append(xml, "    <key name=\"dict\" type=\"a{ss}\"><default>{}</default></key>\n");
+	g_string_append(xml, "    <key name=\"tuple\" type=\"(iisd)\"><default>(0, 0, '', 0.0)</default></key>\n");
+	g_string_append(xml, "    <key name=\"numbers\" type=\"ai\"><default>[]</default></key>\n");
+	g_string_append(xml, "  </schema>\n");
+
+	g_string_append(xml, "</schemalist>\n");
+
+	/* Write schema file */
+	error=NULL;
+	filename=g_build_filename(inSchemaDir, "org.xfce.bench.gschema.xml", NULL);
+	if(!g_file_set_contents(filename, xml->str, xml->len, &error))
+	{
+		g_critical("Could not write schema file %s: %s", filename, error->message);
+
+		/* Release allocated resources */
+		g_error_free(error);
+		g_free(filename);
+		g_string_free(xml, TRUE);
+
+		return(FALSE);
+	}
+
+	g_free(filename);
+	g_string_free(xml, TRUE);
+
+	/* Compile schemas */
+	argv[0]="glib-compile-schemas";
+	argv[1]=(gchar*)inSchemaDir;
+	argv[2]=NULL;
+	if(!g_spawn_sync(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, NULL, &exitStatus, &error) ||
+		exitStatus!=0)
+	{
+		g_critical("Could not compile schemas: %s", error ? error->message : "glib-compile-schemas failed");
+		if(error) g_error_free(error);
+
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+/* Write D-Bus service file to activate xfconfd at private bus */
+static gboolean _create_service(const gchar *inServiceDir, const gchar *inXfconfd)
+{
+	gchar				*filename;
+	gchar				*contents;
+	GError				*error;
+	gboolean			success;
+
+	error=NULL;
+	filename=g_build_filename(inServiceDir, "org.xfce.Xfconf.service", NULL);
+	contents=g_strdup_printf("[D-BUS Service]\nName=org.xfce.Xfconf\nExec=%s\n", inXfconfd);
+
+	success=g_file_set_contents(filename, contents, -1, &error);
+	if(!success)
+	{
+		g_critical("Could not write service file %s: %s", filename, error->message);
+		g_error_free(error);
+	}
+
+	/* Release allocated resources */
+	g_free(contents);
+	g_free(filename);
+
+	return(success);
+}
+
+/* Remove a directory and all its contents */
+static void _remove_directory(const gchar *inPath)
+{
+	GDir				*dir;
+	const gchar			*name;
+	gchar				*path;
+
+	dir=g_dir_open(inPath, 0, NULL);
+	if(dir)
+	{
+		while((name=g_dir_read_name(dir)))
+		{
+			path=g_build_filename(inPath, name, NULL);
+			if(g_file_test(path, G_FILE_TEST_IS_DIR) && !g_file_test(path, G_FILE_TEST_IS_SYMLINK)) _remove_directory(path);
+				else g_unlink(path);
+			g_free(path);
+		}
+
+		g_dir_close(dir);
+	}
+
+	g_rmdir(inPath);
+}
+
+/* Parse results printed one per line by _print_result(). Output files are
+ * written in the same format so baselines are read by this function, too.
+ */
+static void _parse_results(const gchar *inText, GPtrArray *ioResults)
+{
+	GRegex				*regex;
+	GMatchInfo			*match;
+	BenchResult			*result;
+	gchar				*field;
+	gint				i;
+
+	regex=g_regex_new("^\\s*\\{\"scenario\": \"([^\"]+)\", \"channel_keys\": (\\d+), \"size\": (\\d+), \"ops\": (\\d+), \"ops_per_sec\": ([0-9.]+), \"p50_ns\": (\\d+), \"p99_ns\": (\\d+), \"p999_ns\": (\\d+)(?:, \"requests\": (\\d+))?\\},?\\s*$",
+						G_REGEX_MULTILINE,
+						0,
+						NULL);
+	g_assert(regex);
+
+	g_regex_match(regex, inText, 0, &match);
+	while(g_match_info_matches(match))
+	{
+		result=g_new0(BenchResult, 1);
+		result->scenario=g_match_info_fetch(match, 1);
+		result->requests=-1;
+
+		for(i=2; i<=9; i++)
+		{
+			field=g_match_info_fetch(match, i);
+			switch(i)
+			{
+				case 2:
+					result->channelKeys=(guint)g_ascii_strtoull(field, NULL, 10);
+					break;
+
+				case 3:
+					result->size=(guint)g_ascii_strtoull(field, NULL, 10);
+					break;
+
+				case 4:
+					result->ops=(guint)g_ascii_strtoull(field, NULL, 10);
+					break;
+
+				case 5:
+					result->opsPerSecond=g_ascii_strtod(field, NULL);
+					break;
+
+				case 6:
+					result->p50=g_ascii_strtoll(field, NULL, 10);
+					break;
+
+				case 7:
+					result->p99=g_ascii_strtoll(field, NULL, 10);
+					break;
+
+				case 8:
+					result->p999=g_ascii_strtoll(field, NULL, 10);
+					break;
+
+				default:
+					/* Results saved before requests were counted lack them */
+					if(field && *field) result->requests=(gint)g_ascii_strtoll(field, NULL, 10);
+					break;
+			}
+			g_free(field);
+		}
+
+		g_ptr_array_add(ioResults, result);
+		g_match_info_next(match, NULL);
+	}
+
+	/* Release allocated resources */
+	g_match_info_free(match);
+	g_regex_unref(regex);
+}
+
+/* Run this program in a mode for one channel size and collect its results */
+static gboolean _run_child(const gchar *inProgram,
+							const gchar *inMode,
+							guint inChannelKeys,
+							GPtrArray *ioResults)
+{
+	gchar				*argv[5];
+	gchar				*output;
+	gint				exitStatus;
+	GError				*error;
+
+	error=NULL;
+	output=NULL;
+
+	argv[0]=(gchar*)inProgram;
+	argv[1]=g_strdup_printf("--mode=%s", inMode);
+	argv[2]=g_strdup_printf("--channel-keys=%u", inChannelKeys);
+	argv[3]=g_strdup_printf("--iterations=%d", _optionIterations);
+	argv[4]=NULL;
+
+#if GLIB_CHECK_VERSION(2, 70, 0)
+	if(!g_spawn_sync(NULL, argv, NULL, 0, NULL, NULL, &output, NULL, &exitStatus, &error) ||
+		!g_spawn_check_wait_status(exitStatus, &error))
+#else
+	if(!g_spawn_sync(NULL, argv, NULL, 0, NULL, NULL, &output, NULL, &exitStatus, &error) ||
+		!g_spawn_check_exit_status(exitStatus, &error))
+#endif
+	{
+		g_critical("Running benchmark mode '%s' with %u keys failed: %s",
+					inMode,
+					inChannelKeys,
+					error ? error->message : "Unknown error");
+
+		/* Release allocated resources */
+		if(error) g_error_free(error);
+		g_free(output);
+		g_free(argv[1]);
+		g_free(argv[2]);
+		g_free(argv[3]);
+
+		return(FALSE);
+	}
+
+	/* Collect results printed by child */
+	_parse_results(output ? output : "", ioResults);
+
+	/* Release allocated resources */
+	g_free(output);
+	g_free(argv[1]);
+	g_free(argv[2]);
+	g_free(argv[3]);
+
+	return(TRUE);
+}
+
+/* Write results as JSON array, one result per line */
+static gboolean _write_results(GPtrArray *inResults, const gchar *inFilename)
+{
+	GString				*json;
+	BenchResult			*result;
+	GError				*error;
+	gchar				requests[32];
+	guint				i;
+
+	json=g_string_new("[\n");
+	for(i=0; i<inResults->len; i++)
+	{
+		result=(BenchResult*)g_ptr_array_index(inResults, i);
+
+		requests[0]=0;
+		if(result->requests>=0) g_snprintf(requests, sizeof(requests), ", \"requests\": %d", result->requests);
+
+		g_string_append_printf(json,
+								"  {\"scenario\": \"%s\", \"channel_keys\": %u, \"size\": %u, \"ops\": %u, \"ops_per_sec\": %.1f, \"p50_ns\": %" G_GINT64_FORMAT ", \"p99_ns\": %" G_GINT64_FORMAT ", \"p999_ns\": %" G_GINT64_FORMAT "%s}%s\n",
+								result->scenario,
+								result->channelKeys,
+								result->size,
+								result->ops,
+								result->opsPerSecond,
+								result->p50,
+								result->p99,
+								result->p999,
+								requests,
+								(i+1)<inResults->len ? "," : "");
+	}
+	g_string_append(json, "]\n");
+
+	/* Print to standard output if no file was given */
+	if(!inFilename)
+	{
+		g_print("%s", json->str);
+		g_string_free(json, TRUE);
+		return(TRUE);
+	}
+
+	error=NULL;
+	if(!g_file_set_contents(inFilename, json->str, json->len, &error))
+	{
+		g_critical("Could not write results to %s: %s", inFilename, error->message);
+
+		/* Release allocated resources */
+		g_error_free(error);
+		g_string_free(json, TRUE);
+
+		return(FALSE);
+	}
+
+	g_string_free(json, TRUE);
+	g_print("Results written to %s\n", inFilename);
+
+	return(TRUE);
+}
+
+/* Compare results against baseline and return number of regressions found.
+ * Throughput may drop and p99 latency may rise by the tolerance given. Single
+ * measurements like startup are too noisy for their p99 to be compared. The
+ * number of requests does not depend on timing, so any increase is reported.
+ */
+static gint _compare_baseline(GPtrArray *inResults, const gchar *inFilename)
+{
+	GPtrArray			*baseline;
+	BenchResult			*result;
+	BenchResult			*base;
+	gchar				*contents;
+	GError				*error;
+	gdouble				tolerance;
+	gint				regressions;
+	guint				i, j;
+
+	error=NULL;
+	contents=NULL;
+	if(!g_file_get_contents(inFilename, &contents, NULL, &error))
+	{
+		g_critical("Could not read baseline %s: %s", inFilename, error->message);
+		g_error_free(error);
+
+		return(-1);
+	}
+
+	baseline=g_ptr_array_new_with_free_func(_bench_result_free);
+	_parse_results(contents, baseline);
+	g_free(contents);
+
+	tolerance=_optionTolerance/100.0;
+	regressions=0;
+	for(i=0; i<inResults->len; i++)
+	{
+		result=(BenchResult*)g_ptr_array_index(inResults, i);
+
+		/* Find same scenario in baseline */
+		base=NULL;
+		for(j=0; j<baseline->len && !base; j++)
+		{
+			base=(BenchResult*)g_ptr_array_index(baseline, j);
+			if(g_strcmp0(base->scenario, result->scenario)!=0 ||
+				base->channelKeys!=result->channelKeys ||
+				base->size!=result->size)
+			{
+				base=NULL;
+			}
+		}
+
+		if(!base) continue;
+
+		/* Check for regression */
+		if(result->opsPerSecond<base->opsPerSecond*(1.0-tolerance))
+		{
+			g_print("REGRESSION: %s (keys=%u, size=%u): %.1f ops/s, baseline %.1f ops/s\n",
+					result->scenario,
+					result->channelKeys,
+					result->size,
+					result->opsPerSecond,
+					base->opsPerSecond);
+			regressions++;
+		}
+			else if(result->ops>=100 &&
+					base->ops>=100 &&
+					(gdouble)result->p99>(gdouble)base->p99*(1.0+tolerance))
+			{
+				g_print("REGRESSION: %s (keys=%u, size=%u): p99 %" G_GINT64_FORMAT " ns, baseline %" G_GINT64_FORMAT " ns\n",
+						result->scenario,
+						result->channelKeys,
+						result->size,
+						result->p99,
+						base->p99);
+				regressions++;
+			}
+
+		if(result->requests>=0 &&
+			base->requests>=0 &&
+			result->requests>base->requests)
+		{
+			g_print("REGRESSION: %s (keys=%u, size=%u): %d requests, baseline %d requests\n",
+					result->scenario,
+					result->channelKeys,
+					result->size,
+					result->requests,
+					base->requests);
+			regressions++;
+		}
+	}
+
+	g_ptr_array_unref(baseline);
+
+	return(regressions);
+}
+
+/* Find xfconfd binary to activate at private bus */
+static gchar* _find_xfconfd(void)
+{
+	const gchar			**iter;
+
+	if(_optionXfconfd) return(g_strdup(_optionXfconfd));
+
+	if(g_getenv("XFCONFD")) return(g_strdup(g_getenv("XFCONFD")));
+
+	for(iter=_xfconfdPaths; *iter; iter++)
+	{
+		if(g_file_test(*iter, G_FILE_TEST_IS_EXECUTABLE)) return(g_strdup(*iter));
+	}
+
+	return(NULL);
+}
+
+/* Run benchmark in a child process. The backend to test is loaded only by
+ * child processes so every channel size starts with a fresh process,
+ * a fresh private session bus and a fresh xfconfd activated by it.
+ */
+static gint _run_child_mode(void)
+{
+	GSettingsBackend	*backend;
+	guint				channelKeys;
+
+	channelKeys=(guint)MAX(1, _optionChannelKeys);
+
+	if(g_strcmp0(_optionMode, "startup")==0)
+	{
+		backend=_run_startup("_cold_xfconfd", channelKeys);
+		g_object_unref(backend);
+		return(0);
+	}
+
+	if(g_strcmp0(_optionMode, "populate")==0) return(_run_populate(channelKeys));
+
+	if(g_strcmp0(_optionMode, "run")==0) return(_run_scenarios(channelKeys));
+
+	if(g_strcmp0(_optionMode, "requests")==0) return(_run_check_requests(channelKeys));
+
+	g_critical("Unknown benchmark mode '%s'", _optionMode);
+	return(1);
+}
+
+/* Main entry point */
+int main(int argc, char **argv)
+{
+	GOptionContext		*context;
+	GError				*error;
+	gchar				*program;
+	gchar				*moduleDir;
+	gchar				*module;
+	gchar				*xfconfd;
+	gchar				*tempDir;
+	gchar				*schemaDir;
+	gchar				*serviceDir;
+	gchar				*configDir;
+	gchar				*name;
+	GTestDBus			*bus;
+	GPtrArray			*results;
+	const guint			*sizeIter;
+	gint				regressions;
+	gint				exitCode;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	/* Initialize GObject type system */
+	g_type_init();
+#endif
+
+	/* Parse command-line options */
+	error=NULL;
+	context=g_option_context_new("- benchmark xfconf GSettings backend");
+	g_option_context_add_main_entries(context, _options, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+
+		/* Release allocated resources */
+		g_error_free(error);
+		g_option_context_free(context);
+
+		return(1);
+	}
+	g_option_context_free(context);
+
+	/* If a mode is given we were spawned by ourselves to run a benchmark */
+	if(_optionMode) return(_run_child_mode());
+
+	/* Set up environment to load backend to test in child processes */
+	if(!_optionModuleDir) _optionModuleDir=g_strdup(".");
+	if(g_path_is_absolute(_optionModuleDir)) moduleDir=g_strdup(_optionModuleDir);
+		else
+		{
+			gchar		*currentDir;
+
+			currentDir=g_get_current_dir();
+			moduleDir=g_build_filename(currentDir, _optionModuleDir, NULL);
+			g_free(currentDir);
+		}
+
+	module=g_build_filename(moduleDir, "libxfconfsettings.so", NULL);
+	if(!g_file_test(module, G_FILE_TEST_EXISTS))
+	{
+		g_critical("Could not find backend module %s", module);
+
+		/* Release allocated resources */
+		g_free(module);
+		g_free(moduleDir);
+
+		return(1);
+	}
+	g_free(module);
+
+	xfconfd=_find_xfconfd();
+	if(!xfconfd)
+	{
+		g_critical("Could not find xfconfd - use --xfconfd or XFCONFD to set its path");
+		g_free(moduleDir);
+
+		return(1);
+	}
+
+	program=g_find_program_in_path(argv[0]);
+	if(!program)
+	{
+		g_critical("Could not find path of %s", argv[0]);
+
+		/* Release allocated resources */
+		g_free(xfconfd);
+		g_free(moduleDir);
+
+		return(1);
+	}
+
+	tempDir=g_dir_make_tmp("xfconf-gsettings-bench-XXXXXX", &error);
+	if(!tempDir)
+	{
+		g_critical("Could not create temporary directory: %s", error->message);
+
+		/* Release allocated resources */
+		g_error_free(error);
+		g_free(program);
+		g_free(xfconfd);
+		g_free(moduleDir);
+
+		return(1);
+	}
+
+	schemaDir=g_build_filename(tempDir, "schemas", NULL);
+	serviceDir=g_build_filename(tempDir, "services", NULL);
+	g_mkdir_with_parents(schemaDir, 0700);
+	g_mkdir_with_parents(serviceDir, 0700);
+
+	exitCode=1;
+	results=g_ptr_array_new_with_free_func(_bench_result_free);
+
+	if(_create_schemas(schemaDir) && _create_service(serviceDir, xfconfd))
+	{
+		g_setenv("GSETTINGS_BACKEND", "xfconf", TRUE);
+		g_setenv("GIO_EXTRA_MODULES", moduleDir, TRUE);
+		g_setenv("GSETTINGS_SCHEMA_DIR", schemaDir, TRUE);
+
+		/* Requests are only checked at the smallest channel */
+		exitCode=0;
+		for(sizeIter=_channelSizes;
+			*sizeIter && *sizeIter<=(guint)MAX(0, _optionMaxKeys) && exitCode==0 &&
+				(!_optionCheckRequests || sizeIter==_channelSizes);
+			sizeIter++)
+		{
+			g_printerr("%s with %u keys in channel ...\n",
+						_optionCheckRequests ? "Checking requests" : "Running benchmarks",
+						*sizeIter);
+
+			/* Every channel size gets its own configuration and xfconfd */
+			name=g_strdup_printf("config-%u", *sizeIter);
+			configDir=g_build_filename(tempDir, name, NULL);
+			g_mkdir_with_parents(configDir, 0700);
+			g_setenv("XDG_CONFIG_HOME", configDir, TRUE);
+			g_free(configDir);
+			g_free(name);
+
+			bus=g_test_dbus_new(G_TEST_DBUS_NONE);
+			g_test_dbus_add_service_dir(bus, serviceDir);
+			g_test_dbus_up(bus);
+
+			/* First process activates xfconfd, the populated channel is
+			 * then measured with xfconfd already running.
+			 */
+			if(_optionCheckRequests)
+			{
+				if(!_run_child(program, "populate", *sizeIter, results) ||
+					!_run_child(program, "requests", *sizeIter, results))
+				{
+					exitCode=1;
+				}
+			}
+				else if(!_run_child(program, "startup", *sizeIter, results) ||
+						!_run_child(program, "populate", *sizeIter, results) ||
+						!_run_child(program, "run", *sizeIter, results))
+				{
+					exitCode=1;
+				}
+
+			g_test_dbus_down(bus);
+			g_object_unref(bus);
+		}
+	}
+
+	/* Report results and check for regressions */
+	if(exitCode==0 && !_optionCheckRequests && !_write_results(results, _optionOutput)) exitCode=1;
+
+	if(exitCode==0 && !_optionCheckRequests && _optionBaseline)
+	{
+		regressions=_compare_baseline(results, _optionBaseline);
+		if(regressions<0) exitCode=1;
+			else if(regressions>0)
+			{
+				g_print("%d regression(s) against baseline %s found\n", regressions, _optionBaseline);
+				exitCode=1;
+			}
+				else g_print("No regressions against baseline %s found\n", _optionBaseline);
+	}
+
+	/* Release allocated resources */
+	if(!_optionKeepData) _remove_directory(tempDir);
+		else g_printerr("Kept benchmark data at %s\n", tempDir);
+
+	g_ptr_array_unref(results);
+	g_free(serviceDir);
+	g_free(schemaDir);
+	g_free(tempDir);
+	g_free(program);
+	g_free(xfconfd);
+	g_free(moduleDir);
+
+	return(exitCode);
+}
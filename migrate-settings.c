@@ -24,8 +24,12 @@
 #define G_SETTINGS_ENABLE_BACKEND
 #include <gio/gsettingsbackend.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <xfconf/xfconf.h>
 
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 
 /* IMPLEMENTATION: Private variables and methods */
@@ -40,6 +44,193 @@ typedef enum
 	MIGRATE_MODE_OVERWRITE=1 << 2,			/* Just overwrite existing keys at destincation backend */
 } MigrateMode;
 
+/* Plan of migrating a schema: the user-modified keys and their values read
+ * from source backend.
+ */
+typedef struct _MigratePlanSchema		MigratePlanSchema;
+struct _MigratePlanSchema
+{
+	gchar					*schemaID;
+	GPtrArray				*keys;
+	GPtrArray				*values;
+};
+
+/* GVariant type of a migration plan saved to file: an array of schema IDs
+ * with a dictionary of keys and values each.
+ */
+#define MIGRATE_PLAN_TYPE		"a(sa{sv})"
+
+/* Journal of keys migrated successfully. It maps schema ID and key name,
+ * separated by a tab, to the hash of the value written. The journal file
+ * lists one key per line like this. Lines of each schema migrated are
+ * appended when the schema is done, later lines replace earlier ones.
+ */
+typedef struct _MigrateJournal			MigrateJournal;
+struct _MigrateJournal
+{
+	gchar					*filename;
+	GHashTable				*entries;
+	FILE					*file;			/* Opened for appending at first checkpoint */
+};
+
+/* Archive of user-modified values written by export and read by import.
+ * It starts with a header of magic bytes, version and flags all stored
+ * uncompressed followed by the (compressed) stream of schemas. Each schema
+ * is stored as its ID, its path and the number of keys followed by name,
+ * type and serialized value in normal form of each key. Strings and values
+ * are prefixed by their length, all integers are 32 bit little-endian.
+ * An empty schema ID marks the end of archive.
+ */
+#define MIGRATE_ARCHIVE_MAGIC				"XFGSARCH"
+#define MIGRATE_ARCHIVE_VERSION				1
+#define MIGRATE_ARCHIVE_FLAG_COMPRESSED		(1 << 0)
+#define MIGRATE_ARCHIVE_HEADER_SIZE			(8+4+4)
+
+typedef struct _MigrateArchive			MigrateArchive;
+struct _MigrateArchive
+{
+	gchar					*filename;
+	GMappedFile				*mappedFile;	/* Mapped archive file when reading */
+	gsize					maxDataSize;	/* Largest length of data the mapped file can hold */
+	GDataInputStream		*input;
+	GDataOutputStream		*output;
+};
+
+/* Backend, environment variable and channel the values of xfconf backend
+ * are stored in, to enumerate them without asking every key of every schema.
+ */
+#define MIGRATE_XFCONF_BACKEND_NAME			"xfconf"
+#define MIGRATE_XFCONF_ENV_ENGINE			"XFCONF_GSETTINGS_ENGINE"
+#define MIGRATE_XFCONF_CHANNEL				"xfconf-gsettings"
+#define MIGRATE_MEMORY_BACKEND_NAME			"memory"
+
+/* Environment variable enabling snapshots of xfconf backend which are not
+ * used when verifying, so the values are read back from xfconfd.
+ */
+#define MIGRATE_XFCONF_ENV_SNAPSHOT			"XFCONF_GSETTINGS_SNAPSHOT"
+
+#define MIGRATE_VERIFY_READ_BACK_NEW_PROCESS	"by a new process"
+#define MIGRATE_VERIFY_READ_BACK_THIS_PROCESS	"by this process"
+
+/* Report of verification listing each key which differs between source
+ * and destination backend by one tab-separated line.
+ */
+typedef struct _MigrateVerifyReport		MigrateVerifyReport;
+struct _MigrateVerifyReport
+{
+	const gchar				*filename;
+	FILE					*file;
+	guint					keysCount;
+	guint					differentKeysCount;
+};
+
+/* Result of a schema handed over from a worker to the reporter */
+typedef struct _MigrateSchemaResult		MigrateSchemaResult;
+struct _MigrateSchemaResult
+{
+	gboolean				success;
+	const gchar				*schemaID;
+	GString					*output;		/* Lines to print for this schema */
+	gchar					*error;			/* Message of error if migration failed */
+	gint64					duration;		/* Time needed for schema in microseconds */
+	guint					keysCount;		/* Number of keys planned or written */
+	guint					skippedKeysCount;	/* Number of keys unchanged since last migration */
+	guint64					bytes;			/* Size of serialized values planned or written */
+	gint64					readTime;		/* Time spent reading values in microseconds */
+	gint64					writeTime;		/* Time spent writing values in microseconds */
+	guint					differentKeysCount;	/* Number of keys differing on verification */
+	GString					*report;		/* Lines of differing keys to write to report */
+	MigratePlanSchema		*plan;			/* Plan of schema if one was made */
+};
+
+typedef struct _MigrateJob				MigrateJob;
+
+/* Function called by workers for each item of a job */
+typedef gboolean (*MigrateJobFunc)(MigrateJob *inJob,
+									gpointer inItem,
+									MigrateSchemaResult *ioResult);
+
+/* Function called by reporter for each item processed successfully in order of items */
+typedef gboolean (*MigrateJobReportFunc)(MigrateJob *inJob,
+											gpointer inItem,
+											MigrateSchemaResult *ioResult);
+
+/* A job shared by all worker threads. Its items are processed in parallel
+ * but reported in order.
+ */
+struct _MigrateJob
+{
+	const gchar				*name;
+	GSettingsBackend		*source;
+	GSettingsBackend		*destination;
+	MigrateMode				mode;
+	GSettingsSchemaSource	*schemaSource;
+	guint					commitBatchSize;	/* Keys written at once, 0 for all keys of a schema */
+
+	MigrateJournal			*journal;			/* Journal of incremental migration, may be NULL */
+	GHashTable				*storedKeys;		/* Keys stored at source by schema ID if enumerated from storage, may be NULL */
+
+	MigrateJobFunc			func;
+	MigrateJobReportFunc	reportFunc;
+	gpointer				reportData;
+	gpointer				*items;
+	guint					itemsCount;
+	gint					nextItem;		/* Index of next item to take from queue */
+	gint					aborted;
+
+	GMutex					lock;
+	GCond					cond;
+	MigrateSchemaResult		**results;		/* Results by index of item, NULL until processed */
+	guint					runningWorkers;
+};
+
+/* Command-line options */
+static gchar			*_optionFrom=NULL;
+static gchar			*_optionTo=NULL;
+static gchar			**_optionIncludes=NULL;
+static gchar			**_optionExcludes=NULL;
+static gboolean			_optionOverwrite=TRUE;
+static gboolean			_optionCleanDestination=TRUE;
+static gboolean			_optionJSON=FALSE;
+static gint				_optionThreads=0;
+static gboolean			_optionDryRun=FALSE;
+static gchar			*_optionSavePlan=NULL;
+static gchar			*_optionApplyPlan=NULL;
+static gint				_optionCommitBatchSize=0;
+static gboolean			_optionIncremental=FALSE;
+static gchar			*_optionJournal=NULL;
+static gboolean			_optionCompress=FALSE;
+static gboolean			_optionVerify=FALSE;
+static gchar			*_optionVerifyReport=NULL;
+static gchar			*_optionVerifyPlan=NULL;
+
+static GOptionEntry		_options[]=
+{
+	{ "from", 'f', 0, G_OPTION_ARG_STRING, &_optionFrom, "Name of backend to migrate from (default: dconf)", "NAME" },
+	{ "to", 'T', 0, G_OPTION_ARG_STRING, &_optionTo, "Name of backend to migrate to (default: xfconf)", "NAME" },
+	{ "include", 'I', 0, G_OPTION_ARG_STRING_ARRAY, &_optionIncludes, "Only migrate schemas whose ID matches this glob, may be given multiple times", "GLOB" },
+	{ "exclude", 'X', 0, G_OPTION_ARG_STRING_ARRAY, &_optionExcludes, "Do not migrate schemas whose ID matches this glob, may be given multiple times", "GLOB" },
+	{ "no-overwrite", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &_optionOverwrite, "Fail if a key already has a value at destination backend", NULL },
+	{ "no-clean-destination", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &_optionCleanDestination, "Do not assume an empty destination backend on dry-run", NULL },
+	{ "json", 0, 0, G_OPTION_ARG_NONE, &_optionJSON, "Print one JSON object per schema and run instead of each key", NULL },
+	{ "threads", 't', 0, G_OPTION_ARG_INT, &_optionThreads, "Number of schemas to migrate in parallel (default: number of processors)", "N" },
+	{ "dry-run", 'n', 0, G_OPTION_ARG_NONE, &_optionDryRun, "Only check if migration could succeed but do not write any value", NULL },
+	{ "save-plan", 's', 0, G_OPTION_ARG_FILENAME, &_optionSavePlan, "Save plan of keys and values to migrate to file", "FILE" },
+	{ "apply-plan", 'a', 0, G_OPTION_ARG_FILENAME, &_optionApplyPlan, "Apply plan saved before instead of reading source backend", "FILE" },
+	{ "commit-batch-size", 'b', 0, G_OPTION_ARG_INT, &_optionCommitBatchSize, "Number of keys of a schema written at once, 1 writes each key on its own (default: all keys of a schema)", "N" },
+	{ "incremental", 'i', 0, G_OPTION_ARG_NONE, &_optionIncremental, "Skip keys unchanged at both backends since last migration", NULL },
+	{ "journal", 'j', 0, G_OPTION_ARG_FILENAME, &_optionJournal, "Journal of incremental migration (default: migrate.journal in user's cache directory), implies --incremental", "FILE" },
+	{ "compress", 'z', 0, G_OPTION_ARG_NONE, &_optionCompress, "Compress archive written by export", NULL },
+	{ "verify", 'V', 0, G_OPTION_ARG_NONE, &_optionVerify, "Read migrated keys again from both backends and report keys which differ", NULL },
+	{ "verify-report", 0, 0, G_OPTION_ARG_FILENAME, &_optionVerifyReport, "Report of keys which differ (default: migrate-verify.report in user's cache directory), implies --verify", "FILE" },
+	{ "verify-plan", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &_optionVerifyPlan, "Verify keys of plan saved before at a new instance of destination backend and exit", "FILE" },
+	{ NULL }
+};
+
+/* Globs of schema IDs to include and exclude */
+static GPtrArray		*_includePatterns=NULL;
+static GPtrArray		*_excludePatterns=NULL;
+
 /* Ensures that all GIOModules are loaded */
 void _ensure_loaded(void)
 {
@@ -160,321 +351,2787 @@ GSettingsBackend* _get_backend_by_name(const gchar *inBackendName)
 	return(G_SETTINGS_BACKEND(backend));
 }
 
-/* Migration from one backend to another one */
-static gboolean _migrate(GSettingsBackend *inSource,
-							GSettingsBackend *inDestination,
-							MigrateMode inMode)
+/* Print progress of migration unless JSON objects are printed */
+static void _print_progress(const gchar *inFormat, ...) G_GNUC_PRINTF(1, 2);
+static void _print_progress(const gchar *inFormat, ...)
 {
-	GSettingsSchemaSource	*schemaSource;
-	gchar					**schemas;
-	const gchar				**schemaIter;
+	va_list				args;
+	gchar				*message;
 
-	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inSource), FALSE);
-	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inDestination), FALSE);
+	if(_optionJSON) return;
 
-	/* Get all installed schemas and iterate through all keys of each schema.
-	 * Try to read the value of each key and write it to destination backend
-	 * if dry-run was turned off.
-	 */
-	schemaSource=g_settings_schema_source_ref(g_settings_schema_source_get_default());
-	g_settings_schema_source_list_schemas(schemaSource, TRUE, &schemas, NULL);
+	va_start(args, inFormat);
+	message=g_strdup_vprintf(inFormat, args);
+	va_end(args);
+
+	g_print("%s", message);
+	g_free(message);
+}
+
+/* Compile globs given at command-line */
+static GPtrArray* _compile_patterns(gchar **inGlobs)
+{
+	GPtrArray			*patterns;
+	gchar				**iter;
 
-	for(schemaIter=(const gchar**)schemas; *schemaIter; schemaIter++)
+	if(!inGlobs) return(NULL);
+
+	patterns=g_ptr_array_new_with_free_func((GDestroyNotify)g_pattern_spec_free);
+	for(iter=inGlobs; *iter; iter++) g_ptr_array_add(patterns, g_pattern_spec_new(*iter));
+
+	return(patterns);
+}
+
+/* Check if a string matches any pattern */
+static gboolean _matches_any_pattern(GPtrArray *inPatterns, const gchar *inString)
+{
+	guint				i;
+
+	for(i=0; i<inPatterns->len; i++)
 	{
-		GSettingsSchema		*schema;
-		const gchar			*schemaID;
-		gchar				**keys;
-		const gchar			**keyIter;
-		GSettings			*sourceSettings;
-		GSettings			*destinationSettings;
+		if(g_pattern_match_string((GPatternSpec*)g_ptr_array_index(inPatterns, i), inString)) return(TRUE);
+	}
 
-		/* Get ID of schema */
-		schemaID=*schemaIter;
-		g_print("  Migrating schema %s\n", schemaID);
+	return(FALSE);
+}
 
-		/* Get schema */
-		schema=g_settings_schema_source_lookup(schemaSource, schemaID, TRUE);
-		if(!schema)
-		{
-			g_critical("Could not load schema %s.", schemaID);
+/* Check if a schema is selected by the globs to include and exclude */
+static gboolean _is_schema_selected(const gchar *inSchemaID)
+{
+	if(_includePatterns && !_matches_any_pattern(_includePatterns, inSchemaID)) return(FALSE);
+	if(_excludePatterns && _matches_any_pattern(_excludePatterns, inSchemaID)) return(FALSE);
 
-			/* Release allocated resources */
-			if(schemas) g_strfreev(schemas);
+	return(TRUE);
+}
 
-			/* Return error */
-			return(FALSE);
-		}
+/* Get IDs of all non-relocatable schemas selected by the globs to include
+ * and exclude. Schemas are filtered before any settings object is created.
+ */
+static gchar** _list_selected_schemas(GSettingsSchemaSource *inSchemaSource)
+{
+	gchar				**schemas;
+	guint				count;
+	guint				i;
 
-		/* Get settings from source backend */
-		sourceSettings=g_settings_new_with_backend(schemaID, inSource);
-		if(!sourceSettings)
-		{
-			g_critical("Could load settings from source backend %s for schema %s.",
-						G_OBJECT_TYPE_NAME(inSource),
-						schemaID);
+	schemas=NULL;
+	g_settings_schema_source_list_schemas(inSchemaSource, TRUE, &schemas, NULL);
+	if(!schemas) return(NULL);
 
-			/* Release allocated resources */
-			if(schema) g_settings_schema_unref(schema);
-			if(schemas) g_strfreev(schemas);
+	count=0;
+	for(i=0; schemas[i]; i++)
+	{
+		if(_is_schema_selected(schemas[i])) schemas[count++]=schemas[i];
+			else g_free(schemas[i]);
+	}
+	schemas[count]=NULL;
 
-			/* Return error */
-			return(FALSE);
-		}
+	return(schemas);
+}
 
-		/* Get settings from destination backend */
-		destinationSettings=g_settings_new_with_backend(schemaID, inDestination);
-		if(!destinationSettings)
-		{
-			g_critical("Could create settings for destination backend %s with schema %s.",
-						G_OBJECT_TYPE_NAME(inDestination),
-						schemaID);
+/* Compare strings for sorting an array of strings */
+static gint _compare_strings(gconstpointer inLeft, gconstpointer inRight)
+{
+	return(g_strcmp0(*(const gchar**)inLeft, *(const gchar**)inRight));
+}
 
-			/* Release allocated resources */
-			if(sourceSettings) g_object_unref(sourceSettings);
-			if(schema) g_settings_schema_unref(schema);
-			if(schemas) g_strfreev(schemas);
+/* Get sorted and NULL-terminated list of keys of a hash table */
+static gchar** _get_sorted_keys(GHashTable *inTable)
+{
+	GPtrArray			*keys;
+	GHashTableIter		iter;
+	gpointer			key;
 
-			/* Return error */
-			return(FALSE);
-		}
+	keys=g_ptr_array_sized_new(g_hash_table_size(inTable)+1);
+	g_hash_table_iter_init(&iter, inTable);
+	while(g_hash_table_iter_next(&iter, &key, NULL)) g_ptr_array_add(keys, g_strdup((const gchar*)key));
+	g_ptr_array_sort(keys, _compare_strings);
+	g_ptr_array_add(keys, NULL);
 
-		/* Get all keys from currently iterated schema */
-		keys=g_settings_list_keys(sourceSettings);
-		if(!keys)
-		{
-			g_critical("Could get keys from settings of source backend %s for schema %s.",
-						G_OBJECT_TYPE_NAME(inSource),
-						schemaID);
+	return((gchar**)g_ptr_array_free(keys, FALSE));
+}
 
-			/* Release allocated resources */
-			if(destinationSettings) g_object_unref(destinationSettings);
-			if(sourceSettings) g_object_unref(sourceSettings);
-			if(schema) g_settings_schema_unref(schema);
-			if(schemas) g_strfreev(schemas);
+/* Check if settings of source backend can be enumerated from storage of
+ * xfconf. This is only the case if the xfconf backend stores its values in
+ * xfconfd and not in memory of this process.
+ */
+static gboolean _can_enumerate_storage(const gchar *inBackendName)
+{
+	const gchar			*engine;
 
-			/* Return error */
-			return(FALSE);
+	if(g_strcmp0(inBackendName, MIGRATE_XFCONF_BACKEND_NAME)!=0) return(FALSE);
+
+	engine=g_getenv(MIGRATE_XFCONF_ENV_ENGINE);
+	return(!engine || g_strcmp0(engine, "xfconf")==0);
+}
+
+/* Check if values written to backend can be read back by another process.
+ * Backends keeping values in memory only lose them with the process.
+ */
+static gboolean _can_read_back_in_new_process(const gchar *inBackendName)
+{
+	const gchar			*engine;
+
+	if(g_strcmp0(inBackendName, MIGRATE_MEMORY_BACKEND_NAME)==0) return(FALSE);
+	if(g_strcmp0(inBackendName, MIGRATE_XFCONF_BACKEND_NAME)!=0) return(TRUE);
+
+	engine=g_getenv(MIGRATE_XFCONF_ENV_ENGINE);
+	return(!engine || g_strcmp0(engine, "memory")!=0);
+}
+
+/* Get keys stored at xfconf by schema ID. Each property of the channels of
+ * the xfconf backend is named like the path of its key, so the properties
+ * are mapped back to schema and key by an index of the paths of all selected
+ * schemas. The number of lookups depends on the number of values stored and
+ * not on the number of schemas and keys installed. Returns a hash table
+ * mapping schema ID to a sorted list of key names.
+ */
+static GHashTable* _list_stored_keys(GSettingsSchemaSource *inSchemaSource, GError **outError)
+{
+	GHashTable			*pathIndex;
+	GHashTable			*keysBySchema;
+	GHashTable			*storedKeys;
+	gchar				**schemas;
+	gchar				**channels;
+	gchar				**iter;
+	GHashTableIter		tableIter;
+	gpointer			key;
+	gpointer			value;
+
+	if(!xfconf_init(outError)) return(NULL);
+
+	/* Build index of path to schema once */
+	pathIndex=g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_settings_schema_unref);
+
+	schemas=_list_selected_schemas(inSchemaSource);
+	for(iter=schemas; iter && *iter; iter++)
+	{
+		GSettingsSchema	*schema;
+
+		schema=g_settings_schema_source_lookup(inSchemaSource, *iter, TRUE);
+		if(!schema) continue;
+
+		if(g_settings_schema_get_path(schema)) g_hash_table_insert(pathIndex, (gpointer)g_settings_schema_get_path(schema), schema);
+			else g_settings_schema_unref(schema);
+	}
+	if(schemas) g_strfreev(schemas);
+
+	/* Map properties of all channels of backend, i.e. the main channel and
+	 * its shards, to schema and key. A key may be found in more than one
+	 * channel but it is listed only once.
+	 */
+	keysBySchema=g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_hash_table_destroy);
+
+	channels=xfconf_list_channels();
+	for(iter=channels; iter && *iter; iter++)
+	{
+		XfconfChannel	*channel;
+		GHashTable		*properties;
+
+		if(g_strcmp0(*iter, MIGRATE_XFCONF_CHANNEL)!=0 &&
+			!g_str_has_prefix(*iter, MIGRATE_XFCONF_CHANNEL "-"))
+		{
+			continue;
 		}
 
-		/* Try to read values of all keys for current schema from source backend
-		 * and write it to destination backend if dry-run is turned off.
-		 */
-		for(keyIter=(const gchar**)keys; *keyIter; keyIter++)
+		channel=xfconf_channel_new(*iter);
+		properties=xfconf_channel_get_properties(channel, NULL);
+		g_object_unref(channel);
+		if(!properties) continue;
+
+		g_hash_table_iter_init(&tableIter, properties);
+		while(g_hash_table_iter_next(&tableIter, &key, NULL))
 		{
+			const gchar		*propertyName=(const gchar*)key;
 			const gchar		*keyName;
-			GVariant		*sourceValue;
-			GVariant		*destinationValue;
+			gchar			*path;
+			GSettingsSchema	*schema;
+			GHashTable		*keys;
 
-			/* Get key name */
-			keyName=*keyIter;
+			keyName=strrchr(propertyName, '/');
+			if(!keyName) continue;
+			keyName++;
 
-			/* Get user-modified value for currently iterate key from source backend.
-			 * Do not use g_settings_get_value() as it will return the default value
-			 * as defined in schema which is not needed to be migrated. Just continue
-			 * with next key in schema if there is no user-modified value.
-			 */
-			sourceValue=g_settings_get_user_value(sourceSettings, keyName);
-			if(!sourceValue) continue;
+			path=g_strndup(propertyName, keyName-propertyName);
+			schema=(GSettingsSchema*)g_hash_table_lookup(pathIndex, path);
+			g_free(path);
 
-			/* Check if key exists at destination backend and if we can overwrite it */
-			destinationValue=g_settings_get_user_value(destinationSettings, keyName);
-			if(destinationValue)
+			if(!schema || !g_settings_schema_has_key(schema, keyName)) continue;
+
+			keys=(GHashTable*)g_hash_table_lookup(keysBySchema, g_settings_schema_get_id(schema));
+			if(!keys)
 			{
-				gboolean	canOverwrite;
+				keys=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+				g_hash_table_insert(keysBySchema, (gpointer)g_settings_schema_get_id(schema), keys);
+			}
+			g_hash_table_add(keys, g_strdup(keyName));
+		}
 
-				/* Before any check we cannot overwrite value at destination */
-				canOverwrite=FALSE;
+		g_hash_table_destroy(properties);
+	}
+	if(channels) g_strfreev(channels);
 
-				/* If we do a dry-run and cleaning destination was requested also
-				 * then assume that key does not exist.
-				 */
-				if((inMode & MIGRATE_MODE_DRY_RUN) &&
-					(inMode & MIGRATE_MODE_CLEAN_DESTINATION))
-				{
-					canOverwrite=TRUE;
-				}
+	/* Turn set of keys of each schema into sorted list */
+	storedKeys=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_strfreev);
 
-				/* If overwriting keys at destination was requested then we can overwrite */
-				if(inMode & MIGRATE_MODE_OVERWRITE)
-				{
-					canOverwrite=TRUE;
-				}
+	g_hash_table_iter_init(&tableIter, keysBySchema);
+	while(g_hash_table_iter_next(&tableIter, &key, &value))
+	{
+		g_hash_table_insert(storedKeys, g_strdup((const gchar*)key), _get_sorted_keys((GHashTable*)value));
+	}
 
-				/* Show error if we cannot overwrite key at destination backend */
-				if(!canOverwrite)
-				{
-					g_critical("Cannot overwrite key %s for schema %s at destination backend %s.",
-								keyName,
-								schemaID,
-								G_OBJECT_TYPE_NAME(inDestination));
-
-					/* Release allocated resources */
-					if(destinationValue) g_variant_unref(destinationValue);
-					if(destinationSettings) g_object_unref(destinationSettings);
-					if(sourceSettings) g_object_unref(sourceSettings);
-					if(schema) g_settings_schema_unref(schema);
-					if(schemas) g_strfreev(schemas);
-
-					/* Return error */
-					return(FALSE);
-				}
-			}
+	/* Release allocated resources */
+	g_hash_table_destroy(keysBySchema);
+	g_hash_table_destroy(pathIndex);
+	xfconf_shutdown();
 
-			if(destinationValue) g_variant_unref(destinationValue);
+	return(storedKeys);
+}
 
-			/* Check if key at destination backend is writable at all */
-			if(!g_settings_is_writable(destinationSettings, keyName))
-			{
-				g_critical("Cannot migrate key %s for schema %s at destination backend %s because it is not writable.",
-							keyName,
-							schemaID,
-							G_OBJECT_TYPE_NAME(inDestination));
+/* Get schemas to process by a job reading source backend. If source backend
+ * can be enumerated from storage only schemas with stored keys are processed
+ * and only these keys are read, otherwise all installed schemas are walked.
+ */
+static gchar** _list_schemas_of_source(MigrateJob *ioJob, gboolean inEnumerateStorage)
+{
+	GError				*error;
 
-				/* Release allocated resources */
-				if(destinationSettings) g_object_unref(destinationSettings);
-				if(sourceSettings) g_object_unref(sourceSettings);
-				if(schema) g_settings_schema_unref(schema);
-				if(schemas) g_strfreev(schemas);
+	if(inEnumerateStorage)
+	{
+		error=NULL;
+		ioJob->storedKeys=_list_stored_keys(ioJob->schemaSource, &error);
+		if(ioJob->storedKeys) return(_get_sorted_keys(ioJob->storedKeys));
 
-				/* Return error */
-				return(FALSE);
-			}
+		g_warning("Could not enumerate keys stored at xfconf, checking all keys of all schemas instead: %s",
+					error ? error->message : "Unknown error");
+		if(error) g_error_free(error);
+	}
 
-			/* If we do not perform a dry-run then write value at destination backend */
-			if(!(inMode & MIGRATE_MODE_DRY_RUN))
-			{
-				if(!g_settings_set_value(destinationSettings, keyName, sourceValue))
-				{
-					g_critical("Migrating key %s of schema %s to destination backend %s failed.",
-								keyName,
-								schemaID,
-								G_OBJECT_TYPE_NAME(inDestination));
-
-					/* Release allocated resources */
-					if(sourceValue) g_variant_unref(sourceValue);
-					if(destinationSettings) g_object_unref(destinationSettings);
-					if(sourceSettings) g_object_unref(sourceSettings);
-					if(schema) g_settings_schema_unref(schema);
-					if(schemas) g_strfreev(schemas);
-
-					/* Return error */
-					return(FALSE);
-				}
+	return(_list_selected_schemas(ioJob->schemaSource));
+}
 
-				g_print("    Migrated key %s of schema %s\n",
-						keyName,
-						schemaID);
-			}
-				else
-				{
-					g_print("    Would migrate key %s of schema %s\n",
-							keyName,
-							schemaID);
-				}
+/* Create and free plan of a schema */
+static MigratePlanSchema* _plan_schema_new(const gchar *inSchemaID)
+{
+	MigratePlanSchema	*plan;
 
-			/* Release value */
-			if(sourceValue) g_variant_unref(sourceValue);
+	plan=g_new0(MigratePlanSchema, 1);
+	plan->schemaID=g_strdup(inSchemaID);
+	plan->keys=g_ptr_array_new_with_free_func(g_free);
+	plan->values=g_ptr_array_new_with_free_func((GDestroyNotify)g_variant_unref);
+
+	return(plan);
+}
+
+static void _plan_schema_free(gpointer inData)
+{
+	MigratePlanSchema	*plan=(MigratePlanSchema*)inData;
+
+	if(!plan) return;
+
+	g_ptr_array_free(plan->keys, TRUE);
+	g_ptr_array_free(plan->values, TRUE);
+	g_free(plan->schemaID);
+	g_free(plan);
+}
+
+/* Save plan of migration to file as text so it can be reviewed before it is applied */
+static gboolean _plan_save(GPtrArray *inPlan,
+							const gchar *inFilename,
+							GError **outError)
+{
+	GVariantBuilder		builder;
+	GVariant			*planVariant;
+	gchar				*text;
+	gboolean			success;
+	guint				i;
+	guint				j;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE(MIGRATE_PLAN_TYPE));
+	for(i=0; i<inPlan->len; i++)
+	{
+		MigratePlanSchema	*plan;
+
+		plan=(MigratePlanSchema*)g_ptr_array_index(inPlan, i);
+
+		g_variant_builder_open(&builder, G_VARIANT_TYPE("(sa{sv})"));
+		g_variant_builder_add(&builder, "s", plan->schemaID);
+		g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sv}"));
+		for(j=0; j<plan->keys->len; j++)
+		{
+			g_variant_builder_add(&builder,
+									"{sv}",
+									(const gchar*)g_ptr_array_index(plan->keys, j),
+									(GVariant*)g_ptr_array_index(plan->values, j));
 		}
+		g_variant_builder_close(&builder);
+		g_variant_builder_close(&builder);
+	}
+	planVariant=g_variant_ref_sink(g_variant_builder_end(&builder));
 
-		/* Release allocated resources */
-		if(keys) g_strfreev(keys);
-		if(destinationSettings) g_object_unref(destinationSettings);
-		if(sourceSettings) g_object_unref(sourceSettings);
-		if(schema) g_settings_schema_unref(schema);
+	text=g_variant_print(planVariant, TRUE);
+	success=g_file_set_contents(inFilename, text, -1, outError);
+
+	/* Release allocated resources */
+	g_free(text);
+	g_variant_unref(planVariant);
+
+	return(success);
+}
+
+/* Load plan of migration saved to file before */
+static GPtrArray* _plan_load(const gchar *inFilename, GError **outError)
+{
+	gchar				*text;
+	GVariant			*planVariant;
+	GVariantIter		schemaIter;
+	GVariantIter		*keyIter;
+	const gchar			*schemaID;
+	const gchar			*keyName;
+	GVariant			*value;
+	GPtrArray			*plans;
+
+	if(!g_file_get_contents(inFilename, &text, NULL, outError)) return(NULL);
+
+	planVariant=g_variant_parse(G_VARIANT_TYPE(MIGRATE_PLAN_TYPE), text, NULL, NULL, outError);
+	g_free(text);
+	if(!planVariant) return(NULL);
+
+	plans=g_ptr_array_new_with_free_func(_plan_schema_free);
+
+	g_variant_iter_init(&schemaIter, planVariant);
+	while(g_variant_iter_next(&schemaIter, "(&sa{sv})", &schemaID, &keyIter))
+	{
+		MigratePlanSchema	*plan;
 
-		g_print("  Migrated schema %s\n\n", schemaID);
+		plan=_plan_schema_new(schemaID);
+		while(g_variant_iter_next(keyIter, "{&sv}", &keyName, &value))
+		{
+			g_ptr_array_add(plan->keys, g_strdup(keyName));
+			g_ptr_array_add(plan->values, value);
+		}
+		g_variant_iter_free(keyIter);
+
+		g_ptr_array_add(plans, plan);
 	}
 
 	/* Release allocated resources */
-	if(schemas) g_strfreev(schemas);
+	g_variant_unref(planVariant);
 
-	/* If we get here, everything went well */
-	return(TRUE);
+	return(plans);
 }
 
-/* Main entry point */
-int main(int argc, char **argv)
+/* Get hash of a value from its type and serialized data in normal form */
+static gchar* _journal_hash_value(GVariant *inValue)
 {
-	const gchar			*fromBackendName="dconf";
-	GSettingsBackend	*fromBackend=NULL;
-	const gchar			*toBackendName="xfconf";
-	GSettingsBackend	*toBackend=NULL;
-	MigrateMode			mode=(MIGRATE_MODE_CLEAN_DESTINATION | MIGRATE_MODE_OVERWRITE);
+	GVariant			*normalValue;
+	GChecksum			*checksum;
+	const gchar			*typeString;
+	gchar				*hash;
 
-#if !GLIB_CHECK_VERSION(2, 36, 0)
-	/* Initialize GObject type system */
-	g_type_init();
-#endif
+	normalValue=g_variant_get_normal_form(inValue);
+	typeString=g_variant_get_type_string(normalValue);
+
+	checksum=g_checksum_new(G_CHECKSUM_SHA256);
+	g_checksum_update(checksum, (const guchar*)typeString, strlen(typeString)+1);
+	g_checksum_update(checksum, (const guchar*)g_variant_get_data(normalValue), g_variant_get_size(normalValue));
+	hash=g_strdup(g_checksum_get_string(checksum));
+
+	/* Release allocated resources */
+	g_checksum_free(checksum);
+	g_variant_unref(normalValue);
+
+	return(hash);
+}
+
+/* Free journal and close its file */
+static void _journal_free(MigrateJournal *inJournal)
+{
+	if(!inJournal) return;
+
+	if(inJournal->file) fclose(inJournal->file);
+	if(inJournal->entries) g_hash_table_destroy(inJournal->entries);
+	g_free(inJournal->filename);
+	g_free(inJournal);
+}
 
-	/* Get backend to migrate from */
-	fromBackend=_get_backend_by_name(fromBackendName);
-	if(!fromBackend)
+/* Load journal of last migration. A missing file is an empty journal. */
+static MigrateJournal* _journal_load(const gchar *inFilename, GError **outError)
+{
+	MigrateJournal		*journal;
+	gchar				*contents;
+	gchar				**lines;
+	gchar				**lineIter;
+	GError				*error;
+
+	journal=g_new0(MigrateJournal, 1);
+	journal->filename=g_strdup(inFilename);
+	journal->entries=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	error=NULL;
+	if(!g_file_get_contents(inFilename, &contents, NULL, &error))
 	{
-		g_critical("Could not get backend for '%s'", fromBackendName);
+		if(g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+		{
+			g_error_free(error);
+			return(journal);
+		}
 
-		/* Release allocated resources */
-		if(fromBackend) g_object_unref(fromBackend);
-		if(toBackend) g_object_unref(toBackend);
+		g_propagate_error(outError, error);
+		_journal_free(journal);
+		return(NULL);
+	}
 
-		/* Return error code */
-		return(1);
+	/* Each line is schema ID, key name and hash separated by tabs. Lines
+	 * not complete, e.g. written while migration was interrupted, are skipped.
+	 */
+	lines=g_strsplit(contents, "\n", -1);
+	for(lineIter=lines; *lineIter; lineIter++)
+	{
+		gchar			**fields;
+
+		fields=g_strsplit(*lineIter, "\t", 3);
+		if(g_strv_length(fields)==3 && *fields[0] && *fields[1] && *fields[2])
+		{
+			g_hash_table_replace(journal->entries,
+									g_strconcat(fields[0], "\t", fields[1], NULL),
+									g_strdup(fields[2]));
+		}
+		g_strfreev(fields);
 	}
 
-	/* Get backend to migrate to */
-	toBackend=_get_backend_by_name(toBackendName);
-	if(!toBackend)
+	/* Release allocated resources */
+	g_strfreev(lines);
+	g_free(contents);
+
+	return(journal);
+}
+
+/* Check if a key was migrated with the value of a hash */
+static gboolean _journal_has_value(MigrateJournal *inJournal,
+									const gchar *inSchemaID,
+									const gchar *inKeyName,
+									const gchar *inHash)
+{
+	gchar				*entryKey;
+	const gchar			*hash;
+
+	entryKey=g_strconcat(inSchemaID, "\t", inKeyName, NULL);
+	hash=(const gchar*)g_hash_table_lookup(inJournal->entries, entryKey);
+	g_free(entryKey);
+
+	return(hash && strcmp(hash, inHash)==0);
+}
+
+/* Record all keys of a schema migrated and append them to journal file so
+ * an interrupted migration continues after the last schema recorded.
+ */
+static gboolean _journal_record_schema(MigrateJob *inJob,
+										gpointer inItem,
+										MigrateSchemaResult *ioResult)
+{
+	MigrateJournal		*journal=inJob->journal;
+	MigratePlanSchema	*plan=(MigratePlanSchema*)inItem;
+	gchar				*entryKey;
+	gchar				*hash;
+	guint				i;
+
+	/* Open journal file for appending at first checkpoint */
+	if(!journal->file)
 	{
-		g_critical("Could not get backend for '%s'", toBackendName);
+		gchar			*directory;
 
-		/* Release allocated resources */
-		if(fromBackend) g_object_unref(fromBackend);
-		if(toBackend) g_object_unref(toBackend);
+		directory=g_path_get_dirname(journal->filename);
+		g_mkdir_with_parents(directory, 0700);
+		g_free(directory);
 
-		/* Return error code */
-		return(1);
+		journal->file=g_fopen(journal->filename, "a");
+		if(!journal->file)
+		{
+			ioResult->error=g_strdup_printf("Could not open journal '%s'.", journal->filename);
+			return(FALSE);
+		}
 	}
 
-	/* First do a dry run of migration to check if migration could succeed */
-	g_print("Migrating from backend '%s' using backend class %s to backend '%s' using backend class %s\n\n",
-				fromBackendName,
-				G_OBJECT_TYPE_NAME(fromBackend),
-				toBackendName,
-				G_OBJECT_TYPE_NAME(toBackend));
+	for(i=0; i<plan->keys->len; i++)
+	{
+		entryKey=g_strconcat(plan->schemaID, "\t", (const gchar*)g_ptr_array_index(plan->keys, i), NULL);
+		hash=_journal_hash_value((GVariant*)g_ptr_array_index(plan->values, i));
+
+		fprintf(journal->file, "%s\t%s\n", entryKey, hash);
+		g_hash_table_replace(journal->entries, entryKey, hash);
+	}
 
-	g_print("* PERFORMING DRY-RUN MIGRATION\n");
-	if(!_migrate(fromBackend, toBackend, mode | MIGRATE_MODE_DRY_RUN))
+	/* Checkpoint */
+	if(fflush(journal->file)!=0)
 	{
-		g_critical("Dry-run of migration failed!");
+		ioResult->error=g_strdup_printf("Could not write journal '%s'.", journal->filename);
+		return(FALSE);
+	}
 
-		/* Release allocated resources */
-		if(fromBackend) g_object_unref(fromBackend);
-		if(toBackend) g_object_unref(toBackend);
+	return(TRUE);
+}
 
-		/* Return error code */
-		return(1);
+/* Replace journal file by the latest hash of each key */
+static gboolean _journal_save(MigrateJournal *inJournal, GError **outError)
+{
+	GString				*contents;
+	GHashTableIter		iter;
+	gpointer			key;
+	gpointer			value;
+	gchar				*directory;
+	gboolean			success;
+
+	contents=g_string_new(NULL);
+	g_hash_table_iter_init(&iter, inJournal->entries);
+	while(g_hash_table_iter_next(&iter, &key, &value))
+	{
+		g_string_append_printf(contents, "%s\t%s\n", (const gchar*)key, (const gchar*)value);
 	}
-	g_print("* DRY-RUN MIGRATION WAS SUCCESSFULLY.\n\n");
 
-	if(!(mode & MIGRATE_MODE_DRY_RUN))
+	if(inJournal->file)
 	{
-		g_print("* STARTING MIGRATION\n");
-		if(!_migrate(fromBackend, toBackend, mode & ~MIGRATE_MODE_DRY_RUN))
+		fclose(inJournal->file);
+		inJournal->file=NULL;
+	}
+
+	directory=g_path_get_dirname(inJournal->filename);
+	g_mkdir_with_parents(directory, 0700);
+	g_free(directory);
+
+	success=g_file_set_contents(inJournal->filename, contents->str, contents->len, outError);
+
+	/* Release allocated resources */
+	g_string_free(contents, TRUE);
+
+	return(success);
+}
+
+/* Free archive. An archive being written but not finished is discarded
+ * and does not replace an existing file.
+ */
+static void _archive_free(MigrateArchive *inArchive)
+{
+	GCancellable		*cancellable;
+
+	if(!inArchive) return;
+
+	if(inArchive->output)
+	{
+		if(!g_output_stream_is_closed(G_OUTPUT_STREAM(inArchive->output)))
+		{
+			cancellable=g_cancellable_new();
+			g_cancellable_cancel(cancellable);
+			g_output_stream_close(G_OUTPUT_STREAM(inArchive->output), cancellable, NULL);
+			g_object_unref(cancellable);
+		}
+		g_object_unref(inArchive->output);
+	}
+	if(inArchive->input) g_object_unref(inArchive->input);
+	if(inArchive->mappedFile) g_mapped_file_unref(inArchive->mappedFile);
+	g_free(inArchive->filename);
+	g_free(inArchive);
+}
+
+/* Create archive and write its header */
+static MigrateArchive* _archive_create(const gchar *inFilename,
+										gboolean inCompress,
+										GError **outError)
+{
+	MigrateArchive		*archive;
+	GFile				*file;
+	GOutputStream		*stream;
+	GOutputStream		*filterStream;
+	GConverter			*compressor;
+	gchar				header[MIGRATE_ARCHIVE_HEADER_SIZE];
+	guint32				value;
+
+	file=g_file_new_for_path(inFilename);
+	stream=G_OUTPUT_STREAM(g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, outError));
+	g_object_unref(file);
+	if(!stream) return(NULL);
+
+	/* Header is never compressed so import can tell how to read the rest */
+	memcpy(header, MIGRATE_ARCHIVE_MAGIC, 8);
+	value=GUINT32_TO_LE(MIGRATE_ARCHIVE_VERSION);
+	memcpy(header+8, &value, 4);
+	value=GUINT32_TO_LE(inCompress ? MIGRATE_ARCHIVE_FLAG_COMPRESSED : 0);
+	memcpy(header+12, &value, 4);
+
+	if(!g_output_stream_write_all(stream, header, sizeof(header), NULL, NULL, outError))
+	{
+		/* Release allocated resources */
+		g_object_unref(stream);
+
+		/* Return error */
+		return(NULL);
+	}
+
+	if(inCompress)
+	{
+		compressor=G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB, -1));
+		filterStream=g_converter_output_stream_new(stream, compressor);
+		g_object_unref(compressor);
+		g_object_unref(stream);
+		stream=filterStream;
+	}
+
+	/* Buffer the many small writes of lengths, names and values */
+	filterStream=g_buffered_output_stream_new_sized(stream, 64*1024);
+	g_object_unref(stream);
+	stream=filterStream;
+
+	archive=g_new0(MigrateArchive, 1);
+	archive->filename=g_strdup(inFilename);
+	archive->output=g_data_output_stream_new(stream);
+	g_data_output_stream_set_byte_order(archive->output, G_DATA_STREAM_BYTE_ORDER_LITTLE_ENDIAN);
+	g_object_unref(stream);
+
+	return(archive);
+}
+
+/* Write length-prefixed data to archive */
+static gboolean _archive_write_data(MigrateArchive *inArchive,
+									gconstpointer inData,
+									gsize inSize,
+									GError **outError)
+{
+	if(inSize>G_MAXUINT32)
+	{
+		g_set_error(outError, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Value of %" G_GSIZE_FORMAT " bytes is too large", inSize);
+		return(FALSE);
+	}
+
+	if(!g_data_output_stream_put_uint32(inArchive->output, (guint32)inSize, NULL, outError)) return(FALSE);
+
+	if(inSize>0 &&
+		!g_output_stream_write_all(G_OUTPUT_STREAM(inArchive->output), inData, inSize, NULL, NULL, outError))
+	{
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+/* Write all keys and values of a plan of schema to archive */
+static gboolean _archive_write_schema(MigrateArchive *inArchive,
+										MigratePlanSchema *inPlan,
+										const gchar *inPath,
+										GError **outError)
+{
+	guint				i;
+
+	if(!_archive_write_data(inArchive, inPlan->schemaID, strlen(inPlan->schemaID), outError) ||
+		!_archive_write_data(inArchive, inPath, strlen(inPath), outError) ||
+		!g_data_output_stream_put_uint32(inArchive->output, inPlan->keys->len, NULL, outError))
+	{
+		return(FALSE);
+	}
+
+	for(i=0; i<inPlan->keys->len; i++)
+	{
+		const gchar		*keyName;
+		const gchar		*typeString;
+		GVariant		*value;
+		gboolean		success;
+
+		keyName=(const gchar*)g_ptr_array_index(inPlan->keys, i);
+
+		/* Store serialized value in normal form and little-endian byte order */
+		value=g_variant_get_normal_form((GVariant*)g_ptr_array_index(inPlan->values, i));
+#if G_BYTE_ORDER==G_BIG_ENDIAN
+		{
+			GVariant	*swappedValue;
+
+			swappedValue=g_variant_byteswap(value);
+			g_variant_unref(value);
+			value=swappedValue;
+		}
+#endif
+		typeString=g_variant_get_type_string(value);
+
+		success=(_archive_write_data(inArchive, keyName, strlen(keyName), outError) &&
+					_archive_write_data(inArchive, typeString, strlen(typeString), outError) &&
+					_archive_write_data(inArchive, g_variant_get_data(value), g_variant_get_size(value), outError));
+		g_variant_unref(value);
+
+		if(!success) return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+/* Write end of archive and close it */
+static gboolean _archive_finish(MigrateArchive *inArchive, GError **outError)
+{
+	if(!_archive_write_data(inArchive, NULL, 0, outError)) return(FALSE);
+
+	return(g_output_stream_close(G_OUTPUT_STREAM(inArchive->output), NULL, outError));
+}
+
+/* Open archive for reading. The file is mapped into memory and read
+ * sequentially so memory needed does not grow with size of archive.
+ */
+static MigrateArchive* _archive_open(const gchar *inFilename, GError **outError)
+{
+	MigrateArchive		*archive;
+	GMappedFile			*mappedFile;
+	const gchar			*contents;
+	gsize				length;
+	guint32				version;
+	guint32				flags;
+	GInputStream		*stream;
+	GInputStream		*filterStream;
+	GConverter			*decompressor;
+
+	mappedFile=g_mapped_file_new(inFilename, FALSE, outError);
+	if(!mappedFile) return(NULL);
+
+	/* Check header */
+	contents=g_mapped_file_get_contents(mappedFile);
+	length=g_mapped_file_get_length(mappedFile);
+	if(length<MIGRATE_ARCHIVE_HEADER_SIZE ||
+		memcmp(contents, MIGRATE_ARCHIVE_MAGIC, 8)!=0)
+	{
+		g_set_error(outError, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "'%s' is not an archive of settings", inFilename);
+
+		/* Release allocated resources */
+		g_mapped_file_unref(mappedFile);
+
+		/* Return error */
+		return(NULL);
+	}
+
+	memcpy(&version, contents+8, 4);
+	version=GUINT32_FROM_LE(version);
+	memcpy(&flags, contents+12, 4);
+	flags=GUINT32_FROM_LE(flags);
+	if(version!=MIGRATE_ARCHIVE_VERSION)
+	{
+		g_set_error(outError, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Version %u of archive '%s' is not supported", version, inFilename);
+
+		/* Release allocated resources */
+		g_mapped_file_unref(mappedFile);
+
+		/* Return error */
+		return(NULL);
+	}
+
+	/* Read stream of schemas right from mapped file */
+	stream=g_memory_input_stream_new_from_data(contents+MIGRATE_ARCHIVE_HEADER_SIZE,
+												length-MIGRATE_ARCHIVE_HEADER_SIZE,
+												NULL);
+	if(flags & MIGRATE_ARCHIVE_FLAG_COMPRESSED)
+	{
+		decompressor=G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+		filterStream=g_converter_input_stream_new(stream, decompressor);
+		g_object_unref(decompressor);
+		g_object_unref(stream);
+		stream=filterStream;
+	}
+
+	archive=g_new0(MigrateArchive, 1);
+	archive->filename=g_strdup(inFilename);
+	archive->mappedFile=mappedFile;
+	archive->maxDataSize=length-MIGRATE_ARCHIVE_HEADER_SIZE;
+	if(flags & MIGRATE_ARCHIVE_FLAG_COMPRESSED) archive->maxDataSize=MIN(archive->maxDataSize, G_MAXUINT32/1032)*1032;
+	archive->input=g_data_input_stream_new(stream);
+	g_data_input_stream_set_byte_order(archive->input, G_DATA_STREAM_BYTE_ORDER_LITTLE_ENDIAN);
+	g_object_unref(stream);
+
+	return(archive);
+}
+
+/* Read length-prefixed data from archive. Returned data is always terminated
+ * by a NULL byte so it can be used as string.
+ */
+static gchar* _archive_read_data(MigrateArchive *inArchive,
+									gsize *outSize,
+									GError **outError)
+{
+	GError				*error;
+	guint32				size;
+	gsize				bytesRead;
+	gchar				*data;
+
+	error=NULL;
+	size=g_data_input_stream_read_uint32(inArchive->input, NULL, &error);
+	if(error)
+	{
+		g_propagate_error(outError, error);
+		return(NULL);
+	}
+
+	/* Do not trust length of corrupted archives. Data cannot be larger than
+	 * the mapped file or what zlib can inflate it to at most.
+	 */
+	if(size>inArchive->maxDataSize)
+	{
+		g_set_error(outError, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Archive '%s' is corrupted", inArchive->filename);
+		return(NULL);
+	}
+
+	data=g_malloc((gsize)size+1);
+	if(!g_input_stream_read_all(G_INPUT_STREAM(inArchive->input), data, size, &bytesRead, NULL, outError))
+	{
+		g_free(data);
+		return(NULL);
+	}
+
+	if(bytesRead!=size)
+	{
+		g_set_error(outError, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unexpected end of archive '%s'", inArchive->filename);
+		g_free(data);
+		return(NULL);
+	}
+
+	data[size]=0;
+	if(outSize) *outSize=size;
+
+	return(data);
+}
+
+/* Read next schema from archive as plan. Sets plan to NULL at end of archive. */
+static gboolean _archive_read_schema(MigrateArchive *inArchive,
+										MigratePlanSchema **outPlan,
+										gchar **outPath,
+										GError **outError)
+{
+	MigratePlanSchema	*plan;
+	gchar				*schemaID;
+	gchar				*path;
+	gsize				size;
+	guint32				keysCount;
+	GError				*error;
+	guint				i;
+
+	*outPlan=NULL;
+	*outPath=NULL;
+
+	schemaID=_archive_read_data(inArchive, &size, outError);
+	if(!schemaID) return(FALSE);
+
+	/* An empty schema ID marks the end of archive */
+	if(size==0)
+	{
+		g_free(schemaID);
+		return(TRUE);
+	}
+
+	path=_archive_read_data(inArchive, NULL, outError);
+	if(!path)
+	{
+		g_free(schemaID);
+		return(FALSE);
+	}
+
+	error=NULL;
+	keysCount=g_data_input_stream_read_uint32(inArchive->input, NULL, &error);
+	if(error)
+	{
+		g_propagate_error(outError, error);
+
+		/* Release allocated resources */
+		g_free(path);
+		g_free(schemaID);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	plan=_plan_schema_new(schemaID);
+	g_free(schemaID);
+
+	for(i=0; i<keysCount; i++)
+	{
+		gchar			*keyName;
+		gchar			*typeString;
+		gchar			*data;
+		gsize			dataSize;
+		GVariant		*value;
+
+		keyName=_archive_read_data(inArchive, NULL, outError);
+		typeString=(keyName ? _archive_read_data(inArchive, NULL, outError) : NULL);
+		data=(typeString ? _archive_read_data(inArchive, &dataSize, outError) : NULL);
+		if(data && !g_variant_type_string_is_valid(typeString))
+		{
+			g_set_error(outError, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+						"Invalid type '%s' of key %s of schema %s in archive '%s'",
+						typeString,
+						keyName,
+						plan->schemaID,
+						inArchive->filename);
+			g_free(data);
+			data=NULL;
+		}
+
+		if(!data)
+		{
+			/* Release allocated resources */
+			g_free(typeString);
+			g_free(keyName);
+			_plan_schema_free(plan);
+			g_free(path);
+
+			/* Return error */
+			return(FALSE);
+		}
+
+		/* Value takes ownership of data. It is not trusted so it is
+		 * checked when it is accessed.
+		 */
+		value=g_variant_new_from_data(G_VARIANT_TYPE(typeString), data, dataSize, FALSE, g_free, data);
+		value=g_variant_ref_sink(value);
+#if G_BYTE_ORDER==G_BIG_ENDIAN
+		{
+			GVariant	*swappedValue;
+
+			swappedValue=g_variant_byteswap(value);
+			g_variant_unref(value);
+			value=swappedValue;
+		}
+#endif
+		g_free(typeString);
+
+		g_ptr_array_add(plan->keys, keyName);
+		g_ptr_array_add(plan->values, value);
+	}
+
+	*outPlan=plan;
+	*outPath=path;
+
+	return(TRUE);
+}
+
+/* Plan migration of all user-modified keys of a schema. Values are only read
+ * and checked but not written. If job has no destination backend, e.g. on
+ * export, all user-modified keys are planned without any check.
+ */
+static gboolean _plan_schema(MigrateJob *inJob,
+								gpointer inItem,
+								MigrateSchemaResult *ioResult)
+{
+	const gchar			*schemaID=(const gchar*)inItem;
+	GSettingsSchema		*schema;
+	gchar				**keys;
+	const gchar			**keyIter;
+	GSettings			*sourceSettings;
+	GSettings			*destinationSettings;
+	gboolean			checkDestination;
+	gint64				startTime;
+
+	ioResult->schemaID=schemaID;
+	g_string_append_printf(ioResult->output, "  Migrating schema %s\n", schemaID);
+
+	/* Get schema */
+	schema=g_settings_schema_source_lookup(inJob->schemaSource, schemaID, TRUE);
+	if(!schema)
+	{
+		ioResult->error=g_strdup_printf("Could not load schema %s.", schemaID);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Get settings from source backend */
+	sourceSettings=g_settings_new_with_backend(schemaID, inJob->source);
+	if(!sourceSettings)
+	{
+		ioResult->error=g_strdup_printf("Could load settings from source backend %s for schema %s.",
+										G_OBJECT_TYPE_NAME(inJob->source),
+										schemaID);
+
+		/* Release allocated resources */
+		if(schema) g_settings_schema_unref(schema);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Get settings from destination backend */
+	destinationSettings=NULL;
+	if(inJob->destination) destinationSettings=g_settings_new_with_backend(schemaID, inJob->destination);
+	if(inJob->destination && !destinationSettings)
+	{
+		ioResult->error=g_strdup_printf("Could create settings for destination backend %s with schema %s.",
+										G_OBJECT_TYPE_NAME(inJob->destination),
+										schemaID);
+
+		/* Release allocated resources */
+		if(sourceSettings) g_object_unref(sourceSettings);
+		if(schema) g_settings_schema_unref(schema);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Get all keys from schema or only those stored at source backend */
+	if(inJob->storedKeys) keys=g_strdupv((gchar**)g_hash_table_lookup(inJob->storedKeys, schemaID));
+		else keys=g_settings_list_keys(sourceSettings);
+	if(!keys)
+	{
+		ioResult->error=g_strdup_printf("Could get keys from settings of source backend %s for schema %s.",
+										G_OBJECT_TYPE_NAME(inJob->source),
+										schemaID);
+
+		/* Release allocated resources */
+		if(destinationSettings) g_object_unref(destinationSettings);
+		if(sourceSettings) g_object_unref(sourceSettings);
+		if(schema) g_settings_schema_unref(schema);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Existing keys at destination only matter if they cannot be overwritten.
+	 * If cleaning destination was requested assume that no key exists.
+	 */
+	checkDestination=(destinationSettings &&
+						!(inJob->mode & (MIGRATE_MODE_OVERWRITE | MIGRATE_MODE_CLEAN_DESTINATION)));
+
+	/* Read values of all keys for schema from source backend and add them
+	 * to plan if they can be written to destination backend.
+	 */
+	ioResult->plan=_plan_schema_new(schemaID);
+
+	for(keyIter=(const gchar**)keys; *keyIter; keyIter++)
+	{
+		const gchar		*keyName;
+		GVariant		*sourceValue;
+		GVariant		*destinationValue;
+
+		/* Get key name */
+		keyName=*keyIter;
+
+		/* Get user-modified value for currently iterate key from source backend.
+		 * Do not use g_settings_get_value() as it will return the default value
+		 * as defined in schema which is not needed to be migrated. Just continue
+		 * with next key in schema if there is no user-modified value.
+		 */
+		startTime=g_get_monotonic_time();
+		sourceValue=g_settings_get_user_value(sourceSettings, keyName);
+		ioResult->readTime+=g_get_monotonic_time()-startTime;
+		if(!sourceValue) continue;
+
+		/* On incremental migration skip key if its value at both backends is
+		 * still the one migrated last time.
+		 */
+		if(inJob->journal && destinationSettings)
+		{
+			gchar		*sourceHash;
+			gboolean	isUnchanged;
+
+			sourceHash=_journal_hash_value(sourceValue);
+			isUnchanged=FALSE;
+			if(_journal_has_value(inJob->journal, schemaID, keyName, sourceHash))
+			{
+				startTime=g_get_monotonic_time();
+				destinationValue=g_settings_get_user_value(destinationSettings, keyName);
+				ioResult->readTime+=g_get_monotonic_time()-startTime;
+				isUnchanged=(destinationValue && g_variant_equal(destinationValue, sourceValue));
+				if(destinationValue) g_variant_unref(destinationValue);
+			}
+			g_free(sourceHash);
+
+			if(isUnchanged)
+			{
+				ioResult->skippedKeysCount++;
+				g_variant_unref(sourceValue);
+				continue;
+			}
+		}
+
+		/* Check if key exists at destination backend and if we can overwrite it */
+		destinationValue=NULL;
+		if(checkDestination)
+		{
+			startTime=g_get_monotonic_time();
+			destinationValue=g_settings_get_user_value(destinationSettings, keyName);
+			ioResult->readTime+=g_get_monotonic_time()-startTime;
+		}
+		if(destinationValue)
+		{
+			ioResult->error=g_strdup_printf("Cannot overwrite key %s for schema %s at destination backend %s.",
+											keyName,
+											schemaID,
+											G_OBJECT_TYPE_NAME(inJob->destination));
+
+			/* Release allocated resources */
+			if(destinationValue) g_variant_unref(destinationValue);
+			if(sourceValue) g_variant_unref(sourceValue);
+			if(keys) g_strfreev(keys);
+			if(destinationSettings) g_object_unref(destinationSettings);
+			if(sourceSettings) g_object_unref(sourceSettings);
+			if(schema) g_settings_schema_unref(schema);
+
+			/* Return error */
+			return(FALSE);
+		}
+
+		/* Check if key at destination backend is writable at all */
+		if(destinationSettings &&
+			!g_settings_is_writable(destinationSettings, keyName))
+		{
+			ioResult->error=g_strdup_printf("Cannot migrate key %s for schema %s at destination backend %s because it is not writable.",
+											keyName,
+											schemaID,
+											G_OBJECT_TYPE_NAME(inJob->destination));
+
+			/* Release allocated resources */
+			if(sourceValue) g_variant_unref(sourceValue);
+			if(keys) g_strfreev(keys);
+			if(destinationSettings) g_object_unref(destinationSettings);
+			if(sourceSettings) g_object_unref(sourceSettings);
+			if(schema) g_settings_schema_unref(schema);
+
+			/* Return error */
+			return(FALSE);
+		}
+
+		/* Add key and value to plan which takes ownership of value */
+		g_ptr_array_add(ioResult->plan->keys, g_strdup(keyName));
+		g_ptr_array_add(ioResult->plan->values, sourceValue);
+		ioResult->keysCount++;
+		ioResult->bytes+=g_variant_get_size(sourceValue);
+
+		g_string_append_printf(ioResult->output,
+								"    Would migrate key %s of schema %s\n",
+								keyName,
+								schemaID);
+	}
+
+	/* Release allocated resources */
+	if(keys) g_strfreev(keys);
+	if(destinationSettings) g_object_unref(destinationSettings);
+	if(sourceSettings) g_object_unref(sourceSettings);
+	if(schema) g_settings_schema_unref(schema);
+
+	g_string_append_printf(ioResult->output, "  Migrated schema %s\n\n", schemaID);
+
+	/* If we get here, everything went well */
+	return(TRUE);
+}
+
+/* Write keys of plan changed at delayed settings to destination backend at
+ * once and check each key written. The delayed settings hand all changes
+ * over to the backend by one tree write.
+ */
+static gboolean _apply_plan_commit(MigrateJob *inJob,
+									GSettings *inSettings,
+									MigratePlanSchema *inPlan,
+									guint inFirstKey,
+									guint inLastKey,
+									MigrateSchemaResult *ioResult)
+{
+	guint				i;
+	gint64				startTime;
+
+	startTime=g_get_monotonic_time();
+	g_settings_apply(inSettings);
+	ioResult->writeTime+=g_get_monotonic_time()-startTime;
+
+	for(i=inFirstKey; i<inLastKey; i++)
+	{
+		const gchar		*keyName;
+		GVariant		*value;
+		gboolean		isWritten;
+
+		keyName=(const gchar*)g_ptr_array_index(inPlan->keys, i);
+
+		startTime=g_get_monotonic_time();
+		value=g_settings_get_user_value(inSettings, keyName);
+		ioResult->readTime+=g_get_monotonic_time()-startTime;
+		isWritten=(value && g_variant_equal(value, g_ptr_array_index(inPlan->values, i)));
+		if(value) g_variant_unref(value);
+
+		if(!isWritten)
+		{
+			ioResult->error=g_strdup_printf("Migrating key %s of schema %s to destination backend %s failed.",
+											keyName,
+											inPlan->schemaID,
+											G_OBJECT_TYPE_NAME(inJob->destination));
+
+			/* Return error */
+			return(FALSE);
+		}
+
+		g_string_append_printf(ioResult->output,
+								"    Migrated key %s of schema %s\n",
+								keyName,
+								inPlan->schemaID);
+		ioResult->keysCount++;
+		ioResult->bytes+=g_variant_get_size((GVariant*)g_ptr_array_index(inPlan->values, i));
+	}
+
+	return(TRUE);
+}
+
+/* Apply plan of a schema to destination backend without reading source
+ * backend again. Plans loaded from file are checked against the schema
+ * installed. If dry-run is turned on values are only checked.
+ */
+static gboolean _apply_plan_schema(MigrateJob *inJob,
+									gpointer inItem,
+									MigrateSchemaResult *ioResult)
+{
+	MigratePlanSchema	*plan=(MigratePlanSchema*)inItem;
+	GSettingsSchema		*schema;
+	GSettings			*destinationSettings;
+	gboolean			isBatched;
+	guint				batchStart;
+	guint				i;
+	gint64				startTime;
+
+	ioResult->schemaID=plan->schemaID;
+	g_string_append_printf(ioResult->output, "  Migrating schema %s\n", plan->schemaID);
+
+	/* Get schema */
+	schema=g_settings_schema_source_lookup(inJob->schemaSource, plan->schemaID, TRUE);
+	if(!schema)
+	{
+		ioResult->error=g_strdup_printf("Could not load schema %s.", plan->schemaID);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Get settings from destination backend */
+	destinationSettings=g_settings_new_with_backend(plan->schemaID, inJob->destination);
+	if(!destinationSettings)
+	{
+		ioResult->error=g_strdup_printf("Could create settings for destination backend %s with schema %s.",
+										G_OBJECT_TYPE_NAME(inJob->destination),
+										plan->schemaID);
+
+		/* Release allocated resources */
+		if(schema) g_settings_schema_unref(schema);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Collect changes of keys in delayed settings to write them at once
+	 * unless each key should be written on its own.
+	 */
+	isBatched=(!(inJob->mode & MIGRATE_MODE_DRY_RUN) && inJob->commitBatchSize!=1);
+	if(isBatched) g_settings_delay(destinationSettings);
+
+	/* Write value of each key in plan to destination backend */
+	batchStart=0;
+	for(i=0; i<plan->keys->len; i++)
+	{
+		const gchar			*keyName;
+		GVariant			*value;
+		GSettingsSchemaKey	*schemaKey;
+		gboolean			isValid;
+
+		keyName=(const gchar*)g_ptr_array_index(plan->keys, i);
+		value=(GVariant*)g_ptr_array_index(plan->values, i);
+
+		/* Check that key exists in schema and value fits to it */
+		isValid=FALSE;
+		if(g_settings_schema_has_key(schema, keyName))
+		{
+			schemaKey=g_settings_schema_get_key(schema, keyName);
+			isValid=(g_variant_is_of_type(value, g_settings_schema_key_get_value_type(schemaKey)) &&
+						g_settings_schema_key_range_check(schemaKey, value));
+			g_settings_schema_key_unref(schemaKey);
+		}
+
+		if(!isValid)
+		{
+			ioResult->error=g_strdup_printf("Value of key %s for schema %s in plan does not match schema.",
+											keyName,
+											plan->schemaID);
+
+			/* Release allocated resources */
+			if(destinationSettings) g_object_unref(destinationSettings);
+			if(schema) g_settings_schema_unref(schema);
+
+			/* Return error */
+			return(FALSE);
+		}
+
+		/* Check if key exists at destination backend and if we can overwrite it */
+		if(!(inJob->mode & MIGRATE_MODE_OVERWRITE))
+		{
+			GVariant		*destinationValue;
+
+			startTime=g_get_monotonic_time();
+			destinationValue=g_settings_get_user_value(destinationSettings, keyName);
+			ioResult->readTime+=g_get_monotonic_time()-startTime;
+			if(destinationValue)
+			{
+				ioResult->error=g_strdup_printf("Cannot overwrite key %s for schema %s at destination backend %s.",
+												keyName,
+												plan->schemaID,
+												G_OBJECT_TYPE_NAME(inJob->destination));
+
+				/* Release allocated resources */
+				if(destinationValue) g_variant_unref(destinationValue);
+				if(destinationSettings) g_object_unref(destinationSettings);
+				if(schema) g_settings_schema_unref(schema);
+
+				/* Return error */
+				return(FALSE);
+			}
+		}
+
+		/* Check if key at destination backend is writable at all */
+		if(!g_settings_is_writable(destinationSettings, keyName))
+		{
+			ioResult->error=g_strdup_printf("Cannot migrate key %s for schema %s at destination backend %s because it is not writable.",
+											keyName,
+											plan->schemaID,
+											G_OBJECT_TYPE_NAME(inJob->destination));
+
+			/* Release allocated resources */
+			if(destinationSettings) g_object_unref(destinationSettings);
+			if(schema) g_settings_schema_unref(schema);
+
+			/* Return error */
+			return(FALSE);
+		}
+
+		/* If we do not perform a dry-run then write value at destination backend */
+		if(!(inJob->mode & MIGRATE_MODE_DRY_RUN))
+		{
+			gboolean		isSet;
+
+			startTime=g_get_monotonic_time();
+			isSet=g_settings_set_value(destinationSettings, keyName, value);
+			ioResult->writeTime+=g_get_monotonic_time()-startTime;
+
+			if(!isSet)
+			{
+				ioResult->error=g_strdup_printf("Migrating key %s of schema %s to destination backend %s failed.",
+												keyName,
+												plan->schemaID,
+												G_OBJECT_TYPE_NAME(inJob->destination));
+
+				/* Release allocated resources */
+				if(destinationSettings) g_object_unref(destinationSettings);
+				if(schema) g_settings_schema_unref(schema);
+
+				/* Return error */
+				return(FALSE);
+			}
+
+			/* Commit batch if it is full ... */
+			if(isBatched)
+			{
+				if(inJob->commitBatchSize>0 &&
+					i+1-batchStart>=inJob->commitBatchSize)
+				{
+					if(!_apply_plan_commit(inJob, destinationSettings, plan, batchStart, i+1, ioResult))
+					{
+						/* Release allocated resources */
+						if(destinationSettings) g_object_unref(destinationSettings);
+						if(schema) g_settings_schema_unref(schema);
+
+						/* Return error */
+						return(FALSE);
+					}
+
+					batchStart=i+1;
+				}
+			}
+				/* ... or report key written on its own */
+				else
+				{
+					g_string_append_printf(ioResult->output,
+											"    Migrated key %s of schema %s\n",
+											keyName,
+											plan->schemaID);
+					ioResult->keysCount++;
+					ioResult->bytes+=g_variant_get_size(value);
+				}
+		}
+			else
+			{
+				g_string_append_printf(ioResult->output,
+										"    Would migrate key %s of schema %s\n",
+										keyName,
+										plan->schemaID);
+				ioResult->keysCount++;
+				ioResult->bytes+=g_variant_get_size(value);
+			}
+	}
+
+	/* Commit remaining keys */
+	if(isBatched &&
+		batchStart<plan->keys->len &&
+		!_apply_plan_commit(inJob, destinationSettings, plan, batchStart, plan->keys->len, ioResult))
+	{
+		/* Release allocated resources */
+		if(destinationSettings) g_object_unref(destinationSettings);
+		if(schema) g_settings_schema_unref(schema);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Release allocated resources */
+	if(destinationSettings) g_object_unref(destinationSettings);
+	if(schema) g_settings_schema_unref(schema);
+
+	g_string_append_printf(ioResult->output, "  Migrated schema %s\n\n", plan->schemaID);
+
+	/* If we get here, everything went well */
+	return(TRUE);
+}
+
+/* Check if two values are identical by comparing their serialized data in
+ * normal form. Type and size are compared first, then a hash of the data
+ * and only if hashes match the data byte by byte.
+ */
+static gboolean _verify_values_equal(GVariant *inLeft, GVariant *inRight)
+{
+	GVariant			*left;
+	GVariant			*right;
+	GBytes				*leftData;
+	GBytes				*rightData;
+	gboolean			isEqual;
+
+	left=g_variant_get_normal_form(inLeft);
+	right=g_variant_get_normal_form(inRight);
+
+	isEqual=FALSE;
+	if(g_variant_type_equal(g_variant_get_type(left), g_variant_get_type(right)) &&
+		g_variant_get_size(left)==g_variant_get_size(right))
+	{
+		leftData=g_variant_get_data_as_bytes(left);
+		rightData=g_variant_get_data_as_bytes(right);
+
+		isEqual=(g_bytes_hash(leftData)==g_bytes_hash(rightData) &&
+					g_bytes_equal(leftData, rightData));
+
+		g_bytes_unref(rightData);
+		g_bytes_unref(leftData);
+	}
+
+	/* Release allocated resources */
+	g_variant_unref(right);
+	g_variant_unref(left);
+
+	return(isEqual);
+}
+
+/* Add line of differing key to report of schema */
+static void _verify_add_difference(MigrateSchemaResult *ioResult,
+									const gchar *inSchemaID,
+									const gchar *inKeyName,
+									const gchar *inStatus,
+									GVariant *inSourceValue,
+									GVariant *inDestinationValue)
+{
+	gchar				*sourceText;
+	gchar				*destinationText;
+
+	sourceText=(inSourceValue ? g_variant_print(inSourceValue, TRUE) : g_strdup("-"));
+	destinationText=(inDestinationValue ? g_variant_print(inDestinationValue, TRUE) : g_strdup("-"));
+
+	g_string_append_printf(ioResult->report,
+							"%s\t%s\t%s\t%s\t%s\n",
+							inSchemaID,
+							inKeyName,
+							inStatus,
+							sourceText,
+							destinationText);
+	g_string_append_printf(ioResult->output,
+							"    Key %s of schema %s is %s: %s at source, %s at destination\n",
+							inKeyName,
+							inSchemaID,
+							inStatus,
+							sourceText,
+							destinationText);
+	ioResult->differentKeysCount++;
+
+	/* Release allocated resources */
+	g_free(destinationText);
+	g_free(sourceText);
+}
+
+/* Verify keys of plan of a schema by reading them again from both backends.
+ * If there is no source backend, e.g. when a plan from file was applied,
+ * the values of plan are compared. Differences do not fail the schema but
+ * are added to its report.
+ */
+static gboolean _verify_schema(MigrateJob *inJob,
+								gpointer inItem,
+								MigrateSchemaResult *ioResult)
+{
+	MigratePlanSchema	*plan=(MigratePlanSchema*)inItem;
+	GSettings			*sourceSettings;
+	GSettings			*destinationSettings;
+	gint64				startTime;
+	guint				i;
+
+	ioResult->schemaID=plan->schemaID;
+	ioResult->report=g_string_new(NULL);
+	g_string_append_printf(ioResult->output, "  Verifying schema %s\n", plan->schemaID);
+
+	/* Get settings from both backends */
+	sourceSettings=NULL;
+	if(inJob->source)
+	{
+		sourceSettings=g_settings_new_with_backend(plan->schemaID, inJob->source);
+		if(!sourceSettings)
+		{
+			ioResult->error=g_strdup_printf("Could load settings from source backend %s for schema %s.",
+											G_OBJECT_TYPE_NAME(inJob->source),
+											plan->schemaID);
+
+			/* Return error */
+			return(FALSE);
+		}
+	}
+
+	destinationSettings=g_settings_new_with_backend(plan->schemaID, inJob->destination);
+	if(!destinationSettings)
+	{
+		ioResult->error=g_strdup_printf("Could create settings for destination backend %s with schema %s.",
+										G_OBJECT_TYPE_NAME(inJob->destination),
+										plan->schemaID);
+
+		/* Release allocated resources */
+		if(sourceSettings) g_object_unref(sourceSettings);
+
+		/* Return error */
+		return(FALSE);
+	}
+
+	/* Compare each key migrated */
+	for(i=0; i<plan->keys->len; i++)
+	{
+		const gchar		*keyName;
+		GVariant		*sourceValue;
+		GVariant		*destinationValue;
+
+		keyName=(const gchar*)g_ptr_array_index(plan->keys, i);
+
+		startTime=g_get_monotonic_time();
+		if(sourceSettings) sourceValue=g_settings_get_user_value(sourceSettings, keyName);
+			else sourceValue=g_variant_ref((GVariant*)g_ptr_array_index(plan->values, i));
+		destinationValue=g_settings_get_user_value(destinationSettings, keyName);
+		ioResult->readTime+=g_get_monotonic_time()-startTime;
+
+		if(!sourceValue)
+		{
+			_verify_add_difference(ioResult, plan->schemaID, keyName, "missing at source", NULL, destinationValue);
+		}
+			else if(!destinationValue)
+			{
+				_verify_add_difference(ioResult, plan->schemaID, keyName, "missing at destination", sourceValue, NULL);
+			}
+			else if(!_verify_values_equal(sourceValue, destinationValue))
+			{
+				_verify_add_difference(ioResult, plan->schemaID, keyName, "different", sourceValue, destinationValue);
+			}
+			else
+			{
+				g_string_append_printf(ioResult->output,
+										"    Verified key %s of schema %s\n",
+										keyName,
+										plan->schemaID);
+			}
+
+		ioResult->keysCount++;
+		if(sourceValue) ioResult->bytes+=g_variant_get_size(sourceValue);
+
+		/* Release allocated resources */
+		if(destinationValue) g_variant_unref(destinationValue);
+		if(sourceValue) g_variant_unref(sourceValue);
+	}
+
+	/* Release allocated resources */
+	if(destinationSettings) g_object_unref(destinationSettings);
+	if(sourceSettings) g_object_unref(sourceSettings);
+
+	g_string_append_printf(ioResult->output, "  Verified schema %s\n\n", plan->schemaID);
+
+	/* If we get here, everything went well */
+	return(TRUE);
+}
+
+/* Free result of a schema */
+static void _migrate_schema_result_free(MigrateSchemaResult *inResult)
+{
+	if(!inResult) return;
+
+	if(inResult->output) g_string_free(inResult->output, TRUE);
+	if(inResult->report) g_string_free(inResult->report, TRUE);
+	if(inResult->plan) _plan_schema_free(inResult->plan);
+	g_free(inResult->error);
+	g_free(inResult);
+}
+
+/* Worker thread taking items from queue of job until all items are processed
+ * or job was aborted. Each worker uses its own main context for the GSettings
+ * objects it creates.
+ */
+static gpointer _migrate_worker(gpointer inUserData)
+{
+	MigrateJob				*job=(MigrateJob*)inUserData;
+	GMainContext			*context;
+	MigrateSchemaResult		*result;
+	guint					index;
+	gint64					startTime;
+
+	context=g_main_context_new();
+	g_main_context_push_thread_default(context);
+
+	while(!g_atomic_int_get(&job->aborted))
+	{
+		/* Take next item from queue */
+		index=(guint)g_atomic_int_add(&job->nextItem, 1);
+		if(index>=job->itemsCount) break;
+
+		/* Process item */
+		result=g_new0(MigrateSchemaResult, 1);
+		result->output=g_string_new(NULL);
+
+		startTime=g_get_monotonic_time();
+		result->success=(job->func)(job, job->items[index], result);
+		result->duration=g_get_monotonic_time()-startTime;
+
+		/* Dispatch events of settings objects destroyed */
+		while(g_main_context_iteration(context, FALSE));
+
+		/* Stop all workers at first error */
+		if(!result->success) g_atomic_int_set(&job->aborted, TRUE);
+
+		/* Hand result over to reporter */
+		g_mutex_lock(&job->lock);
+		job->results[index]=result;
+		g_cond_broadcast(&job->cond);
+		g_mutex_unlock(&job->lock);
+	}
+
+	g_main_context_pop_thread_default(context);
+	g_main_context_unref(context);
+
+	/* Tell reporter that no more results will come from this worker */
+	g_mutex_lock(&job->lock);
+	job->runningWorkers--;
+	g_cond_broadcast(&job->cond);
+	g_mutex_unlock(&job->lock);
+
+	return(NULL);
+}
+
+/* Print lines of each key or a JSON object of schema processed by a job */
+static void _migrate_print_result(MigrateJob *inJob, MigrateSchemaResult *inResult)
+{
+	if(!_optionJSON) g_print("%s", inResult->output->str);
+		else if(inResult->success)
+		{
+			g_print("{\"run\": \"%s\", \"schema\": \"%s\", \"keys\": %u, \"skipped_keys\": %u, \"bytes\": %" G_GUINT64_FORMAT ", \"read_us\": %" G_GINT64_FORMAT ", \"write_us\": %" G_GINT64_FORMAT ", \"duration_us\": %" G_GINT64_FORMAT "}\n",
+					inJob->name,
+					inResult->schemaID,
+					inResult->keysCount,
+					inResult->skippedKeysCount,
+					inResult->bytes,
+					inResult->readTime,
+					inResult->writeTime,
+					inResult->duration);
+		}
+
+	if(!inResult->success) g_critical("%s", inResult->error);
+}
+
+/* Print summary of a job */
+static void _migrate_print_summary(MigrateJob *inJob,
+									gboolean inSuccess,
+									guint inProcessedCount,
+									guint inKeysCount,
+									guint inSkippedKeysCount,
+									guint inThreads,
+									gint64 inElapsed,
+									gint64 inWorkTime)
+{
+	if(!_optionJSON)
+	{
+		g_print("  Processed %u of %u schemas in %.3f s using %u threads (%.3f s in single-threaded mode, speed-up %.2fx)\n",
+				inProcessedCount,
+				inJob->itemsCount,
+				inElapsed/(gdouble)G_USEC_PER_SEC,
+				inThreads,
+				inWorkTime/(gdouble)G_USEC_PER_SEC,
+				inElapsed>0 ? inWorkTime/(gdouble)inElapsed : 1.0);
+		g_print("  Processed %u keys at %.0f keys/s, skipped %u keys unchanged since last migration\n\n",
+				inKeysCount,
+				inElapsed>0 ? inKeysCount*(gdouble)G_USEC_PER_SEC/inElapsed : 0.0,
+				inSkippedKeysCount);
+	}
+		else
+		{
+			g_print("{\"run\": \"%s\", \"success\": %s, \"schemas\": %u, \"keys\": %u, \"skipped_keys\": %u, \"threads\": %u, \"elapsed_us\": %" G_GINT64_FORMAT ", \"work_us\": %" G_GINT64_FORMAT "}\n",
+					inJob->name,
+					inSuccess ? "true" : "false",
+					inProcessedCount,
+					inKeysCount,
+					inSkippedKeysCount,
+					inThreads,
+					inElapsed,
+					inWorkTime);
+		}
+}
+
+/* Process all items of a job by a pool of worker threads. Results are
+ * reported in order of items regardless which worker processed an item so
+ * the output is the same for any number of threads.
+ */
+static gboolean _migrate_run_job(MigrateJob *ioJob,
+									guint inThreads)
+{
+	GThread					**workers;
+	guint					workersCount;
+	MigrateSchemaResult		*result;
+	gboolean				success;
+	gint64					startTime;
+	gint64					elapsed;
+	gint64					workTime;
+	guint					processedCount;
+	guint					keysCount;
+	guint					skippedKeysCount;
+	guint					i;
+
+	ioJob->nextItem=0;
+	ioJob->aborted=FALSE;
+	ioJob->results=g_new0(MigrateSchemaResult*, ioJob->itemsCount+1);
+	g_mutex_init(&ioJob->lock);
+	g_cond_init(&ioJob->cond);
+
+	/* Start workers */
+	startTime=g_get_monotonic_time();
+
+	workersCount=MAX(1, MIN(inThreads, ioJob->itemsCount));
+	ioJob->runningWorkers=workersCount;
+
+	workers=g_new0(GThread*, workersCount);
+	for(i=0; i<workersCount; i++)
+	{
+		workers[i]=g_thread_new("migrate-worker", _migrate_worker, ioJob);
+	}
+
+	/* Report results in order of items. Stop at first failed item or if
+	 * an item was not processed because job was aborted.
+	 */
+	success=TRUE;
+	processedCount=0;
+	keysCount=0;
+	skippedKeysCount=0;
+	for(i=0; i<ioJob->itemsCount && success; i++)
+	{
+		g_mutex_lock(&ioJob->lock);
+		while(!ioJob->results[i] && ioJob->runningWorkers>0) g_cond_wait(&ioJob->cond, &ioJob->lock);
+		result=ioJob->results[i];
+		g_mutex_unlock(&ioJob->lock);
+
+		if(!result) break;
+
+		/* Let job handle result of item processed successfully */
+		if(result->success &&
+			ioJob->reportFunc)
+		{
+			result->success=(ioJob->reportFunc)(ioJob, ioJob->items[i], result);
+		}
+
+		/* Print result and count it if item was processed successfully */
+		_migrate_print_result(ioJob, result);
+		if(!result->success) success=FALSE;
+			else
+			{
+				processedCount++;
+				keysCount+=result->keysCount;
+				skippedKeysCount+=result->skippedKeysCount;
+			}
+	}
+
+	/* Stop and wait for workers */
+	g_atomic_int_set(&ioJob->aborted, TRUE);
+	for(i=0; i<workersCount; i++) g_thread_join(workers[i]);
+
+	elapsed=g_get_monotonic_time()-startTime;
+
+	/* Report wall-clock time against the time all schemas would have taken
+	 * if they were processed one after another.
+	 */
+	workTime=0;
+	for(i=0; i<ioJob->itemsCount; i++)
+	{
+		if(ioJob->results[i]) workTime+=ioJob->results[i]->duration;
+	}
+
+	_migrate_print_summary(ioJob,
+							success,
+							processedCount,
+							keysCount,
+							skippedKeysCount,
+							workersCount,
+							elapsed,
+							workTime);
+
+	/* Release allocated resources */
+	for(i=0; i<ioJob->itemsCount; i++) _migrate_schema_result_free(ioJob->results[i]);
+	g_free(ioJob->results);
+	ioJob->results=NULL;
+	g_free(workers);
+	g_cond_clear(&ioJob->cond);
+	g_mutex_clear(&ioJob->lock);
+
+	/* Return result */
+	return(success);
+}
+
+/* Take over plan of schema if it has any key to migrate */
+static gboolean _migrate_plan_report(MigrateJob *inJob,
+										gpointer inItem,
+										MigrateSchemaResult *ioResult)
+{
+	GPtrArray				*plan=(GPtrArray*)inJob->reportData;
+
+	if(ioResult->plan && ioResult->plan->keys->len>0)
+	{
+		g_ptr_array_add(plan, ioResult->plan);
+		ioResult->plan=NULL;
+	}
+
+	return(TRUE);
+}
+
+/* Plan migration from one backend to another one. Returns plan of all schemas
+ * with user-modified keys or NULL if migration would fail.
+ */
+static GPtrArray* _migrate_plan(GSettingsBackend *inSource,
+								gboolean inEnumerateStorage,
+								GSettingsBackend *inDestination,
+								MigrateMode inMode,
+								guint inThreads,
+								MigrateJournal *inJournal)
+{
+	MigrateJob				job={ 0, };
+	gchar					**schemas;
+	GPtrArray				*plan;
+
+	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inSource), NULL);
+	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inDestination), NULL);
+
+	/* Plan all installed schemas or those with keys stored at source */
+	job.source=inSource;
+	job.destination=inDestination;
+	job.mode=inMode;
+	job.schemaSource=g_settings_schema_source_ref(g_settings_schema_source_get_default());
+	schemas=_list_schemas_of_source(&job, inEnumerateStorage);
+
+	job.name="plan";
+	job.journal=inJournal;
+	job.func=_plan_schema;
+	job.items=(gpointer*)schemas;
+	job.itemsCount=(schemas ? g_strv_length(schemas) : 0);
+
+	plan=g_ptr_array_new_with_free_func(_plan_schema_free);
+	job.reportFunc=_migrate_plan_report;
+	job.reportData=plan;
+
+	if(!_migrate_run_job(&job, inThreads))
+	{
+		g_ptr_array_free(plan, TRUE);
+		plan=NULL;
+	}
+
+	/* Release allocated resources */
+	if(job.storedKeys) g_hash_table_destroy(job.storedKeys);
+	if(schemas) g_strfreev(schemas);
+	g_settings_schema_source_unref(job.schemaSource);
+
+	return(plan);
+}
+
+/* Apply plan of migration to destination backend. Schemas applied are recorded
+ * in journal if given.
+ */
+static gboolean _migrate_apply_plan(GPtrArray *inPlan,
+									GSettingsBackend *inDestination,
+									MigrateMode inMode,
+									guint inThreads,
+									guint inCommitBatchSize,
+									MigrateJournal *inJournal)
+{
+	MigrateJob				job={ 0, };
+	gboolean				success;
+
+	g_return_val_if_fail(inPlan, FALSE);
+	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inDestination), FALSE);
+
+	job.destination=inDestination;
+	job.mode=inMode;
+	job.schemaSource=g_settings_schema_source_ref(g_settings_schema_source_get_default());
+
+	job.name=(inMode & MIGRATE_MODE_DRY_RUN) ? "check" : "apply";
+	job.commitBatchSize=inCommitBatchSize;
+	job.func=_apply_plan_schema;
+	job.items=inPlan->pdata;
+	job.itemsCount=inPlan->len;
+
+	/* Record schemas in journal unless values are only checked */
+	if(inJournal && !(inMode & MIGRATE_MODE_DRY_RUN))
+	{
+		job.journal=inJournal;
+		job.reportFunc=_journal_record_schema;
+	}
+
+	success=_migrate_run_job(&job, inThreads);
+
+	/* Release allocated resources */
+	g_settings_schema_source_unref(job.schemaSource);
+
+	return(success);
+}
+
+/* Write differences of schema verified to report in order of schemas */
+static gboolean _migrate_verify_report(MigrateJob *inJob,
+										gpointer inItem,
+										MigrateSchemaResult *ioResult)
+{
+	MigrateVerifyReport		*report=(MigrateVerifyReport*)inJob->reportData;
+
+	report->keysCount+=ioResult->keysCount;
+	report->differentKeysCount+=ioResult->differentKeysCount;
+
+	if(ioResult->report->len>0 &&
+		fputs(ioResult->report->str, report->file)==EOF)
+	{
+		ioResult->error=g_strdup_printf("Could not write report '%s'.", report->filename);
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+/* Verify keys of plan by reading them again from both backends and write
+ * keys which differ to report. How the destination was read back is noted
+ * in the report. Returns FALSE if any key differs.
+ */
+static gboolean _migrate_verify(GPtrArray *inPlan,
+								GSettingsBackend *inSource,
+								GSettingsBackend *inDestination,
+								const gchar *inReportFilename,
+								const gchar *inReadBack,
+								guint inThreads)
+{
+	MigrateJob				job={ 0, };
+	MigrateVerifyReport		report={ 0, };
+	gchar					*directory;
+	gboolean				success;
+
+	g_return_val_if_fail(inPlan, FALSE);
+	g_return_val_if_fail(!inSource || G_IS_SETTINGS_BACKEND(inSource), FALSE);
+	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inDestination), FALSE);
+	g_return_val_if_fail(inReportFilename && *inReportFilename, FALSE);
+	g_return_val_if_fail(inReadBack && *inReadBack, FALSE);
+
+	/* Create report */
+	directory=g_path_get_dirname(inReportFilename);
+	g_mkdir_with_parents(directory, 0700);
+	g_free(directory);
+
+	report.filename=inReportFilename;
+	report.file=g_fopen(inReportFilename, "w");
+	if(!report.file)
+	{
+		g_critical("Could not create report '%s'.", inReportFilename);
+		return(FALSE);
+	}
+	fprintf(report.file, "# destination read back %s\n", inReadBack);
+	fprintf(report.file, "# schema\tkey\tstatus\tsource value\tdestination value\n");
+
+	/* Verify all schemas of plan */
+	job.name="verify";
+	job.source=inSource;
+	job.destination=inDestination;
+	job.schemaSource=g_settings_schema_source_ref(g_settings_schema_source_get_default());
+	job.func=_verify_schema;
+	job.items=inPlan->pdata;
+	job.itemsCount=inPlan->len;
+	job.reportFunc=_migrate_verify_report;
+	job.reportData=&report;
+
+	success=_migrate_run_job(&job, inThreads);
+
+	if(fclose(report.file)!=0)
+	{
+		g_critical("Could not write report '%s'.", inReportFilename);
+		success=FALSE;
+	}
+
+	if(!_optionJSON)
+	{
+		g_print("  Verified %u keys read back %s, %u keys differ (see report '%s')\n\n",
+				report.keysCount,
+				inReadBack,
+				report.differentKeysCount,
+				inReportFilename);
+	}
+		else
+		{
+			g_print("{\"run\": \"verify\", \"keys\": %u, \"different_keys\": %u, \"read_back\": \"%s\"}\n",
+					report.keysCount,
+					report.differentKeysCount,
+					inReadBack);
+		}
+
+	/* Release allocated resources */
+	g_settings_schema_source_unref(job.schemaSource);
+
+	return(success && report.differentKeysCount==0);
+}
+
+/* Verify keys of plan by running this program again with a new instance of
+ * destination backend, so values are read back from its storage and not
+ * from anything this process still holds in memory. The plan is passed to
+ * the new process in a temporary file. Returns FALSE if any key differs.
+ */
+static gboolean _migrate_verify_in_new_process(const gchar *inProgram,
+												GPtrArray *inPlan,
+												const gchar *inSourceName,
+												const gchar *inDestinationName,
+												const gchar *inReportFilename,
+												guint inThreads)
+{
+	GPtrArray				*arguments;
+	gchar					**environment;
+	gchar					*planFilename;
+	gchar					*threads;
+	gint					fd;
+	gint					status;
+	GError					*error;
+	gboolean				success;
+
+	g_return_val_if_fail(inProgram && *inProgram, FALSE);
+	g_return_val_if_fail(inPlan, FALSE);
+	g_return_val_if_fail(inDestinationName && *inDestinationName, FALSE);
+	g_return_val_if_fail(inReportFilename && *inReportFilename, FALSE);
+
+	/* Save plan to temporary file for new process */
+	error=NULL;
+	fd=g_file_open_tmp("migrate-verify-XXXXXX.plan", &planFilename, &error);
+	if(fd<0)
+	{
+		g_critical("Could not create temporary plan to verify: %s",
+					error ? error->message : "Unknown error");
+
+		/* Release allocated resources */
+		if(error) g_error_free(error);
+
+		return(FALSE);
+	}
+	g_close(fd, NULL);
+
+	if(!_plan_save(inPlan, planFilename, &error))
+	{
+		g_critical("Could not save temporary plan to '%s': %s",
+					planFilename,
+					error ? error->message : "Unknown error");
+
+		/* Release allocated resources */
+		if(error) g_error_free(error);
+		g_unlink(planFilename);
+		g_free(planFilename);
+
+		return(FALSE);
+	}
+
+	/* Run this program again to verify plan. Its output goes to the same
+	 * terminal and its exit status tells if all keys were verified.
+	 */
+	threads=g_strdup_printf("%u", inThreads);
+
+	arguments=g_ptr_array_new();
+	g_ptr_array_add(arguments, (gpointer)inProgram);
+	g_ptr_array_add(arguments, "--verify-plan");
+	g_ptr_array_add(arguments, planFilename);
+	g_ptr_array_add(arguments, "--verify-report");
+	g_ptr_array_add(arguments, (gpointer)inReportFilename);
+	g_ptr_array_add(arguments, "--to");
+	g_ptr_array_add(arguments, (gpointer)inDestinationName);
+	if(inSourceName)
+	{
+		g_ptr_array_add(arguments, "--from");
+		g_ptr_array_add(arguments, (gpointer)inSourceName);
+	}
+	g_ptr_array_add(arguments, "--threads");
+	g_ptr_array_add(arguments, threads);
+	if(_optionJSON) g_ptr_array_add(arguments, "--json");
+	g_ptr_array_add(arguments, NULL);
+
+	environment=g_environ_unsetenv(g_get_environ(), MIGRATE_XFCONF_ENV_SNAPSHOT);
+
+	success=g_spawn_sync(NULL,
+							(gchar**)arguments->pdata,
+							environment,
+							G_SPAWN_SEARCH_PATH,
+							NULL,
+							NULL,
+							NULL,
+							NULL,
+							&status,
+							&error);
+#if GLIB_CHECK_VERSION(2, 70, 0)
+	if(success) success=g_spawn_check_wait_status(status, &error);
+#else
+	if(success) success=g_spawn_check_exit_status(status, &error);
+#endif
+	if(!success)
+	{
+		g_critical("Could not verify plan in new process: %s",
+					error ? error->message : "Unknown error");
+		if(error) g_error_free(error);
+	}
+
+	/* Release allocated resources */
+	g_strfreev(environment);
+	g_ptr_array_free(arguments, TRUE);
+	g_free(threads);
+	g_unlink(planFilename);
+	g_free(planFilename);
+
+	return(success);
+}
+
+/* Write plan of schema to archive as soon as it is reported and free it
+ * so memory needed by export does not grow with number of schemas.
+ */
+static gboolean _migrate_export_report(MigrateJob *inJob,
+										gpointer inItem,
+										MigrateSchemaResult *ioResult)
+{
+	MigrateArchive			*archive=(MigrateArchive*)inJob->reportData;
+	GSettingsSchema			*schema;
+	GError					*error;
+	gboolean				success;
+
+	if(!ioResult->plan || ioResult->plan->keys->len==0) return(TRUE);
+
+	schema=g_settings_schema_source_lookup(inJob->schemaSource, ioResult->plan->schemaID, TRUE);
+	if(!schema)
+	{
+		ioResult->error=g_strdup_printf("Could not load schema %s.", ioResult->plan->schemaID);
+		return(FALSE);
+	}
+
+	error=NULL;
+	success=_archive_write_schema(archive, ioResult->plan, g_settings_schema_get_path(schema), &error);
+	if(!success)
+	{
+		ioResult->error=g_strdup_printf("Could not write schema %s to archive '%s': %s",
+										ioResult->plan->schemaID,
+										archive->filename,
+										error ? error->message : "Unknown error");
+		if(error) g_error_free(error);
+	}
+
+	/* Release allocated resources */
+	g_settings_schema_unref(schema);
+	_plan_schema_free(ioResult->plan);
+	ioResult->plan=NULL;
+
+	return(success);
+}
+
+/* Export all user-modified values of source backend to archive */
+static gboolean _migrate_export(GSettingsBackend *inSource,
+								gboolean inEnumerateStorage,
+								const gchar *inFilename,
+								gboolean inCompress,
+								guint inThreads)
+{
+	MigrateJob				job={ 0, };
+	MigrateArchive			*archive;
+	gchar					**schemas;
+	GError					*error;
+	gboolean				success;
+
+	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inSource), FALSE);
+	g_return_val_if_fail(inFilename && *inFilename, FALSE);
+
+	error=NULL;
+	archive=_archive_create(inFilename, inCompress, &error);
+	if(!archive)
+	{
+		g_critical("Could not create archive '%s': %s",
+					inFilename,
+					error ? error->message : "Unknown error");
+		if(error) g_error_free(error);
+		return(FALSE);
+	}
+
+	/* Plan all user-modified keys without any destination backend */
+	job.name="export";
+	job.source=inSource;
+	job.mode=MIGRATE_MODE_DRY_RUN;
+	job.schemaSource=g_settings_schema_source_ref(g_settings_schema_source_get_default());
+	schemas=_list_schemas_of_source(&job, inEnumerateStorage);
+
+	job.func=_plan_schema;
+	job.items=(gpointer*)schemas;
+	job.itemsCount=(schemas ? g_strv_length(schemas) : 0);
+	job.reportFunc=_migrate_export_report;
+	job.reportData=archive;
+
+	success=_migrate_run_job(&job, inThreads);
+	if(success && !_archive_finish(archive, &error))
+	{
+		g_critical("Could not write archive '%s': %s",
+					inFilename,
+					error ? error->message : "Unknown error");
+		g_clear_error(&error);
+		success=FALSE;
+	}
+
+	/* Release allocated resources */
+	_archive_free(archive);
+	if(job.storedKeys) g_hash_table_destroy(job.storedKeys);
+	if(schemas) g_strfreev(schemas);
+	g_settings_schema_source_unref(job.schemaSource);
+
+	return(success);
+}
+
+/* Import values of archive to destination backend. Schemas are read and
+ * written one after another each by one tree write unless commit batch size
+ * is set.
+ */
+static gboolean _migrate_import(const gchar *inFilename,
+								GSettingsBackend *inDestination,
+								MigrateMode inMode,
+								guint inCommitBatchSize)
+{
+	MigrateJob				job={ 0, };
+	MigrateArchive			*archive;
+	MigratePlanSchema		*plan;
+	gchar					*path;
+	MigrateSchemaResult		*result;
+	GSettingsSchema			*schema;
+	GError					*error;
+	gboolean				success;
+	gint64					startTime;
+	gint64					schemaStartTime;
+	gint64					workTime;
+	guint					processedCount;
+	guint					keysCount;
+
+	g_return_val_if_fail(inFilename && *inFilename, FALSE);
+	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inDestination), FALSE);
+
+	error=NULL;
+	archive=_archive_open(inFilename, &error);
+	if(!archive)
+	{
+		g_critical("Could not open archive '%s': %s",
+					inFilename,
+					error ? error->message : "Unknown error");
+		if(error) g_error_free(error);
+		return(FALSE);
+	}
+
+	job.name=(inMode & MIGRATE_MODE_DRY_RUN) ? "check" : "import";
+	job.destination=inDestination;
+	job.mode=inMode;
+	job.schemaSource=g_settings_schema_source_ref(g_settings_schema_source_get_default());
+	job.commitBatchSize=inCommitBatchSize;
+
+	startTime=g_get_monotonic_time();
+	workTime=0;
+	processedCount=0;
+	keysCount=0;
+	success=TRUE;
+	while(success)
+	{
+		/* Read next schema */
+		if(!_archive_read_schema(archive, &plan, &path, &error))
+		{
+			g_critical("Could not read archive '%s': %s",
+						inFilename,
+						error ? error->message : "Unknown error");
+			g_clear_error(&error);
+			success=FALSE;
+			break;
+		}
+
+		if(!plan) break;
+
+		if(!_is_schema_selected(plan->schemaID))
+		{
+			_plan_schema_free(plan);
+			g_free(path);
+			continue;
+		}
+
+		job.itemsCount++;
+
+		result=g_new0(MigrateSchemaResult, 1);
+		result->output=g_string_new(NULL);
+		result->schemaID=plan->schemaID;
+
+		/* Values were exported from the path of schema so they must
+		 * not be imported if schema was moved since.
+		 */
+		schema=g_settings_schema_source_lookup(job.schemaSource, plan->schemaID, TRUE);
+		if(schema && g_strcmp0(g_settings_schema_get_path(schema), path)!=0)
+		{
+			result->error=g_strdup_printf("Schema %s is located at %s but archive has values for %s.",
+											plan->schemaID,
+											g_settings_schema_get_path(schema),
+											path);
+		}
+			else
+			{
+				schemaStartTime=g_get_monotonic_time();
+				result->success=_apply_plan_schema(&job, plan, result);
+				result->duration=g_get_monotonic_time()-schemaStartTime;
+			}
+
+		_migrate_print_result(&job, result);
+		if(result->success)
+		{
+			processedCount++;
+			keysCount+=result->keysCount;
+		}
+			else success=FALSE;
+		workTime+=result->duration;
+
+		/* Release allocated resources */
+		_migrate_schema_result_free(result);
+		if(schema) g_settings_schema_unref(schema);
+		_plan_schema_free(plan);
+		g_free(path);
+	}
+
+	_migrate_print_summary(&job,
+							success,
+							processedCount,
+							keysCount,
+							0,
+							1,
+							g_get_monotonic_time()-startTime,
+							workTime);
+
+	/* Release allocated resources */
+	_archive_free(archive);
+	g_settings_schema_source_unref(job.schemaSource);
+
+	return(success);
+}
+
+/* Main entry point */
+int main(int argc, char **argv)
+{
+	const gchar			*fromBackendName;
+	GSettingsBackend	*fromBackend=NULL;
+	const gchar			*toBackendName;
+	GSettingsBackend	*toBackend=NULL;
+	GSettingsBackend	*backend;
+	MigrateMode			mode=0;
+	GOptionContext		*context;
+	GError				*error;
+	guint				threads;
+	GPtrArray			*plan;
+	MigrateJournal		*journal;
+	gchar				*journalFilename;
+	guint				i;
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+	/* Initialize GObject type system */
+	g_type_init();
+#endif
+
+	/* Parse command-line options */
+	error=NULL;
+	context=g_option_context_new("[export FILE | import FILE] - migrate GSettings from one backend to another (default: dconf to xfconf)");
+	g_option_context_add_main_entries(context, _options, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+
+		/* Release allocated resources */
+		g_error_free(error);
+		g_option_context_free(context);
+
+		/* Return error code */
+		return(1);
+	}
+	g_option_context_free(context);
+
+	fromBackendName=(_optionFrom ? _optionFrom : "dconf");
+	toBackendName=(_optionTo ? _optionTo : "xfconf");
+	threads=(_optionThreads>0 ? (guint)_optionThreads : g_get_num_processors());
+	if(_optionDryRun) mode|=MIGRATE_MODE_DRY_RUN;
+	if(_optionCleanDestination) mode|=MIGRATE_MODE_CLEAN_DESTINATION;
+	if(_optionOverwrite) mode|=MIGRATE_MODE_OVERWRITE;
+
+	/* Nothing is written on dry-run so there is nothing to verify */
+	if((mode & MIGRATE_MODE_DRY_RUN) && (_optionVerify || _optionVerifyReport))
+	{
+		g_printerr("Options --verify and --verify-report cannot be used with --dry-run\n");
+
+		/* Return error code */
+		return(1);
+	}
+
+	_includePatterns=_compile_patterns(_optionIncludes);
+	_excludePatterns=_compile_patterns(_optionExcludes);
+
+	/* Verify plan saved by process which migrated it at a new instance of
+	 * destination backend if requested.
+	 */
+	if(_optionVerifyPlan)
+	{
+		gboolean		success;
+
+		plan=_plan_load(_optionVerifyPlan, &error);
+		if(!plan)
+		{
+			g_critical("Could not load plan from '%s': %s",
+						_optionVerifyPlan,
+						error ? error->message : "Unknown error");
+
+			/* Release allocated resources */
+			if(error) g_error_free(error);
+
+			/* Return error code */
+			return(1);
+		}
+
+		if(_optionFrom) fromBackend=_get_backend_by_name(fromBackendName);
+		toBackend=_get_backend_by_name(toBackendName);
+		if((_optionFrom && !fromBackend) || !toBackend || !_optionVerifyReport)
+		{
+			g_critical("Could not get backends or report to verify plan '%s'", _optionVerifyPlan);
+
+			/* Release allocated resources */
+			g_ptr_array_free(plan, TRUE);
+			if(fromBackend) g_object_unref(fromBackend);
+			if(toBackend) g_object_unref(toBackend);
+
+			/* Return error code */
+			return(1);
+		}
+
+		success=_migrate_verify(plan,
+								fromBackend,
+								toBackend,
+								_optionVerifyReport,
+								MIGRATE_VERIFY_READ_BACK_NEW_PROCESS,
+								threads);
+
+		/* Release allocated resources */
+		g_ptr_array_free(plan, TRUE);
+		if(fromBackend) g_object_unref(fromBackend);
+		g_object_unref(toBackend);
+
+		/* Return status code */
+		return(success ? 0 : 1);
+	}
+
+	/* Export values of source backend to archive or import them from archive
+	 * to destination backend if requested.
+	 */
+	if(argc>1)
+	{
+		const gchar		*backendName;
+		gboolean		isExport;
+		gboolean		success;
+
+		isExport=(g_strcmp0(argv[1], "export")==0);
+		if(argc!=3 ||
+			(!isExport && g_strcmp0(argv[1], "import")!=0))
+		{
+			g_printerr("Usage: %s [OPTION...] [export FILE | import FILE]\n", g_get_prgname());
+
+			/* Return error code */
+			return(1);
+		}
+
+		backendName=(isExport ? fromBackendName : toBackendName);
+		backend=_get_backend_by_name(backendName);
+		if(!backend)
+		{
+			g_critical("Could not get backend for '%s'", backendName);
+
+			/* Return error code */
+			return(1);
+		}
+
+		if(isExport)
+		{
+			_print_progress("Exporting from backend '%s' using backend class %s to archive '%s'\n\n",
+								backendName,
+								G_OBJECT_TYPE_NAME(backend),
+								argv[2]);
+			success=_migrate_export(backend,
+										_can_enumerate_storage(backendName),
+										argv[2],
+										_optionCompress,
+										threads);
+		}
+			else
+			{
+				_print_progress("Importing from archive '%s' to backend '%s' using backend class %s\n\n",
+									argv[2],
+									backendName,
+									G_OBJECT_TYPE_NAME(backend));
+				success=_migrate_import(argv[2], backend, mode, MAX(0, _optionCommitBatchSize));
+			}
+
+		if(!success) g_critical("%s failed!", isExport ? "Export" : "Import");
+
+		/* Release allocated resources */
+		g_object_unref(backend);
+
+		/* Return status code */
+		return(success ? 0 : 1);
+	}
+
+	/* Load journal of last migration if migration is incremental */
+	journal=NULL;
+	if(_optionIncremental || _optionJournal)
+	{
+		if(_optionJournal) journalFilename=g_strdup(_optionJournal);
+			else journalFilename=g_build_filename(g_get_user_cache_dir(), "xfconf-gsettings", "migrate.journal", NULL);
+
+		journal=_journal_load(journalFilename, &error);
+		if(!journal)
+		{
+			g_critical("Could not load journal from '%s': %s",
+						journalFilename,
+						error ? error->message : "Unknown error");
+
+			/* Release allocated resources */
+			if(error) g_error_free(error);
+			g_free(journalFilename);
+
+			/* Return error code */
+			return(1);
+		}
+
+		g_free(journalFilename);
+	}
+
+	/* Get backend to migrate from unless a plan is applied */
+	if(!_optionApplyPlan)
+	{
+		fromBackend=_get_backend_by_name(fromBackendName);
+		if(!fromBackend)
+		{
+			g_critical("Could not get backend for '%s'", fromBackendName);
+
+			/* Release allocated resources */
+			if(fromBackend) g_object_unref(fromBackend);
+			if(toBackend) g_object_unref(toBackend);
+			_journal_free(journal);
+
+			/* Return error code */
+			return(1);
+		}
+	}
+
+	/* Get backend to migrate to */
+	toBackend=_get_backend_by_name(toBackendName);
+	if(!toBackend)
+	{
+		g_critical("Could not get backend for '%s'", toBackendName);
+
+		/* Release allocated resources */
+		if(fromBackend) g_object_unref(fromBackend);
+		if(toBackend) g_object_unref(toBackend);
+		_journal_free(journal);
+
+		/* Return error code */
+		return(1);
+	}
+
+	/* Either load plan saved before ... */
+	if(_optionApplyPlan)
+	{
+		_print_progress("Migrating from plan '%s' to backend '%s' using backend class %s\n\n",
+					_optionApplyPlan,
+					toBackendName,
+					G_OBJECT_TYPE_NAME(toBackend));
+
+		plan=_plan_load(_optionApplyPlan, &error);
+		if(!plan)
+		{
+			g_critical("Could not load plan from '%s': %s",
+						_optionApplyPlan,
+						error ? error->message : "Unknown error");
+
+			/* Release allocated resources */
+			if(error) g_error_free(error);
+			if(fromBackend) g_object_unref(fromBackend);
+			if(toBackend) g_object_unref(toBackend);
+			_journal_free(journal);
+
+			/* Return error code */
+			return(1);
+		}
+
+		/* Drop schemas not selected by globs to include and exclude */
+		for(i=plan->len; i>0; i--)
+		{
+			MigratePlanSchema	*planSchema;
+
+			planSchema=(MigratePlanSchema*)g_ptr_array_index(plan, i-1);
+			if(!_is_schema_selected(planSchema->schemaID)) g_ptr_array_remove_index(plan, i-1);
+		}
+	}
+		/* ... or do a dry run of migration to check if migration could succeed
+		 * and to get the plan of keys and values to migrate.
+		 */
+		else
+		{
+			_print_progress("Migrating from backend '%s' using backend class %s to backend '%s' using backend class %s\n\n",
+						fromBackendName,
+						G_OBJECT_TYPE_NAME(fromBackend),
+						toBackendName,
+						G_OBJECT_TYPE_NAME(toBackend));
+
+			_print_progress("* PERFORMING DRY-RUN MIGRATION\n");
+			plan=_migrate_plan(fromBackend,
+								_can_enumerate_storage(fromBackendName),
+								toBackend,
+								mode | MIGRATE_MODE_DRY_RUN,
+								threads,
+								journal);
+			if(!plan)
+			{
+				g_critical("Dry-run of migration failed!");
+
+				/* Release allocated resources */
+				if(fromBackend) g_object_unref(fromBackend);
+				if(toBackend) g_object_unref(toBackend);
+				_journal_free(journal);
+
+				/* Return error code */
+				return(1);
+			}
+			_print_progress("* DRY-RUN MIGRATION WAS SUCCESSFULLY.\n\n");
+
+			/* Save plan if requested */
+			if(_optionSavePlan && !_plan_save(plan, _optionSavePlan, &error))
+			{
+				g_critical("Could not save plan to '%s': %s",
+							_optionSavePlan,
+							error ? error->message : "Unknown error");
+
+				/* Release allocated resources */
+				if(error) g_error_free(error);
+				g_ptr_array_free(plan, TRUE);
+				if(fromBackend) g_object_unref(fromBackend);
+				if(toBackend) g_object_unref(toBackend);
+				_journal_free(journal);
+
+				/* Return error code */
+				return(1);
+			}
+		}
+
+	/* Apply plan without reading source backend again. A plan loaded from
+	 * file is checked also on dry-run.
+	 */
+	if(!(mode & MIGRATE_MODE_DRY_RUN) || _optionApplyPlan)
+	{
+		_print_progress("* STARTING MIGRATION\n");
+		if(!_migrate_apply_plan(plan, toBackend, mode, threads, MAX(0, _optionCommitBatchSize), journal))
+		{
+			g_critical("Migration failed!");
+
+			/* Release allocated resources */
+			g_ptr_array_free(plan, TRUE);
+			if(fromBackend) g_object_unref(fromBackend);
+			if(toBackend) g_object_unref(toBackend);
+			_journal_free(journal);
+
+			/* Return error code */
+			return(1);
+		}
+		_print_progress("* MIGRATION DONE!\n\n");
+
+		/* Compact journal to the latest hash of each key */
+		if(journal &&
+			!(mode & MIGRATE_MODE_DRY_RUN) &&
+			!_journal_save(journal, &error))
+		{
+			g_warning("Could not save journal to '%s': %s",
+						journal->filename,
+						error ? error->message : "Unknown error");
+			g_clear_error(&error);
+		}
+	}
+
+	/* Verify migrated keys by reading them again from both backends */
+	if(_optionVerify || _optionVerifyReport)
+	{
+		gchar			*reportFilename;
+		gboolean		success;
+
+		if(_optionVerifyReport) reportFilename=g_strdup(_optionVerifyReport);
+			else reportFilename=g_build_filename(g_get_user_cache_dir(), "xfconf-gsettings", "migrate-verify.report", NULL);
+
+		/* Make sure all values written to destination backend are stored
+		 * before reading them again. g_settings_sync() would only sync the
+		 * default backend.
+		 */
+		if(G_SETTINGS_BACKEND_GET_CLASS(toBackend)->sync)
+		{
+			G_SETTINGS_BACKEND_GET_CLASS(toBackend)->sync(toBackend);
+		}
+
+		/* Read destination back by a new process as this process may still
+		 * hold the values written in memory, e.g. in a cache of the backend.
+		 * Backends keeping values in memory only can just be read back here.
+		 */
+		_print_progress("* VERIFYING MIGRATION\n");
+		if(_can_read_back_in_new_process(toBackendName))
+		{
+			success=_migrate_verify_in_new_process(argv[0],
+													plan,
+													fromBackend ? fromBackendName : NULL,
+													toBackendName,
+													reportFilename,
+													threads);
+		}
+			else
+			{
+				success=_migrate_verify(plan,
+										fromBackend,
+										toBackend,
+										reportFilename,
+										MIGRATE_VERIFY_READ_BACK_THIS_PROCESS,
+										threads);
+			}
+		g_free(reportFilename);
+		if(!success)
 		{
-			g_critical("Dry-run of migration failed!");
+			g_critical("Verification of migration failed!");
 
 			/* Release allocated resources */
+			g_ptr_array_free(plan, TRUE);
 			if(fromBackend) g_object_unref(fromBackend);
 			if(toBackend) g_object_unref(toBackend);
+			_journal_free(journal);
 
 			/* Return error code */
 			return(1);
 		}
-		g_print("* MIGRATION DONE!\n\n");
+		_print_progress("* VERIFICATION DONE!\n\n");
 	}
 
 	/* Release allocated resources */
+	g_ptr_array_free(plan, TRUE);
 	if(fromBackend) g_object_unref(fromBackend);
 	if(toBackend) g_object_unref(toBackend);
+	_journal_free(journal);
 
 	/* Return success status code */
 	return(0);
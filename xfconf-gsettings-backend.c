@@ -24,26 +24,111 @@
 #define G_SETTINGS_ENABLE_BACKEND
 #include <gio/gsettingsbackend.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 
 #include <xfconf/xfconf.h>
 
-/* If defined variants are stored as an array containing magic number,
- * signature and value. If it is not defined variants are stored just
- * as a serialized string.
- */
-#undef STORE_COMPLEX_VARIANTS
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-/* If defined print debug message. Do not define for silence ;) */
-#define DEBUG
+/* If defined print debug message. Do not define for silence ;)
+ * To measure the backend at runtime use tracing (see XFCONF_SETTINGS_ENV_TRACE).
+ */
+/* #define DEBUG */
 
 
 /* Definitions */
 #define XFCONF_SETTINGS_CHANNEL			"xfconf-gsettings"
 
-#ifdef STORE_COMPLEX_VARIANTS
+/* Changes made by other processes which arrive within this interval (in
+ * milliseconds) are emitted at once. If more keys than the threshold changed
+ * below the common path of all changed keys, the whole path is announced as
+ * changed instead of listing each key.
+ */
+#define XFCONF_SETTINGS_CHANGES_COALESCE_INTERVAL	25
+#define XFCONF_SETTINGS_CHANGES_PATH_THRESHOLD		64
+
+/* If write-behind is enabled by setting this environment variable, writes
+ * return at once and are stored in xfconf after this interval (in milliseconds).
+ * All writes to the same key within this interval are stored only once.
+ */
+#define XFCONF_SETTINGS_ENV_WRITE_BEHIND			"XFCONF_GSETTINGS_WRITE_BEHIND"
+#define XFCONF_SETTINGS_WRITE_BEHIND_INTERVAL		50
+
+/* Variants of types which cannot be mapped to a type xfconf understands are
+ * stored in the format selected by this environment variable:
+ * - "text" (default) stores the variant as serialized string which can be
+ *   edited with xfce4-settings-editor,
+ * - "struct" stores an array of magic number, signature and serialized string,
+ * - "binary" stores an array of magic number, signature and the variant's
+ *   data in normal form encoded as base64.
+ * Values stored in another format are read and rewritten in the selected
+ * format lazily.
+ */
+#define XFCONF_SETTINGS_ENV_STORAGE				"XFCONF_GSETTINGS_STORAGE"
+
+/* Keys can be spread over multiple channels by the policy selected by this
+ * environment variable:
+ * - "none" (default) stores all keys in the channel XFCONF_SETTINGS_CHANNEL,
+ * - "schema" stores keys in one channel per path, i.e. per schema,
+ * - "depth:N" stores keys in one channel per first N path components.
+ * The channel of a shard is named like XFCONF_SETTINGS_CHANNEL followed by
+ * a dash and the path components joined by dots. Keys keep their full path
+ * in a shard.
+ */
+#define XFCONF_SETTINGS_ENV_SHARDING			"XFCONF_GSETTINGS_SHARDING"
+
+/* If this environment variable is enabled, keys not found in their shard are
+ * read from the unsharded channel and reset there as well. It is only needed
+ * for keys stored before sharding was enabled and costs an additional request
+ * to xfconf for each path not found in its shard, so it is disabled by default.
+ */
+#define XFCONF_SETTINGS_ENV_SHARDING_LEGACY	"XFCONF_GSETTINGS_SHARDING_LEGACY"
+
+/* If tracing is enabled by setting this environment variable, each call of
+ * a virtual function is recorded as event in a ring buffer of the calling
+ * thread and counted in a latency histogram of the virtual function. The
+ * histograms and the most recent events are printed at module unload or by
+ * calling xfconf_settings_backend_dump_trace().
+ */
+#define XFCONF_SETTINGS_ENV_TRACE				"XFCONF_GSETTINGS_TRACE"
+#define XFCONF_SETTINGS_TRACE_RING_SIZE			1024
+#define XFCONF_SETTINGS_TRACE_DUMP_EVENTS		32
+#define XFCONF_SETTINGS_TRACE_BUCKETS			32
+
+/* Values are stored by the engine selected by this environment variable:
+ * - "xfconf" (default) stores values in xfconfd,
+ * - "memory" keeps values in hash tables of this process only, e.g. to test
+ *   or measure the backend without D-Bus and xfconfd.
+ */
+#define XFCONF_SETTINGS_ENV_ENGINE				"XFCONF_GSETTINGS_ENGINE"
+
+/* Well-known name of xfconfd at session bus. Lock states of properties are
+ * configured by the system and read by xfconfd at start, so they may change
+ * only if another xfconfd owns this name.
+ */
+#define XFCONF_SETTINGS_XFCONFD_BUS_NAME		"org.xfce.Xfconf"
+
+/* If snapshots are enabled by setting this environment variable, the values
+ * of a channel are written to a snapshot file in the user's cache directory
+ * shortly after changes were committed. A backend created later maps this
+ * file into memory and serves reads from it until the path of a key is loaded
+ * into the cache of the channel, so the first reads of a new process need no
+ * request to xfconfd.
+ * A snapshot is stale if the file the engine saves the channel to changed
+ * since the snapshot was written or if its generation in the header was
+ * cleared by a process which changed a value. Stale snapshots are not used.
+ */
+#define XFCONF_SETTINGS_ENV_SNAPSHOT			"XFCONF_GSETTINGS_SNAPSHOT"
+#define XFCONF_SETTINGS_SNAPSHOT_WRITE_DELAY	2000
+#define XFCONF_SETTINGS_SNAPSHOT_MAGIC			((guint32)('X' << 24 | 'G' << 16 | 'S' << 8 | 's'))
+#define XFCONF_SETTINGS_SNAPSHOT_VERSION		1
+
 #define XFCONF_VARIANT_STRUCT_MAGIC		((guint32)('G' << 24 | 'V' << 16 | 'a' << 8 | 'r'))
-#define XFCONF_VARIANT_STRUCT_NAME		"xfconf-gsettings-variant-struct"
-#endif
+#define XFCONF_VARIANT_BINARY_MAGIC		((guint32)('G' << 24 | 'V' << 16 | 'b' << 8 | 'n'))
 
 /* Define this class in GObject system */
 typedef struct _XfconfSettingsBackendClass					XfconfSettingsBackendClass;
@@ -54,6 +139,68 @@ struct _XfconfSettingsBackendClass
 	GSettingsBackendClass	parent_class;
 };
 
+typedef struct _XfconfSettingsBackendCache					XfconfSettingsBackendCache;
+typedef struct _XfconfSettingsBackendEngine				XfconfSettingsBackendEngine;
+
+/* Formats to store complex variants in */
+typedef enum
+{
+	XFCONF_SETTINGS_BACKEND_STORAGE_TEXT=0,
+	XFCONF_SETTINGS_BACKEND_STORAGE_STRUCT,
+	XFCONF_SETTINGS_BACKEND_STORAGE_BINARY
+} XfconfSettingsBackendStorage;
+
+/* Policies to spread keys over multiple channels */
+typedef enum
+{
+	XFCONF_SETTINGS_BACKEND_SHARDING_NONE=0,
+	XFCONF_SETTINGS_BACKEND_SHARDING_SCHEMA,
+	XFCONF_SETTINGS_BACKEND_SHARDING_DEPTH
+} XfconfSettingsBackendSharding;
+
+/* Virtual functions of GSettingsBackend for which requests to xfconf are counted */
+typedef enum
+{
+	XFCONF_SETTINGS_BACKEND_VFUNC_READ=0,
+	XFCONF_SETTINGS_BACKEND_VFUNC_WRITE,
+	XFCONF_SETTINGS_BACKEND_VFUNC_WRITE_TREE,
+	XFCONF_SETTINGS_BACKEND_VFUNC_RESET,
+	XFCONF_SETTINGS_BACKEND_VFUNC_GET_WRITABLE,
+	XFCONF_SETTINGS_BACKEND_VFUNC_GET_PERMISSION,
+	XFCONF_SETTINGS_BACKEND_VFUNC_SYNC,
+
+	XFCONF_SETTINGS_BACKEND_VFUNC_LAST
+} XfconfSettingsBackendVFunc;
+
+/* Event of a traced call of a virtual function */
+typedef struct _XfconfSettingsBackendTraceEvent			XfconfSettingsBackendTraceEvent;
+struct _XfconfSettingsBackendTraceEvent
+{
+	gint64					time;			/* Monotonic time at begin of call */
+	guint32					keyHash;
+	guint32					latency;		/* In microseconds */
+	guint16					vfunc;
+	guint16					roundTrips;
+	guint8					result;
+};
+
+/* Ring buffer of events of one thread. Only the owning thread writes to it. */
+typedef struct _XfconfSettingsBackendTraceRing				XfconfSettingsBackendTraceRing;
+struct _XfconfSettingsBackendTraceRing
+{
+	gpointer				thread;
+	gint					count;			/* Number of events recorded so far */
+	XfconfSettingsBackendTraceEvent	events[XFCONF_SETTINGS_TRACE_RING_SIZE];
+};
+
+/* State of a traced call kept on stack of caller */
+typedef struct _XfconfSettingsBackendTrace					XfconfSettingsBackendTrace;
+struct _XfconfSettingsBackendTrace
+{
+	gint64					startTime;		/* 0 if tracing is disabled */
+	gint					roundTrips;
+};
+
 typedef struct _XfconfSettingsBackend						XfconfSettingsBackend;
 struct _XfconfSettingsBackend
 {
@@ -61,7 +208,16 @@ struct _XfconfSettingsBackend
 	GSettingsBackend		backend;
 
 	/* Private structure */
-	XfconfChannel			*channel;
+	const XfconfSettingsBackendEngine	*engine;	/* Engine of all caches of this backend */
+	XfconfSettingsBackendCache	*cache;		/* Cache of unsharded channel */
+
+	XfconfSettingsBackendSharding	sharding;
+	guint					shardingDepth;
+	gboolean				shardingLegacy;	/* Fall back to unsharded channel */
+	GMutex					shardsLock;
+	GHashTable				*shards;	/* Channel name -> cache of shard */
+
+	gint					roundTrips[XFCONF_SETTINGS_BACKEND_VFUNC_LAST];
 };
 
 G_DEFINE_TYPE(XfconfSettingsBackend,
@@ -71,42 +227,262 @@ G_DEFINE_TYPE(XfconfSettingsBackend,
 #define XFCONF_TYPE_SETTINGS_BACKEND						(xfconf_settings_backend_get_type())
 #define XFCONF_SETTINGS_BACKEND(obj)						(G_TYPE_CHECK_INSTANCE_CAST((obj), XFCONF_TYPE_SETTINGS_BACKEND, XfconfSettingsBackend))
 
+/* Permission to change the keys below a path. Unlike GSimplePermission its
+ * allowed state follows the lock state of the path whenever it changes.
+ * It can neither be acquired nor released.
+ */
+typedef struct _XfconfSettingsBackendPermission			XfconfSettingsBackendPermission;
+struct _XfconfSettingsBackendPermission
+{
+	/* Parent instance */
+	GPermission				permission;
+};
+
+typedef struct _XfconfSettingsBackendPermissionClass		XfconfSettingsBackendPermissionClass;
+struct _XfconfSettingsBackendPermissionClass
+{
+	/*< private >*/
+	/* Parent class */
+	GPermissionClass		parent_class;
+};
+
+G_DEFINE_TYPE(XfconfSettingsBackendPermission,
+				xfconf_settings_backend_permission,
+				G_TYPE_PERMISSION)
+
+#define XFCONF_TYPE_SETTINGS_BACKEND_PERMISSION			(xfconf_settings_backend_permission_get_type())
+
 
 /* IMPLEMENTATION: Private variables and methods */
-typedef struct _XfconfSettingsBackendTypeMapping			XfconfSettingsBackendTypeMapping;
-struct _XfconfSettingsBackendTypeMapping
+typedef struct _XfconfSettingsBackendCodec				XfconfSettingsBackendCodec;
+
+typedef gboolean (*XfconfSettingsBackendEncodeFunc)(const XfconfSettingsBackendCodec *inCodec,
+													GVariant *inVariant,
+													GValue *outValue);
+typedef GVariant* (*XfconfSettingsBackendDecodeFunc)(const XfconfSettingsBackendCodec *inCodec,
+														const GValue *inValue);
+
+/* A codec converts variants of one type directly to values of the type stored
+ * in xfconf and back. Arrays of mappable types have a codec referring to the
+ * codec of their elements.
+ */
+struct _XfconfSettingsBackendCodec
 {
-	GType					type;
-	GType					subType;
+	const GVariantType					*variantType;	/* Type of variant */
+	GType								type;			/* Type of value stored in xfconf */
+	gsize								fixedSize;		/* Size of an element in fixed-width arrays, otherwise 0 */
+	const XfconfSettingsBackendCodec	*elementCodec;	/* Codec of elements if array, otherwise NULL */
+
+	XfconfSettingsBackendEncodeFunc		encode;
+	XfconfSettingsBackendDecodeFunc		decode;
+};
 
-	const GVariantType		*variantType;
-	const GVariantType		*variantSubtype;
+typedef void (*XfconfSettingsBackendEngineChangedFunc)(const gchar *inKey,
+														const GValue *inValue,
+														gpointer inUserData);
+
+/* An engine stores the values of channels. Caches talk to their channel only
+ * through the engine's functions so the conversion between variants and
+ * values does not depend on xfconfd running. A store is an opened channel
+ * of the engine which calls the function given at opening for each property
+ * changed by others, with an unset value if the property was reset. Engines
+ * saving channels to files return the file of a channel, otherwise NULL.
+ */
+struct _XfconfSettingsBackendEngine
+{
+	const gchar				*name;
+
+	gboolean				(*init)(void);
+	void					(*shutdown)(void);
+
+	gpointer				(*open)(const gchar *inChannelName,
+									XfconfSettingsBackendEngineChangedFunc inChangedFunc,
+									gpointer inUserData);
+	void					(*close)(gpointer inStore);
+
+	gboolean				(*get)(gpointer inStore, const gchar *inKey, GValue *outValue);
+	gboolean				(*set)(gpointer inStore, const gchar *inKey, const GValue *inValue);
+	gboolean				(*set_array)(gpointer inStore, const gchar *inKey, GPtrArray *inValues);
+	void					(*reset)(gpointer inStore, const gchar *inKey, gboolean inRecursive);
+	gboolean				(*has)(gpointer inStore, const gchar *inKey);
+	gboolean				(*is_locked)(gpointer inStore, const gchar *inKey);
+	GHashTable*				(*get_all)(gpointer inStore, const gchar *inPath);
+	gchar**					(*list_channels)(void);
+	gchar*					(*get_channel_file)(const gchar *inChannelName);
 };
 
+/* Keys and values of a tree to write in order of tree, i.e. sorted by key.
+ * Both refer to the data of the tree.
+ */
 typedef struct _XfconfSettingsBackendTreeWriteData			XfconfSettingsBackendTreeWriteData;
 struct _XfconfSettingsBackendTreeWriteData
 {
-	XfconfSettingsBackend	*backend;
-	gpointer				originTag;
-	GHashTable				*writtenKeys;
+	GPtrArray				*keys;
+	GPtrArray				*values;
 };
 
-typedef struct _XfconfSettingsBackendTreeCollectKeysData	XfconfSettingsBackendTreeCollectKeysData;
-struct _XfconfSettingsBackendTreeCollectKeysData
+typedef struct _XfconfSettingsBackendCacheEntry			XfconfSettingsBackendCacheEntry;
+struct _XfconfSettingsBackendCacheEntry
 {
-	gchar					**keysList;
-	guint					index;
+	GValue					value;		/* Value as stored in xfconf */
+	GVariant				*variant;	/* Decoded value of last read or write, may be NULL */
 };
 
-#ifdef STORE_COMPLEX_VARIANTS
-typedef struct _XfconfSettingsBackendVariantStruct			XfconfSettingsBackendVariantStruct;
-struct _XfconfSettingsBackendVariantStruct
+typedef struct _XfconfSettingsBackendPendingWrite			XfconfSettingsBackendPendingWrite;
+struct _XfconfSettingsBackendPendingWrite
 {
-	guint					magic;
-	gchar					*signature;
-	gchar					*value;
+	GValue					value;				/* Value to write, unset to reset property */
+	GValue					previousValue;		/* Value before first pending write, unset if property did not exist */
+	GVariant				*previousVariant;
 };
-#endif
+
+/* Paths subscribed by GSettings are kept in a prefix tree of path components.
+ * Each node counts the subscriptions of the path ending at this node.
+ */
+typedef struct _XfconfSettingsBackendWatch					XfconfSettingsBackendWatch;
+struct _XfconfSettingsBackendWatch
+{
+	gchar							*name;			/* Path component, NULL at root */
+	gsize							nameLength;
+	gint							refCount;
+
+	XfconfSettingsBackendWatch		*children;
+	XfconfSettingsBackendWatch		*next;
+};
+
+/* A snapshot file starts with this header followed by the index of the first
+ * entry of each bucket (plus one index past the last entry), the entries sorted
+ * by bucket and the data of keys and values. Keys are NUL-terminated, values
+ * are serialized variants of type "v" aligned to 8 bytes. All offsets are
+ * relative to the start of the file.
+ */
+typedef struct _XfconfSettingsBackendSnapshotHeader			XfconfSettingsBackendSnapshotHeader;
+struct _XfconfSettingsBackendSnapshotHeader
+{
+	guint32					magic;
+	guint32					version;
+	guint64					generation;		/* 0 if snapshot is stale */
+	gint64					sourceTime;		/* Modification time of engine's file of channel in nanoseconds */
+	guint64					sourceSize;
+	guint32					bucketsCount;
+	guint32					entriesCount;
+};
+
+typedef struct _XfconfSettingsBackendSnapshotEntry			XfconfSettingsBackendSnapshotEntry;
+struct _XfconfSettingsBackendSnapshotEntry
+{
+	guint32					hash;
+	guint32					keyOffset;
+	guint32					keyLength;
+	guint32					valueOffset;
+	guint32					valueLength;
+};
+
+/* A mapped snapshot file. Variants read from it refer to the mapped data. */
+typedef struct _XfconfSettingsBackendSnapshot				XfconfSettingsBackendSnapshot;
+struct _XfconfSettingsBackendSnapshot
+{
+	gint					refCount;
+	const guint8			*data;
+	gsize					size;
+	guint64					generation;		/* Generation at time of mapping */
+};
+
+/* The cache of a channel is shared by all backend instances of this process
+ * using the same channel. The properties below a path are loaded by one bulk
+ * request when the path is used first, or the whole channel is seeded at once,
+ * and kept up-to-date by the change notifications of its engine.
+ */
+struct _XfconfSettingsBackendCache
+{
+	gint					refCount;
+
+	gchar					*channelName;
+	gchar					*cacheKey;			/* Name of engine and channel caches are shared by */
+	const XfconfSettingsBackendEngine	*engine;
+	gpointer				store;
+
+	GRecMutex				lock;
+	gboolean				isSeeded;
+	XfconfSettingsBackendWatch	*loadedPaths;	/* Paths loaded before cache was seeded */
+	GHashTable				*entries;
+
+	GList					*backends;
+	GHashTable				*echoes;
+	GHashTable				*pendingChanges;
+	guint					pendingChangesSourceID;
+
+	gboolean				writeBehind;
+	GHashTable				*pendingWrites;
+	guint					pendingWritesSourceID;
+
+	XfconfSettingsBackendStorage	storage;
+	GHashTable				*pendingRewrites;
+	guint					pendingRewritesSourceID;
+
+	gchar					*snapshotPath;		/* NULL if snapshots are disabled */
+	XfconfSettingsBackendSnapshot	*snapshot;
+	XfconfSettingsBackendSnapshot	*snapshotBase;	/* Snapshot usable when cache was created, merged into next snapshot */
+	GHashTable				*snapshotChangedKeys;	/* Keys stored or removed since snapshot base was mapped */
+	guint64					snapshotGeneration;
+	gboolean				snapshotInvalidated;
+	guint					snapshotSourceID;
+
+	GHashTable				*lockStates;		/* Key to locked state */
+	GHashTable				*permissions;		/* Path to shared permission */
+	gint					lockStatesGeneration;
+};
+
+static gboolean			_xfconf_settings_backend_trace_enabled=FALSE;
+static GPrivate			_xfconf_settings_backend_trace_ring=G_PRIVATE_INIT(NULL);
+static GSList			*_xfconf_settings_backend_trace_rings=NULL;
+G_LOCK_DEFINE_STATIC(_xfconf_settings_backend_trace_rings);
+static gint				_xfconf_settings_backend_trace_histograms[XFCONF_SETTINGS_BACKEND_VFUNC_LAST][XFCONF_SETTINGS_TRACE_BUCKETS];
+
+static const XfconfSettingsBackendEngine	*_xfconf_settings_backend_engine=NULL;
+static gboolean			_xfconf_settings_backend_engine_initialized=FALSE;
+static gboolean			_xfconf_settings_backend_engine_fallback_initialized=FALSE;
+G_LOCK_DEFINE_STATIC(_xfconf_settings_backend_engine);
+
+/* Increased whenever lock states of properties may have changed. Caches
+ * forget all lock states of older generations and update their permissions.
+ */
+static gint				_xfconf_settings_backend_lock_states_generation=0;
+
+static guint			_xfconf_settings_backend_engine_xfconf_watcher_id=0;
+
+/* Channels of memory engine. Each channel is a hash table of keys and values. */
+static GHashTable		*_xfconf_settings_backend_memory_channels=NULL;
+G_LOCK_DEFINE_STATIC(_xfconf_settings_backend_memory_channels);
+
+static GHashTable		*_xfconf_settings_backend_caches=NULL;
+G_LOCK_DEFINE_STATIC(_xfconf_settings_backend_caches);
+
+/* Paths watched by any backend of this process. Keys keep their full path
+ * in all channels so one prefix tree serves all caches.
+ */
+static XfconfSettingsBackendWatch	*_xfconf_settings_backend_watches=NULL;
+G_LOCK_DEFINE_STATIC(_xfconf_settings_backend_watches);
+
+/* Codecs are indexed by the type character of basic variant types. Codecs of
+ * arrays are indexed by the type character of their elements.
+ */
+#define XFCONF_SETTINGS_CODECS_SIZE		128
+
+static XfconfSettingsBackendCodec	_xfconf_settings_backend_codecs[XFCONF_SETTINGS_CODECS_SIZE];
+static XfconfSettingsBackendCodec	_xfconf_settings_backend_array_codecs[XFCONF_SETTINGS_CODECS_SIZE];
+
+
+static const gchar		*_xfconf_settings_backend_vfunc_names[XFCONF_SETTINGS_BACKEND_VFUNC_LAST]=
+							{
+								"read",
+								"write",
+								"write_tree",
+								"reset",
+								"get_writable",
+								"get_permission",
+								"sync"
+							};
 
 
 /* Forward declarations */
@@ -114,6 +490,83 @@ static void _xfconf_settings_backend_reset(GSettingsBackend *inBackend,
 											const gchar *inKey,
 											gpointer inOriginTag);
 
+static gboolean _xfconf_settings_backend_cache_on_rewrite_values(gpointer inUserData);
+static guint _xfconf_settings_backend_cache_seed(XfconfSettingsBackendCache *self);
+static void _xfconf_settings_backend_cache_refresh_all_lock_states(void);
+
+static void _xfconf_settings_backend_watch_free(XfconfSettingsBackendWatch *self);
+static void _xfconf_settings_backend_watch_add(XfconfSettingsBackendWatch *self,
+												const gchar *inPath);
+static gboolean _xfconf_settings_backend_watch_matches(XfconfSettingsBackendWatch *self,
+														const gchar *inKey);
+
+guint xfconf_settings_backend_get_round_trips(GSettingsBackend *inBackend,
+												const gchar *inVFuncName);
+void xfconf_settings_backend_reset_round_trips(GSettingsBackend *inBackend);
+void xfconf_settings_backend_dump_trace(void);
+
+/* Check if an option is enabled by an environment variable */
+static gboolean _xfconf_settings_backend_is_option_enabled(const gchar *inName)
+{
+	const gchar				*value;
+
+	value=g_getenv(inName);
+	if(!value || !*value) return(FALSE);
+
+	return(g_strcmp0(value, "0")!=0 &&
+			g_ascii_strcasecmp(value, "false")!=0 &&
+			g_ascii_strcasecmp(value, "no")!=0);
+}
+
+/* Get format to store complex variants in as set by environment variable */
+static XfconfSettingsBackendStorage _xfconf_settings_backend_get_storage_option(void)
+{
+	const gchar				*value;
+
+	value=g_getenv(XFCONF_SETTINGS_ENV_STORAGE);
+	if(!value || !*value) return(XFCONF_SETTINGS_BACKEND_STORAGE_TEXT);
+
+	if(g_ascii_strcasecmp(value, "binary")==0) return(XFCONF_SETTINGS_BACKEND_STORAGE_BINARY);
+	if(g_ascii_strcasecmp(value, "struct")==0) return(XFCONF_SETTINGS_BACKEND_STORAGE_STRUCT);
+	if(g_ascii_strcasecmp(value, "text")!=0)
+	{
+		g_warning("Unknown storage format '%s' - using 'text'", value);
+	}
+
+	return(XFCONF_SETTINGS_BACKEND_STORAGE_TEXT);
+}
+
+/* Get sharding policy selected by environment variable */
+static XfconfSettingsBackendSharding _xfconf_settings_backend_get_sharding_option(guint *outDepth)
+{
+	const gchar				*value;
+	gchar					*end;
+	guint64					depth;
+
+	*outDepth=0;
+
+	value=g_getenv(XFCONF_SETTINGS_ENV_SHARDING);
+	if(!value || !*value) return(XFCONF_SETTINGS_BACKEND_SHARDING_NONE);
+
+	if(g_ascii_strcasecmp(value, "schema")==0) return(XFCONF_SETTINGS_BACKEND_SHARDING_SCHEMA);
+	if(g_ascii_strncasecmp(value, "depth:", 6)==0)
+	{
+		depth=g_ascii_strtoull(value+6, &end, 10);
+		if(end!=value+6 && !*end && depth>0 && depth<=G_MAXUINT)
+		{
+			*outDepth=(guint)depth;
+			return(XFCONF_SETTINGS_BACKEND_SHARDING_DEPTH);
+		}
+	}
+
+	if(g_ascii_strcasecmp(value, "none")!=0)
+	{
+		g_warning("Unknown sharding policy '%s' - using 'none'", value);
+	}
+
+	return(XFCONF_SETTINGS_BACKEND_SHARDING_NONE);
+}
+
 #ifdef DEBUG
 void _xfconf_settings_backend_debug(const gchar *inFormat, ...) G_GNUC_PRINTF(1, 2);
 
@@ -140,496 +593,3906 @@ void _xfconf_settings_backend_debug(const gchar *inFormat, ...)
 #define _xfconf_settings_backend_debug(inFormat, ...)
 #endif
 
-#ifdef STORE_COMPLEX_VARIANTS
-/* Initialize variant structure */
-static void _xfconf_settings_backend_init_variant_struct(XfconfSettingsBackendVariantStruct *inStruct)
-{
-	g_return_if_fail(inStruct);
-
-	/* Initialize structure */
-	inStruct->magic=XFCONF_VARIANT_STRUCT_MAGIC;
-	inStruct->signature=NULL;
-	inStruct->value=NULL;
-}
-
-/* Free variant structure */
-static void _xfconf_settings_backend_free_variant_struct(XfconfSettingsBackendVariantStruct *inStruct)
+/* Begin tracing a call of a virtual function. If tracing is disabled this
+ * is all done for a call.
+ */
+static void _xfconf_settings_backend_trace_begin(XfconfSettingsBackend *self,
+													XfconfSettingsBackendVFunc inVFunc,
+													XfconfSettingsBackendTrace *outTrace)
 {
-	g_return_if_fail(inStruct);
-	g_return_if_fail(inStruct->magic==XFCONF_VARIANT_STRUCT_MAGIC);
-
-	/* Free allocated resources */
-	if(inStruct->signature)
+	if(G_LIKELY(!_xfconf_settings_backend_trace_enabled))
 	{
-		g_free(inStruct->signature);
-		inStruct->signature=NULL;
+		outTrace->startTime=0;
+		return;
 	}
 
-	if(inStruct->value)
-	{
-		g_free(inStruct->value);
-		inStruct->value=NULL;
-	}
+	outTrace->startTime=g_get_monotonic_time();
+	outTrace->roundTrips=g_atomic_int_get(&self->roundTrips[inVFunc]);
 }
-#endif
 
-/* Find matching GType for a GVariant type */
-static gboolean _xfconf_settings_backend_gtype_from_gvariant_type(const GVariantType *inVariantType, XfconfSettingsBackendTypeMapping *ioMapping)
+/* Record a traced call as event in ring buffer of calling thread and count
+ * it in latency histogram of virtual function.
+ */
+static void _xfconf_settings_backend_trace_record(XfconfSettingsBackend *self,
+													XfconfSettingsBackendVFunc inVFunc,
+													XfconfSettingsBackendTrace *inTrace,
+													const gchar *inKey,
+													gboolean inResult)
 {
-	const gchar				*iter;
-	gsize					numberTypes;
-
-	g_return_val_if_fail(inVariantType, FALSE);
-	g_return_val_if_fail(ioMapping, FALSE);
+	XfconfSettingsBackendTraceRing		*ring;
+	XfconfSettingsBackendTraceEvent		*event;
+	gint64								latency;
+	guint								bucket;
 
-	/* Initialize GVariant's type iterator */
-	iter=g_variant_type_peek_string(inVariantType);
-	numberTypes=g_variant_type_get_string_length(inVariantType);
+	latency=g_get_monotonic_time()-inTrace->startTime;
 
-	/* Initialize mapping with invalid types */
-	ioMapping->type=G_TYPE_INVALID;
-	ioMapping->subType=G_TYPE_INVALID;
-	ioMapping->variantType=NULL;
-	ioMapping->variantSubtype=NULL;
-
-	/* If GVariant's signaure is a container and it can be handled like an
-	 * array then get array type but it must have only two types in its
-	 * signature *exactly*.
-	 */
-	switch(*iter)
+	/* Get ring buffer of this thread and create it at first call */
+	ring=(XfconfSettingsBackendTraceRing*)g_private_get(&_xfconf_settings_backend_trace_ring);
+	if(G_UNLIKELY(!ring))
 	{
-		case G_VARIANT_CLASS_ARRAY:
-			if(numberTypes==2)
-			{
-				ioMapping->type=G_TYPE_ARRAY;
-				ioMapping->variantType=G_VARIANT_TYPE_ARRAY;
-			}
-			break;
+		ring=g_new0(XfconfSettingsBackendTraceRing, 1);
+		ring->thread=g_thread_self();
+		g_private_set(&_xfconf_settings_backend_trace_ring, ring);
 
-		/* GVariant's signature either not describes an container or it cannot
-		 * be handled like an array.
-		 */
-		default:
-			break;
+		G_LOCK(_xfconf_settings_backend_trace_rings);
+		_xfconf_settings_backend_trace_rings=g_slist_prepend(_xfconf_settings_backend_trace_rings, ring);
+		G_UNLOCK(_xfconf_settings_backend_trace_rings);
 	}
 
-	/* GVariant's signature must define exactly one type to map it to a GType
-	 * if it's not an array-like container. If it can be handled as an array-alike
-	 * then if must have exactly two type in its signature.
+	/* Overwrite oldest event */
+	event=&ring->events[ring->count % XFCONF_SETTINGS_TRACE_RING_SIZE];
+	event->time=inTrace->startTime;
+	event->keyHash=(inKey ? g_str_hash(inKey) : 0);
+	event->latency=(guint32)MIN(latency, G_MAXUINT32);
+	event->vfunc=inVFunc;
+	event->roundTrips=(guint16)MIN(g_atomic_int_get(&self->roundTrips[inVFunc])-inTrace->roundTrips, G_MAXUINT16);
+	event->result=(inResult ? 1 : 0);
+	g_atomic_int_inc(&ring->count);
+
+	/* Count call in bucket of its latency. Bucket N counts calls which took
+	 * less than 2^N microseconds.
 	 */
-	if((ioMapping->type!=G_TYPE_INVALID && numberTypes==2) ||
-		(ioMapping->type==G_TYPE_INVALID && numberTypes==1))
-	{
-		/* Move iterator if it is array-alike */
-		if(ioMapping->type!=G_TYPE_INVALID) iter++;
-
-		/* Try mapping type */
-		switch(*iter)
-		{
-			case G_VARIANT_CLASS_BOOLEAN:
-				ioMapping->subType=G_TYPE_BOOLEAN;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_BOOLEAN;
-				break;
-
-			case G_VARIANT_CLASS_BYTE:
-				ioMapping->subType=G_TYPE_UCHAR;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_BYTE;
-				break;
-
-			case G_VARIANT_CLASS_INT16:
-				ioMapping->subType=XFCONF_TYPE_INT16;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_INT16;
-				break;
-
-			case G_VARIANT_CLASS_UINT16:
-				ioMapping->subType=XFCONF_TYPE_UINT16;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_UINT16;
-				break;
-
-			case G_VARIANT_CLASS_INT32:
-				ioMapping->subType=G_TYPE_INT;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_INT32;
-				break;
+	bucket=MIN(g_bit_storage((gulong)latency), XFCONF_SETTINGS_TRACE_BUCKETS-1);
+	g_atomic_int_inc(&_xfconf_settings_backend_trace_histograms[inVFunc][bucket]);
+}
 
-			case G_VARIANT_CLASS_UINT32:
-				ioMapping->subType=G_TYPE_UINT;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_UINT32;
-				break;
+/* End tracing a call of a virtual function */
+static void _xfconf_settings_backend_trace_end(XfconfSettingsBackend *self,
+												XfconfSettingsBackendVFunc inVFunc,
+												XfconfSettingsBackendTrace *inTrace,
+												const gchar *inKey,
+												gboolean inResult)
+{
+	if(G_LIKELY(!inTrace->startTime)) return;
 
-			case G_VARIANT_CLASS_INT64:
-				ioMapping->subType=G_TYPE_INT64;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_INT64;
-				break;
+	_xfconf_settings_backend_trace_record(self, inVFunc, inTrace, inKey, inResult);
+}
 
-			case G_VARIANT_CLASS_UINT64:
-				ioMapping->subType=G_TYPE_INT64;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_UINT64;
-				break;
+/* Free a value allocated on heap, e.g. an element of an array stored in xfconf */
+static void _xfconf_settings_backend_free_value(gpointer inData)
+{
+	GValue			*value=(GValue*)inData;
 
-			case G_VARIANT_CLASS_DOUBLE:
-				ioMapping->subType=G_TYPE_DOUBLE;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_DOUBLE;
-				break;
+	if(G_IS_VALUE(value)) g_value_unset(value);
+	g_free(value);
+}
 
-			case G_VARIANT_CLASS_STRING:
-				ioMapping->subType=G_TYPE_STRING;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_STRING;
-				break;
+/* Copy a value of a property. Arrays are copied deeply so the copy
+ * does not share any element with the original value.
+ */
+static void _xfconf_settings_backend_copy_value(const GValue *inSource, GValue *outDestination)
+{
+	g_return_if_fail(G_IS_VALUE(inSource));
+	g_return_if_fail(outDestination && !G_IS_VALUE(outDestination));
 
-			case G_VARIANT_CLASS_OBJECT_PATH:
-				ioMapping->subType=G_TYPE_STRING;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_OBJECT_PATH;
-				break;
+	if(G_VALUE_HOLDS(inSource, XFCONF_TYPE_G_VALUE_ARRAY))
+	{
+		GPtrArray		*sourceArray;
+		GPtrArray		*array;
+		GValue			*element;
+		guint			i;
 
-			case G_VARIANT_CLASS_SIGNATURE:
-				ioMapping->subType=G_TYPE_STRING;
-				ioMapping->variantSubtype=G_VARIANT_TYPE_SIGNATURE;
-				break;
+		sourceArray=(GPtrArray*)g_value_get_boxed(inSource);
 
-			/* The following type cannot be mapped to a GValue type processable
-			 * by xfconf properly. If it is array-alike then reset also its type.
-			 */
-			case G_VARIANT_CLASS_HANDLE:
-			case G_VARIANT_CLASS_VARIANT:
-			case G_VARIANT_CLASS_MAYBE:
-			case G_VARIANT_CLASS_ARRAY:
-			case G_VARIANT_CLASS_TUPLE:
-			case G_VARIANT_CLASS_DICT_ENTRY:
-			default:
-				ioMapping->type=G_TYPE_INVALID;
-				ioMapping->variantType=NULL;
-				break;
+		array=g_ptr_array_new_full(sourceArray ? sourceArray->len : 0, _xfconf_settings_backend_free_value);
+		for(i=0; sourceArray && i<sourceArray->len; i++)
+		{
+			element=g_new0(GValue, 1);
+			_xfconf_settings_backend_copy_value((const GValue*)g_ptr_array_index(sourceArray, i), element);
+			g_ptr_array_add(array, element);
 		}
 
-		/* If sub-type is set but type is invalid move sub-type to type */
-		if(ioMapping->subType!=G_TYPE_INVALID &&
-			ioMapping->type==G_TYPE_INVALID)
+		g_value_init(outDestination, XFCONF_TYPE_G_VALUE_ARRAY);
+		g_value_take_boxed(outDestination, array);
+	}
+		else
 		{
-			ioMapping->type=ioMapping->subType;
-			ioMapping->subType=G_TYPE_INVALID;
-
-			ioMapping->variantType=ioMapping->variantSubtype;
-			ioMapping->variantSubtype=NULL;
+			g_value_init(outDestination, G_VALUE_TYPE(inSource));
+			g_value_copy(inSource, outDestination);
 		}
-	}
-
-	/* Return with success result even if no mapping could be found */
-	_xfconf_settings_backend_debug("GVariant's signature '%s' with %lu elements resolved to type %s and sub-type %s",
-									g_variant_type_peek_string(inVariantType),
-									numberTypes,
-									g_type_name(ioMapping->type),
-									g_type_name(ioMapping->subType));
-	return(TRUE);
 }
 
-/* Store a value in xfconf */
-static gboolean _xfconf_settings_backend_write_internal(XfconfSettingsBackend *self,
-														const gchar *inKey,
-														GVariant *inValue,
-														gpointer inOriginTag)
+/* Check if two values of properties are equal */
+static gboolean _xfconf_settings_backend_value_equal(const GValue *inLeft, const GValue *inRight)
 {
-	XfconfSettingsBackendTypeMapping		valueType;
-	gboolean								success;
-
-	/* Get GType of property value for variant */
-	if(!_xfconf_settings_backend_gtype_from_gvariant_type(g_variant_get_type(inValue), &valueType))
-	{
-		g_critical("Failed to determine types when writting key %s.", inKey);
-		return(FALSE);
-	}
-
-	/* If variant type could not be mapped to a GType than get a string
-	 * representation of variant which will be store instead along with
-	 * variant's signature ...
-	 */
-	if(valueType.type==G_TYPE_INVALID)
-	{
-#ifdef STORE_COMPLEX_VARIANTS
-		XfconfSettingsBackendVariantStruct	variantStruct;
+	GType					type;
 
-		/* Set up value to store */
-		_xfconf_settings_backend_init_variant_struct(&variantStruct);
-		variantStruct.signature=g_variant_type_dup_string(g_variant_get_type(inValue));
-		variantStruct.value=g_variant_print(inValue, FALSE);
+	g_return_val_if_fail(G_IS_VALUE(inLeft), FALSE);
+	g_return_val_if_fail(G_IS_VALUE(inRight), FALSE);
 
-		/* Store value in xfconf */
-		success=xfconf_channel_set_named_struct(self->channel, inKey, XFCONF_VARIANT_STRUCT_NAME, &variantStruct);
+	/* Values of different types are never equal */
+	type=G_VALUE_TYPE(inLeft);
+	if(type!=G_VALUE_TYPE(inRight)) return(FALSE);
 
-		/* Release allocated resources */
-		_xfconf_settings_backend_free_variant_struct(&variantStruct);
-#else
-		gchar								*variantString;
-		GValue								xfconfValue=G_VALUE_INIT;
+	/* Arrays are equal if all their elements are equal */
+	if(type==XFCONF_TYPE_G_VALUE_ARRAY)
+	{
+		GPtrArray			*leftArray;
+		GPtrArray			*rightArray;
+		guint				leftSize;
+		guint				rightSize;
+		guint				i;
 
-		/* Get string representation of variant */
-		variantString=g_variant_print(inValue, FALSE);
+		leftArray=(GPtrArray*)g_value_get_boxed(inLeft);
+		leftSize=(leftArray ? leftArray->len : 0);
 
-		/* Set up property value */
-		g_value_init(&xfconfValue, G_TYPE_STRING);
-		g_value_set_string(&xfconfValue, variantString);
+		rightArray=(GPtrArray*)g_value_get_boxed(inRight);
+		rightSize=(rightArray ? rightArray->len : 0);
 
-		/* Store value in xfconf */
-		success=xfconf_channel_set_property(self->channel, inKey, &xfconfValue);
+		if(leftSize!=rightSize) return(FALSE);
 
-		/* Release allocated resources */
-		g_value_unset(&xfconfValue);
-		g_free(variantString);
-#endif
-	}
-		/* ... otherwise check for array ... */
-		else if(valueType.type==G_TYPE_ARRAY && valueType.subType!=G_TYPE_INVALID)
+		for(i=0; i<leftSize; i++)
 		{
-			gsize							arraySize;
-			GPtrArray						*array;
-			gsize							i;
-			GValue							*xfconfValue;
-
-			/* Get size of array */
-			arraySize=g_variant_n_children(inValue);
-
-			/* Set up array for storing in xfconf */
-			array=g_ptr_array_sized_new(arraySize);
-			for(i=0; i<arraySize; i++)
+			if(!_xfconf_settings_backend_value_equal((const GValue*)g_ptr_array_index(leftArray, i),
+														(const GValue*)g_ptr_array_index(rightArray, i)))
 			{
-				xfconfValue=g_new0(GValue, 1);
-				g_dbus_gvariant_to_gvalue(g_variant_get_child_value(inValue, i), xfconfValue);
-				g_ptr_array_add(array, xfconfValue);
+				return(FALSE);
 			}
-
-			/* Store value in xfconf */
-			success=xfconf_channel_set_arrayv(self->channel, inKey, array);
-
-			/* Release allocated resources */
-			xfconf_array_free(array);
 		}
-		/* ... otherwise the variant can be simply converted */
-		else
-		{
-			GValue							xfconfValue=G_VALUE_INIT;
 
-			/* Convert variant to GValue */
-			g_dbus_gvariant_to_gvalue(inValue, &xfconfValue);
+		return(TRUE);
+	}
 
-			/* Store value in xfconf */
-			success=xfconf_channel_set_property(self->channel, inKey, &xfconfValue);
+	/* Compare values of basic types directly ... */
+	if(type==G_TYPE_STRING) return(g_strcmp0(g_value_get_string(inLeft), g_value_get_string(inRight))==0);
+	if(type==G_TYPE_BOOLEAN) return(g_value_get_boolean(inLeft)==g_value_get_boolean(inRight));
+	if(type==G_TYPE_UCHAR) return(g_value_get_uchar(inLeft)==g_value_get_uchar(inRight));
+	if(type==G_TYPE_INT) return(g_value_get_int(inLeft)==g_value_get_int(inRight));
+	if(type==G_TYPE_UINT) return(g_value_get_uint(inLeft)==g_value_get_uint(inRight));
+	if(type==G_TYPE_INT64) return(g_value_get_int64(inLeft)==g_value_get_int64(inRight));
+	if(type==G_TYPE_UINT64) return(g_value_get_uint64(inLeft)==g_value_get_uint64(inRight));
+	if(type==G_TYPE_DOUBLE) return(g_value_get_double(inLeft)==g_value_get_double(inRight));
+
+	/* ... and all other ones by their string representation */
+	{
+		gchar				*leftContents;
+		gchar				*rightContents;
+		gboolean			isEqual;
 
-			/* Release allocated resources */
-			g_value_unset(&xfconfValue);
-		}
+		leftContents=g_strdup_value_contents(inLeft);
+		rightContents=g_strdup_value_contents(inRight);
+		isEqual=(g_strcmp0(leftContents, rightContents)==0);
+		g_free(leftContents);
+		g_free(rightContents);
 
-	/* Return success result */
-	_xfconf_settings_backend_debug("Wrote key '%s' %s",
-									inKey,
-									success ? "successfully" : "unsuccessfully");
-	return(success);
+		return(isEqual);
+	}
 }
 
-/* Reset a value in xfconf */
-static gboolean _xfconf_settings_backend_reset_internal(XfconfSettingsBackend *self,
-														const gchar *inKey,
-														gpointer inOriginTag)
+/* Codecs of basic types. Encoders get a variant of the codec's type and an
+ * uninitialized value, decoders get a value of the codec's type.
+ */
+static gboolean _xfconf_settings_backend_codec_encode_boolean(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
 {
-	/* If key does not exists return FALSE here */
-	if(!xfconf_channel_has_property(self->channel, inKey))
-	{
-		_xfconf_settings_backend_debug("Cannot reset non-existing key '%s'", inKey);
-		return(FALSE);
-	}
+	g_value_init(outValue, inCodec->type);
+	g_value_set_boolean(outValue, g_variant_get_boolean(inVariant));
+	return(TRUE);
+}
 
-	/* Reset value in xfconf */
-	xfconf_channel_reset_property(self->channel, inKey, TRUE);
+static GVariant* _xfconf_settings_backend_codec_decode_boolean(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_boolean(g_value_get_boolean(inValue)));
+}
 
-	/* Return success result */
+static gboolean _xfconf_settings_backend_codec_encode_byte(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	g_value_set_uchar(outValue, g_variant_get_byte(inVariant));
 	return(TRUE);
 }
 
+static GVariant* _xfconf_settings_backend_codec_decode_byte(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_byte(g_value_get_uchar(inValue)));
+}
 
-/* IMPLEMENTATION: GSettingsBackend */
-
-/* Read a value from xfconf */
-static GVariant* _xfconf_settings_backend_read(GSettingsBackend *inBackend,
-												const gchar *inKey,
-												const GVariantType *inExpectedType,
-												gboolean inDefaultValue)
+static gboolean _xfconf_settings_backend_codec_encode_int16(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
 {
-	XfconfSettingsBackend					*self=(XfconfSettingsBackend*)inBackend;
-	XfconfSettingsBackendTypeMapping		valueType;
-	GVariant								*value;
+	g_value_init(outValue, inCodec->type);
+	xfconf_g_value_set_int16(outValue, g_variant_get_int16(inVariant));
+	return(TRUE);
+}
 
-	value=NULL;
+static GVariant* _xfconf_settings_backend_codec_decode_int16(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_int16(xfconf_g_value_get_int16(inValue)));
+}
 
+static gboolean _xfconf_settings_backend_codec_encode_uint16(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	xfconf_g_value_set_uint16(outValue, g_variant_get_uint16(inVariant));
+	return(TRUE);
+}
 
-	/* If default value is requested return NULL */
-	if(inDefaultValue) return(NULL);
+static GVariant* _xfconf_settings_backend_codec_decode_uint16(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_uint16(xfconf_g_value_get_uint16(inValue)));
+}
 
-	/* Check that requested property exists */
-	if(!xfconf_channel_has_property(self->channel, inKey))
-	{
-		_xfconf_settings_backend_debug("Cannot read non-existing key '%s'", inKey);
+static gboolean _xfconf_settings_backend_codec_encode_int32(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	g_value_set_int(outValue, g_variant_get_int32(inVariant));
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_int32(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_int32(g_value_get_int(inValue)));
+}
+
+static gboolean _xfconf_settings_backend_codec_encode_uint32(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	g_value_set_uint(outValue, g_variant_get_uint32(inVariant));
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_uint32(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_uint32(g_value_get_uint(inValue)));
+}
+
+static gboolean _xfconf_settings_backend_codec_encode_int64(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	g_value_set_int64(outValue, g_variant_get_int64(inVariant));
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_int64(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_int64(g_value_get_int64(inValue)));
+}
+
+static gboolean _xfconf_settings_backend_codec_encode_uint64(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	g_value_set_uint64(outValue, g_variant_get_uint64(inVariant));
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_uint64(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_uint64(g_value_get_uint64(inValue)));
+}
+
+static gboolean _xfconf_settings_backend_codec_encode_double(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	g_value_set_double(outValue, g_variant_get_double(inVariant));
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_double(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	return(g_variant_new_double(g_value_get_double(inValue)));
+}
+
+/* Strings, object paths and signatures share the string encoder. The copy of
+ * the string is handed over to the value without copying it again.
+ */
+static gboolean _xfconf_settings_backend_codec_encode_string(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+	g_value_take_string(outValue, g_variant_dup_string(inVariant, NULL));
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_string(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	const gchar			*string;
+
+	string=g_value_get_string(inValue);
+	return(g_variant_new_string(string ? string : ""));
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_object_path(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	const gchar			*string;
+
+	string=g_value_get_string(inValue);
+	if(!string || !g_variant_is_object_path(string)) return(NULL);
+
+	return(g_variant_new_object_path(string));
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_signature(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	const gchar			*string;
+
+	string=g_value_get_string(inValue);
+	if(!string || !g_variant_is_signature(string)) return(NULL);
+
+	return(g_variant_new_signature(string));
+}
+
+/* Forward declarations of codec functions used by array codecs */
+static gboolean _xfconf_settings_backend_codec_encode(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue);
+static GVariant* _xfconf_settings_backend_codec_decode(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue);
+
+/* Set a value from an element of an array of fixed-width type */
+static void _xfconf_settings_backend_codec_get_fixed_element(const XfconfSettingsBackendCodec *inCodec,
+																gconstpointer inElements,
+																gsize inIndex,
+																GValue *outValue)
+{
+	g_value_init(outValue, inCodec->type);
+
+	switch(*g_variant_type_peek_string(inCodec->variantType))
+	{
+		case G_VARIANT_CLASS_BOOLEAN:
+			g_value_set_boolean(outValue, ((const guint8*)inElements)[inIndex]!=0);
+			break;
+
+		case G_VARIANT_CLASS_BYTE:
+			g_value_set_uchar(outValue, ((const guint8*)inElements)[inIndex]);
+			break;
+
+		case G_VARIANT_CLASS_INT16:
+			xfconf_g_value_set_int16(outValue, ((const gint16*)inElements)[inIndex]);
+			break;
+
+		case G_VARIANT_CLASS_UINT16:
+			xfconf_g_value_set_uint16(outValue, ((const guint16*)inElements)[inIndex]);
+			break;
+
+		case G_VARIANT_CLASS_INT32:
+			g_value_set_int(outValue, ((const gint32*)inElements)[inIndex]);
+			break;
+
+		case G_VARIANT_CLASS_UINT32:
+			g_value_set_uint(outValue, ((const guint32*)inElements)[inIndex]);
+			break;
+
+		case G_VARIANT_CLASS_INT64:
+			g_value_set_int64(outValue, ((const gint64*)inElements)[inIndex]);
+			break;
+
+		case G_VARIANT_CLASS_UINT64:
+			g_value_set_uint64(outValue, ((const guint64*)inElements)[inIndex]);
+			break;
+
+		case G_VARIANT_CLASS_DOUBLE:
+			g_value_set_double(outValue, ((const gdouble*)inElements)[inIndex]);
+			break;
+
+		default:
+			g_assert_not_reached();
+			break;
+	}
+}
+
+/* Store a value as element of an array of fixed-width type */
+static void _xfconf_settings_backend_codec_set_fixed_element(const XfconfSettingsBackendCodec *inCodec,
+																const GValue *inValue,
+																gpointer ioElements,
+																gsize inIndex)
+{
+	switch(*g_variant_type_peek_string(inCodec->variantType))
+	{
+		case G_VARIANT_CLASS_BOOLEAN:
+			((guint8*)ioElements)[inIndex]=(g_value_get_boolean(inValue) ? 1 : 0);
+			break;
+
+		case G_VARIANT_CLASS_BYTE:
+			((guint8*)ioElements)[inIndex]=g_value_get_uchar(inValue);
+			break;
+
+		case G_VARIANT_CLASS_INT16:
+			((gint16*)ioElements)[inIndex]=xfconf_g_value_get_int16(inValue);
+			break;
+
+		case G_VARIANT_CLASS_UINT16:
+			((guint16*)ioElements)[inIndex]=xfconf_g_value_get_uint16(inValue);
+			break;
+
+		case G_VARIANT_CLASS_INT32:
+			((gint32*)ioElements)[inIndex]=g_value_get_int(inValue);
+			break;
+
+		case G_VARIANT_CLASS_UINT32:
+			((guint32*)ioElements)[inIndex]=g_value_get_uint(inValue);
+			break;
+
+		case G_VARIANT_CLASS_INT64:
+			((gint64*)ioElements)[inIndex]=g_value_get_int64(inValue);
+			break;
+
+		case G_VARIANT_CLASS_UINT64:
+			((guint64*)ioElements)[inIndex]=g_value_get_uint64(inValue);
+			break;
+
+		case G_VARIANT_CLASS_DOUBLE:
+			((gdouble*)ioElements)[inIndex]=g_value_get_double(inValue);
+			break;
+
+		default:
+			g_assert_not_reached();
+			break;
+	}
+}
+
+/* Codec of arrays of fixed-width types. The elements are accessed in bulk
+ * without creating a variant for each element.
+ */
+static gboolean _xfconf_settings_backend_codec_encode_fixed_array(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	const XfconfSettingsBackendCodec	*elementCodec;
+	gconstpointer						elements;
+	gsize								arraySize;
+	GPtrArray							*array;
+	GValue								*xfconfValue;
+	gsize								i;
+
+	elementCodec=inCodec->elementCodec;
+
+	/* Get all elements at once */
+	elements=g_variant_get_fixed_array(inVariant, &arraySize, elementCodec->fixedSize);
+
+	/* Set up array for storing in xfconf */
+	array=g_ptr_array_new_full(arraySize, _xfconf_settings_backend_free_value);
+	for(i=0; i<arraySize; i++)
+	{
+		xfconfValue=g_new0(GValue, 1);
+		_xfconf_settings_backend_codec_get_fixed_element(elementCodec, elements, i, xfconfValue);
+		g_ptr_array_add(array, xfconfValue);
+	}
+
+	/* Set up property value */
+	g_value_init(outValue, inCodec->type);
+	g_value_take_boxed(outValue, array);
+
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_array(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue);
+
+static GVariant* _xfconf_settings_backend_codec_decode_fixed_array(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	const XfconfSettingsBackendCodec	*elementCodec;
+	GPtrArray							*array;
+	gsize								arraySize;
+	gpointer							elements;
+	const GValue						*element;
+	gsize								i;
+
+	elementCodec=inCodec->elementCodec;
+
+	/* Get size of array */
+	array=(GPtrArray*)g_value_get_boxed(inValue);
+	arraySize=(array ? array->len : 0);
+	if(arraySize==0) return(g_variant_new_array(elementCodec->variantType, NULL, 0));
+
+	/* Collect all elements in one block of memory. If an element is not of
+	 * the expected type, e.g. it was stored by an older version, convert
+	 * the array element by element.
+	 */
+	elements=g_malloc(arraySize*elementCodec->fixedSize);
+	for(i=0; i<arraySize; i++)
+	{
+		element=(const GValue*)g_ptr_array_index(array, i);
+		if(!G_VALUE_HOLDS(element, elementCodec->type))
+		{
+			g_free(elements);
+			return(_xfconf_settings_backend_codec_decode_array(inCodec, inValue));
+		}
+
+		_xfconf_settings_backend_codec_set_fixed_element(elementCodec, element, elements, i);
+	}
+
+	/* Create variant taking over the block of elements */
+	return(g_variant_new_from_data(inCodec->variantType,
+									elements,
+									arraySize*elementCodec->fixedSize,
+									FALSE,
+									g_free,
+									elements));
+}
+
+/* Codec of arrays. Each element is converted by the codec of the elements. */
+static gboolean _xfconf_settings_backend_codec_encode_array(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	GPtrArray			*array;
+	gsize				arraySize;
+	gsize				i;
+	GVariant			*element;
+	GValue				*xfconfValue;
+
+	/* Set up array for storing in xfconf */
+	arraySize=g_variant_n_children(inVariant);
+	array=g_ptr_array_new_full(arraySize, _xfconf_settings_backend_free_value);
+	for(i=0; i<arraySize; i++)
+	{
+		element=g_variant_get_child_value(inVariant, i);
+
+		xfconfValue=g_new0(GValue, 1);
+		_xfconf_settings_backend_codec_encode(inCodec->elementCodec, element, xfconfValue);
+		g_ptr_array_add(array, xfconfValue);
+
+		g_variant_unref(element);
+	}
+
+	/* Set up property value */
+	g_value_init(outValue, inCodec->type);
+	g_value_take_boxed(outValue, array);
+
+	return(TRUE);
+}
+
+static GVariant* _xfconf_settings_backend_codec_decode_array(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	GPtrArray			*array;
+	gsize				arraySize;
+	GVariant			**elements;
+	GVariant			*value;
+	gsize				i;
+
+	/* Get size of array */
+	array=(GPtrArray*)g_value_get_boxed(inValue);
+	arraySize=(array ? array->len : 0);
+
+	/* Set up array for storing GVariants. If any element cannot be converted
+	 * the whole array is invalid.
+	 */
+	elements=g_new0(GVariant*, arraySize);
+	for(i=0; i<arraySize; i++)
+	{
+		elements[i]=_xfconf_settings_backend_codec_decode(inCodec->elementCodec,
+															(const GValue*)g_ptr_array_index(array, i));
+		if(!elements[i])
+		{
+			while(i>0) g_variant_unref(elements[--i]);
+			g_free(elements);
+			return(NULL);
+		}
+	}
+
+	/* Get final GVariant array */
+	value=g_variant_new_array(inCodec->elementCodec->variantType, elements, arraySize);
+
+	/* Release allocated resources */
+	g_free(elements);
+
+	return(value);
+}
+
+/* Register codec of a basic type and the codec of arrays of this type. Arrays
+ * of types with a fixed size are converted in bulk.
+ */
+static void _xfconf_settings_backend_codecs_add(const GVariantType *inVariantType,
+												GType inType,
+												gsize inFixedSize,
+												XfconfSettingsBackendEncodeFunc inEncode,
+												XfconfSettingsBackendDecodeFunc inDecode)
+{
+	XfconfSettingsBackendCodec			*codec;
+	guchar								index;
+
+	index=(guchar)*g_variant_type_peek_string(inVariantType);
+	g_assert(index<XFCONF_SETTINGS_CODECS_SIZE);
+
+	codec=&_xfconf_settings_backend_codecs[index];
+	codec->variantType=inVariantType;
+	codec->type=inType;
+	codec->fixedSize=inFixedSize;
+	codec->elementCodec=NULL;
+	codec->encode=inEncode;
+	codec->decode=inDecode;
+
+	codec=&_xfconf_settings_backend_array_codecs[index];
+	codec->variantType=g_variant_type_new_array(inVariantType);
+	codec->type=XFCONF_TYPE_G_VALUE_ARRAY;
+	codec->fixedSize=0;
+	codec->elementCodec=&_xfconf_settings_backend_codecs[index];
+	if(inFixedSize>0)
+	{
+		codec->encode=_xfconf_settings_backend_codec_encode_fixed_array;
+		codec->decode=_xfconf_settings_backend_codec_decode_fixed_array;
+	}
+		else
+		{
+			codec->encode=_xfconf_settings_backend_codec_encode_array;
+			codec->decode=_xfconf_settings_backend_codec_decode_array;
+		}
+}
+
+/* Build codec registry. Variant types not listed here cannot be mapped to a
+ * type xfconf can process (e.g. handles, variants, maybes, tuples, dictionaries
+ * and nested containers) and are stored in the format selected for complex variants.
+ */
+static void _xfconf_settings_backend_codecs_init(void)
+{
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_BOOLEAN, G_TYPE_BOOLEAN, sizeof(guint8),
+										_xfconf_settings_backend_codec_encode_boolean,
+										_xfconf_settings_backend_codec_decode_boolean);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_BYTE, G_TYPE_UCHAR, sizeof(guint8),
+										_xfconf_settings_backend_codec_encode_byte,
+										_xfconf_settings_backend_codec_decode_byte);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_INT16, XFCONF_TYPE_INT16, sizeof(gint16),
+										_xfconf_settings_backend_codec_encode_int16,
+										_xfconf_settings_backend_codec_decode_int16);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_UINT16, XFCONF_TYPE_UINT16, sizeof(guint16),
+										_xfconf_settings_backend_codec_encode_uint16,
+										_xfconf_settings_backend_codec_decode_uint16);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_INT32, G_TYPE_INT, sizeof(gint32),
+										_xfconf_settings_backend_codec_encode_int32,
+										_xfconf_settings_backend_codec_decode_int32);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_UINT32, G_TYPE_UINT, sizeof(guint32),
+										_xfconf_settings_backend_codec_encode_uint32,
+										_xfconf_settings_backend_codec_decode_uint32);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_INT64, G_TYPE_INT64, sizeof(gint64),
+										_xfconf_settings_backend_codec_encode_int64,
+										_xfconf_settings_backend_codec_decode_int64);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_UINT64, G_TYPE_UINT64, sizeof(guint64),
+										_xfconf_settings_backend_codec_encode_uint64,
+										_xfconf_settings_backend_codec_decode_uint64);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_DOUBLE, G_TYPE_DOUBLE, sizeof(gdouble),
+										_xfconf_settings_backend_codec_encode_double,
+										_xfconf_settings_backend_codec_decode_double);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_STRING, G_TYPE_STRING, 0,
+										_xfconf_settings_backend_codec_encode_string,
+										_xfconf_settings_backend_codec_decode_string);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_OBJECT_PATH, G_TYPE_STRING, 0,
+										_xfconf_settings_backend_codec_encode_string,
+										_xfconf_settings_backend_codec_decode_object_path);
+	_xfconf_settings_backend_codecs_add(G_VARIANT_TYPE_SIGNATURE, G_TYPE_STRING, 0,
+										_xfconf_settings_backend_codec_encode_string,
+										_xfconf_settings_backend_codec_decode_signature);
+}
+
+/* Find codec for a variant type or NULL if it cannot be mapped to a type
+ * xfconf can process. A basic type consists of one character and an array of
+ * basic types of two characters by definition so the type string does not
+ * need to be parsed.
+ */
+static const XfconfSettingsBackendCodec* _xfconf_settings_backend_codec_lookup(const GVariantType *inVariantType)
+{
+	const guchar						*signature;
+	const XfconfSettingsBackendCodec	*codecs;
+
+	signature=(const guchar*)g_variant_type_peek_string(inVariantType);
+
+	codecs=_xfconf_settings_backend_codecs;
+	if(*signature==G_VARIANT_CLASS_ARRAY)
+	{
+		codecs=_xfconf_settings_backend_array_codecs;
+		signature++;
+	}
+
+	if(*signature>=XFCONF_SETTINGS_CODECS_SIZE || !codecs[*signature].encode) return(NULL);
+	return(&codecs[*signature]);
+}
+
+/* Convert a variant to a value by codec */
+static gboolean _xfconf_settings_backend_codec_encode(const XfconfSettingsBackendCodec *inCodec, GVariant *inVariant, GValue *outValue)
+{
+	return((inCodec->encode)(inCodec, inVariant, outValue));
+}
+
+/* Convert a value to a variant by codec. Values of another type, e.g. unsigned
+ * 64-bit integers stored as signed ones by older versions, are transformed to
+ * the codec's type first.
+ */
+static GVariant* _xfconf_settings_backend_codec_decode(const XfconfSettingsBackendCodec *inCodec, const GValue *inValue)
+{
+	GValue								transformedValue=G_VALUE_INIT;
+	GVariant							*value;
+
+	if(G_VALUE_HOLDS(inValue, inCodec->type)) return((inCodec->decode)(inCodec, inValue));
+
+	if(!g_value_type_transformable(G_VALUE_TYPE(inValue), inCodec->type)) return(NULL);
+
+	g_value_init(&transformedValue, inCodec->type);
+	if(!g_value_transform(inValue, &transformedValue))
+	{
+		g_value_unset(&transformedValue);
 		return(NULL);
 	}
 
-	/* Get GType of property value for variant */
-	if(!_xfconf_settings_backend_gtype_from_gvariant_type(inExpectedType, &valueType))
+	value=(inCodec->decode)(inCodec, &transformedValue);
+	g_value_unset(&transformedValue);
+
+	return(value);
+}
+
+/* Convert a variant to a value which can be stored in xfconf. Complex variants
+ * are stored in the format requested.
+ */
+static gboolean _xfconf_settings_backend_value_from_variant(const gchar *inKey,
+															GVariant *inVariant,
+															XfconfSettingsBackendStorage inStorage,
+															GValue *outValue)
+{
+	const XfconfSettingsBackendCodec		*codec;
+
+	g_return_val_if_fail(inKey && *inKey, FALSE);
+	g_return_val_if_fail(inVariant, FALSE);
+	g_return_val_if_fail(outValue && !G_IS_VALUE(outValue), FALSE);
+
+	/* Get codec for variant's type */
+	codec=_xfconf_settings_backend_codec_lookup(g_variant_get_type(inVariant));
+
+	/* If variant type could not be mapped to a GType than get a string
+	 * representation of variant which will be store instead along with
+	 * variant's signature ...
+	 */
+	if(!codec)
 	{
-		g_critical("Failed to determine types when writting key %s.", inKey);
-		return(FALSE);
+		GPtrArray							*array;
+		GValue								*member;
+		GVariant							*normalVariant;
+
+		switch(inStorage)
+		{
+			/* Set up an array of magic number, signature and variant's data
+			 * in normal form encoded as base64.
+			 */
+			case XFCONF_SETTINGS_BACKEND_STORAGE_BINARY:
+				normalVariant=g_variant_get_normal_form(inVariant);
+
+				array=g_ptr_array_new_full(3, _xfconf_settings_backend_free_value);
+
+				member=g_new0(GValue, 1);
+				g_value_init(member, G_TYPE_UINT);
+				g_value_set_uint(member, XFCONF_VARIANT_BINARY_MAGIC);
+				g_ptr_array_add(array, member);
+
+				member=g_new0(GValue, 1);
+				g_value_init(member, G_TYPE_STRING);
+				g_value_set_string(member, g_variant_get_type_string(normalVariant));
+				g_ptr_array_add(array, member);
+
+				member=g_new0(GValue, 1);
+				g_value_init(member, G_TYPE_STRING);
+				g_value_take_string(member, g_base64_encode((const guchar*)g_variant_get_data(normalVariant),
+															g_variant_get_size(normalVariant)));
+				g_ptr_array_add(array, member);
+
+				g_value_init(outValue, XFCONF_TYPE_G_VALUE_ARRAY);
+				g_value_take_boxed(outValue, array);
+
+				g_variant_unref(normalVariant);
+				break;
+
+			/* Set up an array of magic number, signature and string representation
+			 * of variant.
+			 */
+			case XFCONF_SETTINGS_BACKEND_STORAGE_STRUCT:
+				array=g_ptr_array_new_full(3, _xfconf_settings_backend_free_value);
+
+				member=g_new0(GValue, 1);
+				g_value_init(member, G_TYPE_UINT);
+				g_value_set_uint(member, XFCONF_VARIANT_STRUCT_MAGIC);
+				g_ptr_array_add(array, member);
+
+				member=g_new0(GValue, 1);
+				g_value_init(member, G_TYPE_STRING);
+				g_value_set_string(member, g_variant_get_type_string(inVariant));
+				g_ptr_array_add(array, member);
+
+				member=g_new0(GValue, 1);
+				g_value_init(member, G_TYPE_STRING);
+				g_value_take_string(member, g_variant_print(inVariant, FALSE));
+				g_ptr_array_add(array, member);
+
+				g_value_init(outValue, XFCONF_TYPE_G_VALUE_ARRAY);
+				g_value_take_boxed(outValue, array);
+				break;
+
+			/* Set up property value with string representation of variant */
+			case XFCONF_SETTINGS_BACKEND_STORAGE_TEXT:
+			default:
+				g_value_init(outValue, G_TYPE_STRING);
+				g_value_take_string(outValue, g_variant_print(inVariant, FALSE));
+				break;
+		}
 	}
+		/* ... otherwise the variant can be converted by its codec */
+		else
+		{
+			if(!_xfconf_settings_backend_codec_encode(codec, inVariant, outValue))
+			{
+				g_critical("Failed to convert variant of type '%s' for key '%s'",
+							g_variant_get_type_string(inVariant),
+							inKey);
+				return(FALSE);
+			}
+		}
+
+	/* Return success result */
+	return(TRUE);
+}
+
+/* Convert a value stored in xfconf to a variant of expected type. If the variant
+ * is stored in another format than the one requested, the caller is told to
+ * rewrite it.
+ */
+static GVariant* _xfconf_settings_backend_variant_from_value(const gchar *inKey,
+																const GValue *inValue,
+																const GVariantType *inExpectedType,
+																XfconfSettingsBackendStorage inStorage,
+																gboolean *outNeedsRewrite)
+{
+	const XfconfSettingsBackendCodec		*codec;
+	GVariant								*value;
+
+	g_return_val_if_fail(inKey && *inKey, NULL);
+	g_return_val_if_fail(G_IS_VALUE(inValue), NULL);
+	g_return_val_if_fail(inExpectedType, NULL);
+
+	value=NULL;
+	if(outNeedsRewrite) *outNeedsRewrite=FALSE;
+
+	/* Get codec for expected type */
+	codec=_xfconf_settings_backend_codec_lookup(inExpectedType);
 
 	/* If variant type could not be mapped to a GType than the variant
 	 * has to be created from a string representation ...
 	 */
-	if(valueType.type==G_TYPE_INVALID)
+	if(!codec)
 	{
-#ifdef STORE_COMPLEX_VARIANTS
-		XfconfSettingsBackendVariantStruct	variantStruct;
+		XfconfSettingsBackendStorage		storage;
+		const gchar							*variantString;
 		GError								*error;
+		GPtrArray							*array;
+		const GValue						*member;
+		guint								magic;
 
 		error=NULL;
 
-		/* Initialize struct to get value of property at */
-		_xfconf_settings_backend_init_variant_struct(&variantStruct);
-
-		/* Get value of property */
-		if(!xfconf_channel_get_named_struct(self->channel, inKey, XFCONF_VARIANT_STRUCT_NAME, &variantStruct))
+		/* Detect format the variant is stored in. It is either a string or an
+		 * array of magic number, signature and the data.
+		 */
+		if(G_VALUE_HOLDS_STRING(inValue))
 		{
-			g_critical("Failed to get complex array to determine value for key '%s'", inKey);
+			storage=XFCONF_SETTINGS_BACKEND_STORAGE_TEXT;
+			variantString=g_value_get_string(inValue);
+		}
+			else
+			{
+				array=G_VALUE_HOLDS(inValue, XFCONF_TYPE_G_VALUE_ARRAY) ? (GPtrArray*)g_value_get_boxed(inValue) : NULL;
+				if(!array ||
+					array->len!=3 ||
+					!G_VALUE_HOLDS((const GValue*)g_ptr_array_index(array, 0), G_TYPE_UINT) ||
+					!G_VALUE_HOLDS_STRING((const GValue*)g_ptr_array_index(array, 1)) ||
+					!G_VALUE_HOLDS_STRING((const GValue*)g_ptr_array_index(array, 2)))
+				{
+					g_critical("Failed to parse variant for key '%s': %s",
+								inKey,
+								"Value is neither a string nor a complex array");
+					return(NULL);
+				}
+
+				member=(const GValue*)g_ptr_array_index(array, 0);
+				magic=g_value_get_uint(member);
+				if(magic==XFCONF_VARIANT_BINARY_MAGIC) storage=XFCONF_SETTINGS_BACKEND_STORAGE_BINARY;
+					else if(magic==XFCONF_VARIANT_STRUCT_MAGIC) storage=XFCONF_SETTINGS_BACKEND_STORAGE_STRUCT;
+					else
+					{
+						g_critical("Failed to parse variant for key '%s': %s",
+									inKey,
+									"Unknown magic number of complex array");
+						return(NULL);
+					}
+
+				/* Signature of stored variant must match expected one */
+				member=(const GValue*)g_ptr_array_index(array, 1);
+				if(!g_value_get_string(member) ||
+					!g_variant_type_string_is_valid(g_value_get_string(member)) ||
+					!g_variant_type_equal(G_VARIANT_TYPE(g_value_get_string(member)), inExpectedType))
+				{
+					g_critical("Failed to parse variant for key '%s': Stored signature '%s' does not match expected one",
+								inKey,
+								g_value_get_string(member));
+					return(NULL);
+				}
 
-			/* Release allocated resources */
-			_xfconf_settings_backend_free_variant_struct(&variantStruct);
+				member=(const GValue*)g_ptr_array_index(array, 2);
+				variantString=g_value_get_string(member);
+			}
 
-			return(NULL);
+		/* Create variant from its data in normal form. The decoded data is
+		 * taken over by the variant without copying it again.
+		 */
+		if(storage==XFCONF_SETTINGS_BACKEND_STORAGE_BINARY)
+		{
+			guchar							*data;
+			gsize							dataSize;
+			GBytes							*bytes;
+
+			data=g_base64_decode(variantString ? variantString : "", &dataSize);
+			bytes=g_bytes_new_take(data, dataSize);
+			value=g_variant_new_from_bytes(inExpectedType, bytes, FALSE);
+			g_bytes_unref(bytes);
 		}
+			/* Create variant from string representation for expected type */
+			else
+			{
+				value=g_variant_parse(inExpectedType,
+										variantString,
+										NULL,
+										NULL,
+										&error);
+				if(!value || error)
+				{
+					g_critical("Failed to parse variant for key '%s' from '%s': %s",
+								inKey,
+								variantString,
+								error ? error->message : "Unknown error");
 
-		/* Create variant from string representation for expected type */
-		value=g_variant_parse(inExpectedType,
-								variantStruct.value,
-								NULL,
-								NULL,
-								&error);
-		if(!value || error)
-		{
-			g_critical("Failed to parse variant for key '%s' from '%s': %s",
-						inKey,
-						variantStruct.value,
-						error ? error->message : "Unknown error");
+					/* Release allocated resources */
+					if(value) g_variant_unref(value);
+					if(error) g_error_free(error);
 
-			/* Release allocated resources */
-			if(value) g_variant_unref(value);
-			if(error) g_error_free(error);
-			_xfconf_settings_backend_free_variant_struct(&variantStruct);
+					return(NULL);
+				}
+			}
 
-			return(NULL);
-		}
+		/* Tell caller if variant is stored in another format than requested */
+		if(outNeedsRewrite) *outNeedsRewrite=(storage!=inStorage);
+	}
+		/* ... otherwise it can be converted by its codec */
+		else
+		{
+			value=_xfconf_settings_backend_codec_decode(codec, inValue);
+			if(!value)
+			{
+				g_critical("Failed to convert value of type %s for key '%s' to variant of type '%.*s'",
+							G_VALUE_TYPE_NAME(inValue),
+							inKey,
+							(gint)g_variant_type_get_string_length(inExpectedType),
+							g_variant_type_peek_string(inExpectedType));
+				return(NULL);
+			}
+		}
+
+	/* Return variant created from property value */
+	return(value);
+}
+
+/* Engine storing values in xfconfd */
+typedef struct _XfconfSettingsBackendEngineXfconfStore	XfconfSettingsBackendEngineXfconfStore;
+struct _XfconfSettingsBackendEngineXfconfStore
+{
+	XfconfChannel							*channel;
+	gulong									propertyChangedSignalID;
+
+	XfconfSettingsBackendEngineChangedFunc	changedFunc;
+	gpointer								userData;
+};
+
+#define XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(store)		(((XfconfSettingsBackendEngineXfconfStore*)(store))->channel)
+
+/* Another xfconfd owns its bus name, e.g. it was restarted or activated
+ * again, so lock states known may be outdated.
+ */
+static void _xfconf_settings_backend_engine_xfconf_on_name_appeared(GDBusConnection *inConnection,
+																	const gchar *inName,
+																	const gchar *inNameOwner,
+																	gpointer inUserData)
+{
+	g_atomic_int_inc(&_xfconf_settings_backend_lock_states_generation);
+
+	_xfconf_settings_backend_debug("Forgetting lock states as '%s' is owned by '%s' now",
+									inName,
+									inNameOwner);
+
+	/* Update permissions handed out already as their owners are not asking again */
+	_xfconf_settings_backend_cache_refresh_all_lock_states();
+}
+
+static gboolean _xfconf_settings_backend_engine_xfconf_init(void)
+{
+	GError								*error;
+
+	error=NULL;
+	if(!xfconf_init(&error))
+	{
+		g_critical("Could not initialize xfconf: %s", error ? error->message : "Unknown error");
+		if(error) g_error_free(error);
+
+		return(FALSE);
+	}
+
+	_xfconf_settings_backend_engine_xfconf_watcher_id=g_bus_watch_name(G_BUS_TYPE_SESSION,
+																		XFCONF_SETTINGS_XFCONFD_BUS_NAME,
+																		G_BUS_NAME_WATCHER_FLAGS_NONE,
+																		_xfconf_settings_backend_engine_xfconf_on_name_appeared,
+																		NULL,
+																		NULL,
+																		NULL);
+
+	return(TRUE);
+}
+
+static void _xfconf_settings_backend_engine_xfconf_shutdown(void)
+{
+	if(_xfconf_settings_backend_engine_xfconf_watcher_id)
+	{
+		g_bus_unwatch_name(_xfconf_settings_backend_engine_xfconf_watcher_id);
+		_xfconf_settings_backend_engine_xfconf_watcher_id=0;
+	}
+
+	xfconf_shutdown();
+}
+
+static void _xfconf_settings_backend_engine_xfconf_on_property_changed(XfconfChannel *inChannel,
+																		const gchar *inProperty,
+																		const GValue *inValue,
+																		gpointer inUserData)
+{
+	XfconfSettingsBackendEngineXfconfStore	*store=(XfconfSettingsBackendEngineXfconfStore*)inUserData;
+
+	store->changedFunc(inProperty, inValue, store->userData);
+}
+
+static gpointer _xfconf_settings_backend_engine_xfconf_open(const gchar *inChannelName,
+															XfconfSettingsBackendEngineChangedFunc inChangedFunc,
+															gpointer inUserData)
+{
+	XfconfSettingsBackendEngineXfconfStore	*store;
+
+	store=g_new0(XfconfSettingsBackendEngineXfconfStore, 1);
+	store->channel=xfconf_channel_new(inChannelName);
+	store->changedFunc=inChangedFunc;
+	store->userData=inUserData;
+	store->propertyChangedSignalID=g_signal_connect(store->channel,
+													"property-changed",
+													G_CALLBACK(_xfconf_settings_backend_engine_xfconf_on_property_changed),
+													store);
+
+	return(store);
+}
+
+static void _xfconf_settings_backend_engine_xfconf_close(gpointer inStore)
+{
+	XfconfSettingsBackendEngineXfconfStore	*store=(XfconfSettingsBackendEngineXfconfStore*)inStore;
+
+	g_signal_handler_disconnect(store->channel, store->propertyChangedSignalID);
+	g_object_unref(store->channel);
+	g_free(store);
+}
+
+static gboolean _xfconf_settings_backend_engine_xfconf_get(gpointer inStore, const gchar *inKey, GValue *outValue)
+{
+	return(xfconf_channel_get_property(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), inKey, outValue));
+}
+
+static gboolean _xfconf_settings_backend_engine_xfconf_set(gpointer inStore, const gchar *inKey, const GValue *inValue)
+{
+	return(xfconf_channel_set_property(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), inKey, inValue));
+}
+
+static gboolean _xfconf_settings_backend_engine_xfconf_set_array(gpointer inStore, const gchar *inKey, GPtrArray *inValues)
+{
+	GValue								value=G_VALUE_INIT;
+	gboolean							success;
+
+	if(inValues && inValues->len>0) return(xfconf_channel_set_arrayv(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), inKey, inValues));
+
+	/* Empty arrays are not accepted by xfconf_channel_set_arrayv() */
+	g_value_init(&value, XFCONF_TYPE_G_VALUE_ARRAY);
+	g_value_set_static_boxed(&value, inValues);
+	success=xfconf_channel_set_property(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), inKey, &value);
+	g_value_unset(&value);
+
+	return(success);
+}
+
+static void _xfconf_settings_backend_engine_xfconf_reset(gpointer inStore, const gchar *inKey, gboolean inRecursive)
+{
+	xfconf_channel_reset_property(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), inKey, inRecursive);
+}
+
+static gboolean _xfconf_settings_backend_engine_xfconf_has(gpointer inStore, const gchar *inKey)
+{
+	return(xfconf_channel_has_property(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), inKey));
+}
+
+static gboolean _xfconf_settings_backend_engine_xfconf_is_locked(gpointer inStore, const gchar *inKey)
+{
+	return(xfconf_channel_is_property_locked(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), inKey));
+}
+
+/* Get all properties below a path ending with a slash or of whole channel if
+ * path is NULL. Xfconf expects the property base without trailing slash.
+ */
+static GHashTable* _xfconf_settings_backend_engine_xfconf_get_all(gpointer inStore, const gchar *inPath)
+{
+	GHashTable							*properties;
+	gchar								*propertyBase;
+
+	propertyBase=NULL;
+	if(inPath && strlen(inPath)>1) propertyBase=g_strndup(inPath, strlen(inPath)-1);
+
+	properties=xfconf_channel_get_properties(XFCONF_SETTINGS_ENGINE_XFCONF_CHANNEL(inStore), propertyBase);
+	g_free(propertyBase);
+
+	return(properties);
+}
+
+static gchar** _xfconf_settings_backend_engine_xfconf_list_channels(void)
+{
+	return(xfconf_list_channels());
+}
+
+/* Get file xfconfd saves a channel to. It is saved shortly after changes. */
+static gchar* _xfconf_settings_backend_engine_xfconf_get_channel_file(const gchar *inChannelName)
+{
+	gchar								*filename;
+	gchar								*path;
+
+	filename=g_strconcat(inChannelName, ".xml", NULL);
+	path=g_build_filename(g_get_user_config_dir(), "xfce4", "xfconf", "xfce-perchannel-xml", filename, NULL);
+	g_free(filename);
+
+	return(path);
+}
+
+/* Engine keeping values in memory of this process. A store is the hash table
+ * of keys and values of its channel. Channels live until the module is
+ * unloaded. Nobody else can change these values so stores are never notified.
+ */
+static gboolean _xfconf_settings_backend_engine_memory_init(void)
+{
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+	if(!_xfconf_settings_backend_memory_channels)
+	{
+		_xfconf_settings_backend_memory_channels=g_hash_table_new_full(g_str_hash,
+																		g_str_equal,
+																		(GDestroyNotify)g_free,
+																		(GDestroyNotify)g_hash_table_destroy);
+	}
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+
+	return(TRUE);
+}
+
+static void _xfconf_settings_backend_engine_memory_shutdown(void)
+{
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+	if(_xfconf_settings_backend_memory_channels)
+	{
+		g_hash_table_destroy(_xfconf_settings_backend_memory_channels);
+		_xfconf_settings_backend_memory_channels=NULL;
+	}
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+}
+
+static gpointer _xfconf_settings_backend_engine_memory_open(const gchar *inChannelName,
+															XfconfSettingsBackendEngineChangedFunc inChangedFunc,
+															gpointer inUserData)
+{
+	GHashTable							*properties;
+
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+
+	properties=(GHashTable*)g_hash_table_lookup(_xfconf_settings_backend_memory_channels, inChannelName);
+	if(!properties)
+	{
+		properties=g_hash_table_new_full(g_str_hash,
+											g_str_equal,
+											(GDestroyNotify)g_free,
+											_xfconf_settings_backend_free_value);
+		g_hash_table_insert(_xfconf_settings_backend_memory_channels, g_strdup(inChannelName), properties);
+	}
+
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+
+	return(properties);
+}
+
+static void _xfconf_settings_backend_engine_memory_close(gpointer inStore)
+{
+	/* Values are kept for the next time the channel is opened */
+}
+
+static gboolean _xfconf_settings_backend_engine_memory_get(gpointer inStore, const gchar *inKey, GValue *outValue)
+{
+	const GValue						*value;
+
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+	value=(const GValue*)g_hash_table_lookup((GHashTable*)inStore, inKey);
+	if(value) _xfconf_settings_backend_copy_value(value, outValue);
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+
+	return(value!=NULL);
+}
+
+static gboolean _xfconf_settings_backend_engine_memory_set(gpointer inStore, const gchar *inKey, const GValue *inValue)
+{
+	GValue								*value;
+
+	value=g_new0(GValue, 1);
+	_xfconf_settings_backend_copy_value(inValue, value);
+
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+	g_hash_table_replace((GHashTable*)inStore, g_strdup(inKey), value);
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+
+	return(TRUE);
+}
+
+static gboolean _xfconf_settings_backend_engine_memory_set_array(gpointer inStore, const gchar *inKey, GPtrArray *inValues)
+{
+	GValue								value=G_VALUE_INIT;
+	gboolean							success;
+
+	g_value_init(&value, XFCONF_TYPE_G_VALUE_ARRAY);
+	g_value_set_static_boxed(&value, inValues);
+	success=_xfconf_settings_backend_engine_memory_set(inStore, inKey, &value);
+	g_value_unset(&value);
+
+	return(success);
+}
+
+static void _xfconf_settings_backend_engine_memory_reset(gpointer inStore, const gchar *inKey, gboolean inRecursive)
+{
+	GHashTableIter						iter;
+	gpointer							key;
+	gsize								keyLength;
+
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+
+	g_hash_table_remove((GHashTable*)inStore, inKey);
+
+	/* Remove all keys below key if requested */
+	if(inRecursive)
+	{
+		keyLength=strlen(inKey);
+
+		g_hash_table_iter_init(&iter, (GHashTable*)inStore);
+		while(g_hash_table_iter_next(&iter, &key, NULL))
+		{
+			if(strncmp((const gchar*)key, inKey, keyLength)==0 &&
+				(keyLength==0 || inKey[keyLength-1]=='/' || ((const gchar*)key)[keyLength]=='/'))
+			{
+				g_hash_table_iter_remove(&iter);
+			}
+		}
+	}
+
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+}
+
+static gboolean _xfconf_settings_backend_engine_memory_has(gpointer inStore, const gchar *inKey)
+{
+	gboolean							hasKey;
+
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+	hasKey=g_hash_table_contains((GHashTable*)inStore, inKey);
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+
+	return(hasKey);
+}
+
+static gboolean _xfconf_settings_backend_engine_memory_is_locked(gpointer inStore, const gchar *inKey)
+{
+	return(FALSE);
+}
+
+static GHashTable* _xfconf_settings_backend_engine_memory_get_all(gpointer inStore, const gchar *inPath)
+{
+	GHashTable							*properties;
+	GHashTableIter						iter;
+	gpointer							key;
+	gpointer							value;
+	GValue								*copy;
+
+	properties=g_hash_table_new_full(g_str_hash,
+										g_str_equal,
+										(GDestroyNotify)g_free,
+										_xfconf_settings_backend_free_value);
+
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+
+	g_hash_table_iter_init(&iter, (GHashTable*)inStore);
+	while(g_hash_table_iter_next(&iter, &key, &value))
+	{
+		if(inPath && !g_str_has_prefix((const gchar*)key, inPath)) continue;
+
+		copy=g_new0(GValue, 1);
+		_xfconf_settings_backend_copy_value((const GValue*)value, copy);
+		g_hash_table_insert(properties, g_strdup((const gchar*)key), copy);
+	}
+
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+
+	return(properties);
+}
+
+static gchar** _xfconf_settings_backend_engine_memory_list_channels(void)
+{
+	gchar								**channels;
+	GHashTableIter						iter;
+	gpointer							key;
+	guint								i;
+
+	G_LOCK(_xfconf_settings_backend_memory_channels);
+
+	i=0;
+	channels=g_new0(gchar*, g_hash_table_size(_xfconf_settings_backend_memory_channels)+1);
+
+	g_hash_table_iter_init(&iter, _xfconf_settings_backend_memory_channels);
+	while(g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		channels[i++]=g_strdup((const gchar*)key);
+	}
+
+	G_UNLOCK(_xfconf_settings_backend_memory_channels);
+
+	return(channels);
+}
+
+static gchar* _xfconf_settings_backend_engine_memory_get_channel_file(const gchar *inChannelName)
+{
+	/* Values are not saved to any file */
+	return(NULL);
+}
+
+/* Index of engine used by backends while the selected engine cannot be
+ * initialized.
+ */
+#define XFCONF_SETTINGS_ENGINE_FALLBACK		1
+
+static const XfconfSettingsBackendEngine	_xfconf_settings_backend_engines[]=
+{
+	{
+		"xfconf",
+		_xfconf_settings_backend_engine_xfconf_init,
+		_xfconf_settings_backend_engine_xfconf_shutdown,
+		_xfconf_settings_backend_engine_xfconf_open,
+		_xfconf_settings_backend_engine_xfconf_close,
+		_xfconf_settings_backend_engine_xfconf_get,
+		_xfconf_settings_backend_engine_xfconf_set,
+		_xfconf_settings_backend_engine_xfconf_set_array,
+		_xfconf_settings_backend_engine_xfconf_reset,
+		_xfconf_settings_backend_engine_xfconf_has,
+		_xfconf_settings_backend_engine_xfconf_is_locked,
+		_xfconf_settings_backend_engine_xfconf_get_all,
+		_xfconf_settings_backend_engine_xfconf_list_channels,
+		_xfconf_settings_backend_engine_xfconf_get_channel_file
+	},
+
+	{
+		"memory",
+		_xfconf_settings_backend_engine_memory_init,
+		_xfconf_settings_backend_engine_memory_shutdown,
+		_xfconf_settings_backend_engine_memory_open,
+		_xfconf_settings_backend_engine_memory_close,
+		_xfconf_settings_backend_engine_memory_get,
+		_xfconf_settings_backend_engine_memory_set,
+		_xfconf_settings_backend_engine_memory_set_array,
+		_xfconf_settings_backend_engine_memory_reset,
+		_xfconf_settings_backend_engine_memory_has,
+		_xfconf_settings_backend_engine_memory_is_locked,
+		_xfconf_settings_backend_engine_memory_get_all,
+		_xfconf_settings_backend_engine_memory_list_channels,
+		_xfconf_settings_backend_engine_memory_get_channel_file
+	},
+
+	{ NULL, }
+};
+
+/* Get engine selected by environment variable */
+static const XfconfSettingsBackendEngine* _xfconf_settings_backend_get_engine_option(void)
+{
+	const gchar							*value;
+	const XfconfSettingsBackendEngine	*engine;
+
+	value=g_getenv(XFCONF_SETTINGS_ENV_ENGINE);
+	if(!value || !*value) return(&_xfconf_settings_backend_engines[0]);
+
+	for(engine=_xfconf_settings_backend_engines; engine->name; engine++)
+	{
+		if(g_ascii_strcasecmp(value, engine->name)==0) return(engine);
+	}
+
+	g_warning("Unknown engine '%s' - using '%s'", value, _xfconf_settings_backend_engines[0].name);
+	return(&_xfconf_settings_backend_engines[0]);
+}
+
+/* Store a value by engine of cache. Arrays are stored by the engine's
+ * function for arrays.
+ */
+static gboolean _xfconf_settings_backend_cache_engine_set(XfconfSettingsBackendCache *self,
+															const gchar *inKey,
+															const GValue *inValue)
+{
+	if(G_VALUE_HOLDS(inValue, XFCONF_TYPE_G_VALUE_ARRAY))
+	{
+		return(self->engine->set_array(self->store, inKey, (GPtrArray*)g_value_get_boxed(inValue)));
+	}
+
+	return(self->engine->set(self->store, inKey, inValue));
+}
+
+/* Convert a value stored by engine to a variant of its natural type to store
+ * it in a snapshot. Returns a floating variant or NULL if the type of value
+ * is not supported.
+ */
+static GVariant* _xfconf_settings_backend_snapshot_variant_from_value(const GValue *inValue)
+{
+	GType								type;
+
+	type=G_VALUE_TYPE(inValue);
+
+	if(type==G_TYPE_BOOLEAN) return(g_variant_new_boolean(g_value_get_boolean(inValue)));
+	if(type==G_TYPE_UCHAR) return(g_variant_new_byte(g_value_get_uchar(inValue)));
+	if(type==XFCONF_TYPE_INT16) return(g_variant_new_int16(xfconf_g_value_get_int16(inValue)));
+	if(type==XFCONF_TYPE_UINT16) return(g_variant_new_uint16(xfconf_g_value_get_uint16(inValue)));
+	if(type==G_TYPE_INT) return(g_variant_new_int32(g_value_get_int(inValue)));
+	if(type==G_TYPE_UINT) return(g_variant_new_uint32(g_value_get_uint(inValue)));
+	if(type==G_TYPE_INT64) return(g_variant_new_int64(g_value_get_int64(inValue)));
+	if(type==G_TYPE_UINT64) return(g_variant_new_uint64(g_value_get_uint64(inValue)));
+	if(type==G_TYPE_DOUBLE) return(g_variant_new_double(g_value_get_double(inValue)));
+	if(type==G_TYPE_STRING) return(g_variant_new_string(g_value_get_string(inValue) ? g_value_get_string(inValue) : ""));
+
+	/* Arrays are stored as array of variants of their elements */
+	if(type==XFCONF_TYPE_G_VALUE_ARRAY)
+	{
+		GPtrArray						*array;
+		GVariantBuilder					builder;
+		GVariant						*element;
+		guint							i;
+
+		array=(GPtrArray*)g_value_get_boxed(inValue);
+
+		g_variant_builder_init(&builder, G_VARIANT_TYPE("av"));
+		for(i=0; array && i<array->len; i++)
+		{
+			element=_xfconf_settings_backend_snapshot_variant_from_value((const GValue*)g_ptr_array_index(array, i));
+			if(!element)
+			{
+				g_variant_builder_clear(&builder);
+				return(NULL);
+			}
+
+			g_variant_builder_add(&builder, "v", element);
+		}
+
+		return(g_variant_builder_end(&builder));
+	}
+
+	return(NULL);
+}
+
+/* Convert a variant read from a snapshot back to the value stored by engine */
+static gboolean _xfconf_settings_backend_snapshot_value_from_variant(GVariant *inVariant, GValue *outValue)
+{
+	switch(g_variant_classify(inVariant))
+	{
+		case G_VARIANT_CLASS_BOOLEAN:
+			g_value_init(outValue, G_TYPE_BOOLEAN);
+			g_value_set_boolean(outValue, g_variant_get_boolean(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_BYTE:
+			g_value_init(outValue, G_TYPE_UCHAR);
+			g_value_set_uchar(outValue, g_variant_get_byte(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_INT16:
+			g_value_init(outValue, XFCONF_TYPE_INT16);
+			xfconf_g_value_set_int16(outValue, g_variant_get_int16(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_UINT16:
+			g_value_init(outValue, XFCONF_TYPE_UINT16);
+			xfconf_g_value_set_uint16(outValue, g_variant_get_uint16(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_INT32:
+			g_value_init(outValue, G_TYPE_INT);
+			g_value_set_int(outValue, g_variant_get_int32(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_UINT32:
+			g_value_init(outValue, G_TYPE_UINT);
+			g_value_set_uint(outValue, g_variant_get_uint32(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_INT64:
+			g_value_init(outValue, G_TYPE_INT64);
+			g_value_set_int64(outValue, g_variant_get_int64(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_UINT64:
+			g_value_init(outValue, G_TYPE_UINT64);
+			g_value_set_uint64(outValue, g_variant_get_uint64(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_DOUBLE:
+			g_value_init(outValue, G_TYPE_DOUBLE);
+			g_value_set_double(outValue, g_variant_get_double(inVariant));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_STRING:
+			g_value_init(outValue, G_TYPE_STRING);
+			g_value_set_string(outValue, g_variant_get_string(inVariant, NULL));
+			return(TRUE);
+
+		case G_VARIANT_CLASS_ARRAY:
+			if(g_variant_is_of_type(inVariant, G_VARIANT_TYPE("av")))
+			{
+				GPtrArray				*array;
+				GVariant				*child;
+				GVariant				*element;
+				GValue					*value;
+				gsize					count;
+				gsize					i;
+
+				count=g_variant_n_children(inVariant);
+				array=g_ptr_array_new_full(count, _xfconf_settings_backend_free_value);
+				for(i=0; i<count; i++)
+				{
+					child=g_variant_get_child_value(inVariant, i);
+					element=g_variant_get_variant(child);
+
+					value=g_new0(GValue, 1);
+					g_ptr_array_add(array, value);
+
+					if(!_xfconf_settings_backend_snapshot_value_from_variant(element, value))
+					{
+						g_variant_unref(element);
+						g_variant_unref(child);
+						g_ptr_array_unref(array);
+						return(FALSE);
+					}
+
+					g_variant_unref(element);
+					g_variant_unref(child);
+				}
+
+				g_value_init(outValue, XFCONF_TYPE_G_VALUE_ARRAY);
+				g_value_take_boxed(outValue, array);
+				return(TRUE);
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	return(FALSE);
+}
+
+/* Take a reference on a mapped snapshot */
+static XfconfSettingsBackendSnapshot* _xfconf_settings_backend_snapshot_ref(XfconfSettingsBackendSnapshot *self)
+{
+	g_atomic_int_inc(&self->refCount);
+	return(self);
+}
+
+/* Release a reference on a mapped snapshot and unmap it if it was the last one */
+static void _xfconf_settings_backend_snapshot_unref(gpointer inData)
+{
+	XfconfSettingsBackendSnapshot		*self=(XfconfSettingsBackendSnapshot*)inData;
+
+	if(!g_atomic_int_dec_and_test(&self->refCount)) return;
+
+	munmap((gpointer)self->data, self->size);
+	g_free(self);
+}
+
+/* Get path of snapshot file of a channel */
+static gchar* _xfconf_settings_backend_snapshot_get_path(const gchar *inChannelName)
+{
+	gchar								*filename;
+	gchar								*path;
+
+	filename=g_strconcat(inChannelName, ".snapshot", NULL);
+	path=g_build_filename(g_get_user_cache_dir(), "xfconf-gsettings", filename, NULL);
+	g_free(filename);
+
+	return(path);
+}
+
+/* Get modification time and size of the file an engine saves a channel to.
+ * Both are 0 if the file does not exist.
+ */
+static void _xfconf_settings_backend_snapshot_get_source_state(const XfconfSettingsBackendEngine *inEngine,
+																const gchar *inChannelName,
+																gint64 *outTime,
+																guint64 *outSize)
+{
+	gchar								*path;
+	struct stat							state;
+
+	*outTime=0;
+	*outSize=0;
+
+	path=inEngine->get_channel_file(inChannelName);
+	if(path && stat(path, &state)==0)
+	{
+		*outTime=((gint64)state.st_mtim.tv_sec*G_GINT64_CONSTANT(1000000000))+state.st_mtim.tv_nsec;
+		*outSize=(guint64)state.st_size;
+	}
+
+	g_free(path);
+}
+
+/* Map snapshot file into memory. Returns NULL if it does not exist, is
+ * invalid or stale.
+ */
+static XfconfSettingsBackendSnapshot* _xfconf_settings_backend_snapshot_open(const gchar *inPath,
+																				gint64 inSourceTime,
+																				guint64 inSourceSize)
+{
+	XfconfSettingsBackendSnapshot		*self;
+	const XfconfSettingsBackendSnapshotHeader	*header;
+	struct stat							state;
+	gpointer							data;
+	gint								fd;
+	gsize								minimumSize;
+
+	fd=g_open(inPath, O_RDONLY, 0);
+	if(fd<0) return(NULL);
+
+	if(fstat(fd, &state)!=0 ||
+		state.st_size<(off_t)sizeof(XfconfSettingsBackendSnapshotHeader) ||
+		(guint64)state.st_size>G_MAXUINT32)
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	/* Map file shared so clearing the generation by other processes is seen */
+	data=mmap(NULL, state.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(data==MAP_FAILED) return(NULL);
+
+	/* Check header */
+	header=(const XfconfSettingsBackendSnapshotHeader*)data;
+	minimumSize=sizeof(XfconfSettingsBackendSnapshotHeader)+
+					((gsize)header->bucketsCount+1)*sizeof(guint32)+
+					(gsize)header->entriesCount*sizeof(XfconfSettingsBackendSnapshotEntry);
+
+	if(header->magic!=XFCONF_SETTINGS_SNAPSHOT_MAGIC ||
+		header->version!=XFCONF_SETTINGS_SNAPSHOT_VERSION ||
+		header->generation==0 ||
+		header->sourceTime!=inSourceTime ||
+		header->sourceSize!=inSourceSize ||
+		header->bucketsCount==0 ||
+		minimumSize>(gsize)state.st_size)
+	{
+		_xfconf_settings_backend_debug("Snapshot '%s' is invalid or stale", inPath);
+
+		munmap(data, state.st_size);
+		return(NULL);
+	}
+
+	self=g_new0(XfconfSettingsBackendSnapshot, 1);
+	self->refCount=1;
+	self->data=(const guint8*)data;
+	self->size=state.st_size;
+	self->generation=header->generation;
+
+	_xfconf_settings_backend_debug("Mapped snapshot '%s' of generation %" G_GUINT64_FORMAT " with %u entries",
+									inPath,
+									self->generation,
+									header->entriesCount);
+
+	return(self);
+}
+
+/* Look up a key in a snapshot. Returns FALSE if snapshot became stale,
+ * otherwise TRUE and the variant of key's value or NULL if key does not exist.
+ */
+static gboolean _xfconf_settings_backend_snapshot_lookup(XfconfSettingsBackendSnapshot *self,
+															const gchar *inKey,
+															GVariant **outValue)
+{
+	const XfconfSettingsBackendSnapshotHeader	*header;
+	const guint32						*buckets;
+	const XfconfSettingsBackendSnapshotEntry	*entries;
+	const XfconfSettingsBackendSnapshotEntry	*entry;
+	guint32								hash;
+	guint32								bucket;
+	guint32								i;
+	gsize								keyLength;
+	GVariant							*container;
+
+	*outValue=NULL;
+
+	/* Generation is cleared by processes changing a value */
+	header=(const XfconfSettingsBackendSnapshotHeader*)self->data;
+	if(*((volatile const guint64*)&header->generation)!=self->generation) return(FALSE);
+
+	buckets=(const guint32*)(self->data+sizeof(XfconfSettingsBackendSnapshotHeader));
+	entries=(const XfconfSettingsBackendSnapshotEntry*)(buckets+header->bucketsCount+1);
+
+	/* Find entry in bucket of key */
+	hash=g_str_hash(inKey);
+	keyLength=strlen(inKey);
+	bucket=hash % header->bucketsCount;
+
+	for(i=buckets[bucket]; i<buckets[bucket+1] && i<header->entriesCount; i++)
+	{
+		entry=&entries[i];
+		if(entry->hash!=hash ||
+			entry->keyLength!=keyLength ||
+			(gsize)entry->keyOffset+keyLength>self->size ||
+			memcmp(self->data+entry->keyOffset, inKey, keyLength)!=0)
+		{
+			continue;
+		}
+
+		if((gsize)entry->valueOffset+entry->valueLength>self->size) return(TRUE);
+
+		/* The variant refers to the mapped data which stays mapped as long
+		 * as the variant exists.
+		 */
+		container=g_variant_new_from_data(G_VARIANT_TYPE_VARIANT,
+											self->data+entry->valueOffset,
+											entry->valueLength,
+											FALSE,
+											_xfconf_settings_backend_snapshot_unref,
+											_xfconf_settings_backend_snapshot_ref(self));
+		g_variant_ref_sink(container);
+		*outValue=g_variant_get_variant(container);
+		g_variant_unref(container);
+
+		return(TRUE);
+	}
+
+	return(TRUE);
+}
+
+/* Get all keys and values of a snapshot as stored by engine regardless of
+ * its generation. Values which cannot be converted back are skipped.
+ */
+static GHashTable* _xfconf_settings_backend_snapshot_get_all(XfconfSettingsBackendSnapshot *self)
+{
+	const XfconfSettingsBackendSnapshotHeader	*header;
+	const XfconfSettingsBackendSnapshotEntry	*entries;
+	const XfconfSettingsBackendSnapshotEntry	*entry;
+	GHashTable							*values;
+	GVariant							*container;
+	GVariant							*variant;
+	GValue								*value;
+	guint32								i;
+
+	values=g_hash_table_new_full(g_str_hash,
+									g_str_equal,
+									(GDestroyNotify)g_free,
+									_xfconf_settings_backend_free_value);
+
+	header=(const XfconfSettingsBackendSnapshotHeader*)self->data;
+	entries=(const XfconfSettingsBackendSnapshotEntry*)(self->data+
+															sizeof(XfconfSettingsBackendSnapshotHeader)+
+															((gsize)header->bucketsCount+1)*sizeof(guint32));
+
+	for(i=0; i<header->entriesCount; i++)
+	{
+		entry=&entries[i];
+		if((gsize)entry->keyOffset+entry->keyLength>self->size ||
+			(gsize)entry->valueOffset+entry->valueLength>self->size)
+		{
+			continue;
+		}
+
+		container=g_variant_new_from_data(G_VARIANT_TYPE_VARIANT,
+											self->data+entry->valueOffset,
+											entry->valueLength,
+											FALSE,
+											_xfconf_settings_backend_snapshot_unref,
+											_xfconf_settings_backend_snapshot_ref(self));
+		g_variant_ref_sink(container);
+		variant=g_variant_get_variant(container);
+
+		value=g_new0(GValue, 1);
+		if(_xfconf_settings_backend_snapshot_value_from_variant(variant, value))
+		{
+			g_hash_table_replace(values,
+									g_strndup((const gchar*)self->data+entry->keyOffset, entry->keyLength),
+									value);
+		}
+			else g_free(value);
+
+		g_variant_unref(variant);
+		g_variant_unref(container);
+	}
+
+	return(values);
+}
+
+/* Clear generation of a snapshot file so processes which mapped it know it
+ * became stale. Returns the generation the file had.
+ */
+static guint64 _xfconf_settings_backend_snapshot_invalidate_file(const gchar *inPath)
+{
+	XfconfSettingsBackendSnapshotHeader	header;
+	guint64								generation;
+	gint								fd;
+
+	fd=g_open(inPath, O_RDWR, 0);
+	if(fd<0) return(0);
+
+	generation=0;
+	if(pread(fd, &header, sizeof(header), 0)==(gssize)sizeof(header) &&
+		header.magic==XFCONF_SETTINGS_SNAPSHOT_MAGIC &&
+		header.generation!=0)
+	{
+		generation=header.generation;
+		header.generation=0;
+		if(pwrite(fd, &header.generation, sizeof(header.generation), G_STRUCT_OFFSET(XfconfSettingsBackendSnapshotHeader, generation))!=(gssize)sizeof(header.generation))
+		{
+			g_warning("Could not invalidate snapshot '%s'", inPath);
+		}
+	}
+
+	close(fd);
+
+	return(generation);
+}
+
+/* Sort entries of a snapshot by bucket */
+static gint _xfconf_settings_backend_snapshot_compare_entries(gconstpointer inLeft, gconstpointer inRight, gpointer inUserData)
+{
+	const XfconfSettingsBackendSnapshotEntry	*left=(const XfconfSettingsBackendSnapshotEntry*)inLeft;
+	const XfconfSettingsBackendSnapshotEntry	*right=(const XfconfSettingsBackendSnapshotEntry*)inRight;
+	guint32								bucketsCount=GPOINTER_TO_UINT(inUserData);
+	guint32								leftBucket;
+	guint32								rightBucket;
+
+	leftBucket=left->hash % bucketsCount;
+	rightBucket=right->hash % bucketsCount;
+
+	return(leftBucket<rightBucket ? -1 : (leftBucket>rightBucket ? 1 : 0));
+}
+
+/* Build snapshot file of keys and their values as stored by engine and
+ * replace the snapshot file atomically. Returns FALSE if a value cannot be
+ * stored in a snapshot.
+ */
+static gboolean _xfconf_settings_backend_snapshot_write(const gchar *inPath,
+														GHashTable *inValues,
+														guint64 inGeneration,
+														gint64 inSourceTime,
+														guint64 inSourceSize)
+{
+	XfconfSettingsBackendSnapshotHeader	header;
+	GArray								*entries;
+	GByteArray							*data;
+	GByteArray							*file;
+	guint32								*buckets;
+	GHashTableIter						iter;
+	gpointer							key;
+	gpointer							value;
+	XfconfSettingsBackendSnapshotEntry	entry;
+	XfconfSettingsBackendSnapshotEntry	*entryIter;
+	GVariant							*variant;
+	guint32								dataOffset;
+	guint32								bucket;
+	guint								i;
+	gchar								*directory;
+	GError								*error;
+	gboolean							success;
+	static const guint8					padding[8]={ 0, };
+
+	entries=g_array_new(FALSE, FALSE, sizeof(XfconfSettingsBackendSnapshotEntry));
+	data=g_byte_array_new();
+
+	/* Serialize keys and values. Offsets are relative to the data for now. */
+	g_hash_table_iter_init(&iter, inValues);
+	while(g_hash_table_iter_next(&iter, &key, &value))
+	{
+		variant=_xfconf_settings_backend_snapshot_variant_from_value((const GValue*)value);
+		if(!variant)
+		{
+			_xfconf_settings_backend_debug("Cannot store value of key '%s' in snapshot", (const gchar*)key);
+
+			g_array_unref(entries);
+			g_byte_array_unref(data);
+			return(FALSE);
+		}
+
+		variant=g_variant_ref_sink(g_variant_new_variant(variant));
+
+		entry.hash=g_str_hash(key);
+		entry.keyLength=strlen((const gchar*)key);
+		entry.keyOffset=data->len;
+		g_byte_array_append(data, (const guint8*)key, entry.keyLength+1);
+
+		g_byte_array_append(data, padding, (8-(data->len % 8)) % 8);
+		entry.valueLength=g_variant_get_size(variant);
+		entry.valueOffset=data->len;
+		g_byte_array_set_size(data, data->len+entry.valueLength);
+		g_variant_store(variant, data->data+entry.valueOffset);
+		g_variant_unref(variant);
+
+		g_array_append_val(entries, entry);
+	}
+
+	/* Build header and buckets */
+	header.magic=XFCONF_SETTINGS_SNAPSHOT_MAGIC;
+	header.version=XFCONF_SETTINGS_SNAPSHOT_VERSION;
+	header.generation=inGeneration;
+	header.sourceTime=inSourceTime;
+	header.sourceSize=inSourceSize;
+	header.bucketsCount=MAX(1, entries->len);
+	header.entriesCount=entries->len;
+
+	g_array_sort_with_data(entries, _xfconf_settings_backend_snapshot_compare_entries, GUINT_TO_POINTER(header.bucketsCount));
+
+	buckets=g_new0(guint32, header.bucketsCount+1);
+	for(i=0; i<entries->len; i++)
+	{
+		bucket=g_array_index(entries, XfconfSettingsBackendSnapshotEntry, i).hash % header.bucketsCount;
+		buckets[bucket+1]++;
+	}
+	for(i=0; i<header.bucketsCount; i++) buckets[i+1]+=buckets[i];
+
+	/* Data starts aligned after header, buckets and entries */
+	dataOffset=sizeof(header)+(header.bucketsCount+1)*sizeof(guint32)+entries->len*sizeof(XfconfSettingsBackendSnapshotEntry);
+	dataOffset+=(8-(dataOffset % 8)) % 8;
+
+	for(i=0; i<entries->len; i++)
+	{
+		entryIter=&g_array_index(entries, XfconfSettingsBackendSnapshotEntry, i);
+		entryIter->keyOffset+=dataOffset;
+		entryIter->valueOffset+=dataOffset;
+	}
+
+	file=g_byte_array_sized_new(dataOffset+data->len);
+	g_byte_array_append(file, (const guint8*)&header, sizeof(header));
+	g_byte_array_append(file, (const guint8*)buckets, (header.bucketsCount+1)*sizeof(guint32));
+	g_byte_array_append(file, (const guint8*)entries->data, entries->len*sizeof(XfconfSettingsBackendSnapshotEntry));
+	g_byte_array_append(file, padding, dataOffset-file->len);
+	g_byte_array_append(file, data->data, data->len);
+
+	/* Replace snapshot file atomically */
+	directory=g_path_get_dirname(inPath);
+	g_mkdir_with_parents(directory, 0700);
+	g_free(directory);
+
+	error=NULL;
+	success=g_file_set_contents(inPath, (const gchar*)file->data, file->len, &error);
+	if(!success)
+	{
+		g_warning("Could not write snapshot '%s': %s", inPath, error ? error->message : "Unknown error");
+		if(error) g_error_free(error);
+	}
+
+	_xfconf_settings_backend_debug("Wrote snapshot '%s' of generation %" G_GUINT64_FORMAT " with %u entries",
+									inPath,
+									inGeneration,
+									header.entriesCount);
+
+	/* Release allocated resources */
+	g_byte_array_unref(file);
+	g_free(buckets);
+	g_byte_array_unref(data);
+	g_array_unref(entries);
+
+	return(success);
+}
+
+/* Free an entry of a cache */
+static void _xfconf_settings_backend_cache_entry_free(gpointer inData)
+{
+	XfconfSettingsBackendCacheEntry		*entry=(XfconfSettingsBackendCacheEntry*)inData;
+
+	if(G_IS_VALUE(&entry->value)) g_value_unset(&entry->value);
+	if(entry->variant) g_variant_unref(entry->variant);
+	g_free(entry);
+}
+
+/* Store a copy of a property value in cache along with its decoded variant if known */
+static void _xfconf_settings_backend_cache_store(XfconfSettingsBackendCache *self,
+													const gchar *inKey,
+													const GValue *inValue,
+													GVariant *inVariant)
+{
+	XfconfSettingsBackendCacheEntry		*entry;
+
+	entry=g_new0(XfconfSettingsBackendCacheEntry, 1);
+	_xfconf_settings_backend_copy_value(inValue, &entry->value);
+	if(inVariant) entry->variant=g_variant_ref(inVariant);
+
+	g_rec_mutex_lock(&self->lock);
+	g_hash_table_replace(self->entries, g_strdup(inKey), entry);
+	if(self->snapshotChangedKeys) g_hash_table_add(self->snapshotChangedKeys, g_strdup(inKey));
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Remove a property from cache */
+static void _xfconf_settings_backend_cache_remove(XfconfSettingsBackendCache *self,
+													const gchar *inKey)
+{
+	g_rec_mutex_lock(&self->lock);
+	g_hash_table_remove(self->entries, inKey);
+	if(self->snapshotChangedKeys) g_hash_table_add(self->snapshotChangedKeys, g_strdup(inKey));
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Forget snapshot of cache and clear generation of snapshot file as values
+ * of the channel changed. Caller must hold lock of cache.
+ */
+static void _xfconf_settings_backend_cache_invalidate_snapshot(XfconfSettingsBackendCache *self)
+{
+	guint64								generation;
+
+	if(!self->snapshotPath) return;
+
+	if(self->snapshot)
+	{
+		_xfconf_settings_backend_snapshot_unref(self->snapshot);
+		self->snapshot=NULL;
+	}
+
+	/* Snapshot file needs to be invalidated only once until a new one is written */
+	if(!self->snapshotInvalidated)
+	{
+		generation=_xfconf_settings_backend_snapshot_invalidate_file(self->snapshotPath);
+		self->snapshotGeneration=MAX(self->snapshotGeneration, generation);
+		self->snapshotInvalidated=TRUE;
+	}
+}
+
+/* Write snapshot of all values of channel without asking the engine for
+ * values not loaded yet. The values of the cache are merged with those of
+ * the snapshot the cache was created with except for the keys changed since.
+ * Without such a snapshot it is only written if the whole channel is cached.
+ */
+static gboolean _xfconf_settings_backend_cache_on_write_snapshot(gpointer inUserData)
+{
+	XfconfSettingsBackendCache			*self=(XfconfSettingsBackendCache*)inUserData;
+	GHashTable							*values;
+	GHashTable							*baseValues;
+	GHashTableIter						iter;
+	gpointer							key;
+	gpointer							value;
+	gint64								sourceTime;
+	guint64								sourceSize;
+	guint64								generation;
+
+	g_rec_mutex_lock(&self->lock);
+
+	/* Values queued by write-behind are not stored yet. Flushing them
+	 * schedules another snapshot.
+	 */
+	if(g_hash_table_size(self->pendingWrites)==0 &&
+		(self->isSeeded || self->snapshotBase))
+	{
+		values=g_hash_table_new(g_str_hash, g_str_equal);
+
+		baseValues=NULL;
+		if(!self->isSeeded)
+		{
+			baseValues=_xfconf_settings_backend_snapshot_get_all(self->snapshotBase);
+
+			g_hash_table_iter_init(&iter, baseValues);
+			while(g_hash_table_iter_next(&iter, &key, &value))
+			{
+				if(!g_hash_table_contains(self->snapshotChangedKeys, key)) g_hash_table_insert(values, key, value);
+			}
+		}
+
+		g_hash_table_iter_init(&iter, self->entries);
+		while(g_hash_table_iter_next(&iter, &key, &value))
+		{
+			g_hash_table_insert(values, key, &((XfconfSettingsBackendCacheEntry*)value)->value);
+		}
+
+		_xfconf_settings_backend_snapshot_get_source_state(self->engine, self->channelName, &sourceTime, &sourceSize);
+
+		generation=_xfconf_settings_backend_snapshot_invalidate_file(self->snapshotPath);
+		generation=MAX(generation, self->snapshotGeneration)+1;
+		if(_xfconf_settings_backend_snapshot_write(self->snapshotPath, values, generation, sourceTime, sourceSize))
+		{
+			self->snapshotGeneration=generation;
+			self->snapshotInvalidated=FALSE;
+		}
+
+		/* Release allocated resources */
+		g_hash_table_destroy(values);
+		if(baseValues) g_hash_table_destroy(baseValues);
+	}
+
+	self->snapshotSourceID=0;
+
+	g_rec_mutex_unlock(&self->lock);
+
+	return(G_SOURCE_REMOVE);
+}
+
+/* Schedule writing a snapshot after values were committed. Caller must hold lock of cache. */
+static void _xfconf_settings_backend_cache_schedule_snapshot(XfconfSettingsBackendCache *self)
+{
+	if(!self->snapshotPath || self->snapshotSourceID) return;
+
+	self->snapshotSourceID=g_timeout_add(XFCONF_SETTINGS_SNAPSHOT_WRITE_DELAY,
+											_xfconf_settings_backend_cache_on_write_snapshot,
+											self);
+}
+
+/* Store properties fetched by one bulk request in cache and release them.
+ * Caller must hold lock of cache.
+ */
+static void _xfconf_settings_backend_cache_store_all(XfconfSettingsBackendCache *self,
+														GHashTable *inProperties)
+{
+	GHashTableIter						iter;
+	gpointer							key;
+	gpointer							value;
+
+	if(!inProperties) return;
+
+	g_hash_table_iter_init(&iter, inProperties);
+	while(g_hash_table_iter_next(&iter, &key, &value))
+	{
+		/* Do not replace values written by this process but not yet stored in xfconf */
+		if(g_hash_table_contains(self->pendingWrites, key)) continue;
+
+		_xfconf_settings_backend_cache_store(self, (const gchar*)key, (const GValue*)value, NULL);
+	}
+
+	g_hash_table_destroy(inProperties);
+}
+
+/* Check if cache holds all properties of channel at or below the path of a
+ * key, i.e. a key not found in cache does not exist. Caller must hold lock
+ * of cache.
+ */
+static gboolean _xfconf_settings_backend_cache_is_loaded(XfconfSettingsBackendCache *self,
+															const gchar *inKey)
+{
+	if(self->isSeeded) return(TRUE);
+
+	return(self->loadedPaths && _xfconf_settings_backend_watch_matches(self->loadedPaths, inKey));
+}
+
+/* Seed cache with all properties of channel by one request to xfconf.
+ * Caller must hold lock of cache. Returns the number of requests made to xfconf.
+ */
+static guint _xfconf_settings_backend_cache_seed(XfconfSettingsBackendCache *self)
+{
+	/* Seed cache only once */
+	if(self->isSeeded) return(0);
+
+	/* Get all properties of channel. If channel does not exist yet or xfconf
+	 * cannot be reached, no properties are returned and cache is seeded empty.
+	 * In both cases reading from xfconf directly would not return any value
+	 * either and any property set later will be added by change notifications.
+	 */
+	_xfconf_settings_backend_cache_store_all(self, self->engine->get_all(self->store, NULL));
+
+	self->isSeeded=TRUE;
+
+	/* Paths loaded before are covered by seeded cache now */
+	if(self->loadedPaths)
+	{
+		_xfconf_settings_backend_watch_free(self->loadedPaths);
+		self->loadedPaths=NULL;
+	}
+
+	/* Cache is used from now on. Write a snapshot if there was none usable. */
+	if(self->snapshot)
+	{
+		_xfconf_settings_backend_snapshot_unref(self->snapshot);
+		self->snapshot=NULL;
+	}
+		else _xfconf_settings_backend_cache_schedule_snapshot(self);
+
+	_xfconf_settings_backend_debug("Seeded cache for channel '%s' with %u properties",
+									self->channelName,
+									g_hash_table_size(self->entries));
+	return(1);
+}
+
+/* Load all properties below a path ending with a slash by one request to
+ * xfconf, e.g. all keys of a schema when GSettings starts to use its path.
+ * Each path is loaded once. Caller must hold lock of cache. Returns the
+ * number of requests made to xfconf.
+ */
+static guint _xfconf_settings_backend_cache_load_path(XfconfSettingsBackendCache *self,
+														const gchar *inPath)
+{
+	/* Nothing to do if path or any path above was loaded or channel was seeded.
+	 * Also do not ask xfconf while reads are served from snapshot.
+	 */
+	if(_xfconf_settings_backend_cache_is_loaded(self, inPath) || self->snapshot) return(0);
+
+	/* Loading root path is seeding the whole channel */
+	if(strcmp(inPath, "/")==0) return(_xfconf_settings_backend_cache_seed(self));
+
+	/* Get all properties below path. If path does not exist, no properties
+	 * are returned and no key below this path exists.
+	 */
+	_xfconf_settings_backend_cache_store_all(self, self->engine->get_all(self->store, inPath));
+
+	if(!self->loadedPaths) self->loadedPaths=g_new0(XfconfSettingsBackendWatch, 1);
+	_xfconf_settings_backend_watch_add(self->loadedPaths, inPath);
+
+	_xfconf_settings_backend_debug("Loaded path '%s' of channel '%s' into cache with now %u properties",
+									inPath,
+									self->channelName,
+									g_hash_table_size(self->entries));
+	return(1);
+}
+
+/* Look up a property in cache and return its value as variant of expected type.
+ * The number of requests made to xfconf is added to the round-trip counter.
+ */
+static GVariant* _xfconf_settings_backend_cache_lookup(XfconfSettingsBackendCache *self,
+														const gchar *inKey,
+														const GVariantType *inExpectedType,
+														guint *ioRoundTrips)
+{
+	XfconfSettingsBackendCacheEntry		*entry;
+	GVariant							*value;
+	gboolean							needsRewrite;
+	gchar								*path;
+
+	value=NULL;
+
+	g_rec_mutex_lock(&self->lock);
+
+	/* Serve reads from snapshot until path of key is loaded into cache. Values
+	 * changed since the snapshot was written made it stale.
+	 */
+	if(!_xfconf_settings_backend_cache_is_loaded(self, inKey) &&
+		self->snapshot &&
+		!g_hash_table_contains(self->entries, inKey))
+	{
+		if(_xfconf_settings_backend_snapshot_lookup(self->snapshot, inKey, &value))
+		{
+			/* Values of other types than the expected one must be decoded */
+			if(value && !g_variant_is_of_type(value, inExpectedType))
+			{
+				GVariant					*storedVariant;
+				GValue						storedValue=G_VALUE_INIT;
+
+				storedVariant=value;
+				value=NULL;
+
+				if(_xfconf_settings_backend_snapshot_value_from_variant(storedVariant, &storedValue))
+				{
+					value=_xfconf_settings_backend_variant_from_value(inKey,
+																		&storedValue,
+																		inExpectedType,
+																		self->storage,
+																		NULL);
+					if(value) value=g_variant_take_ref(value);
+					g_value_unset(&storedValue);
+				}
+
+				g_variant_unref(storedVariant);
+			}
+
+			g_rec_mutex_unlock(&self->lock);
+
+			return(value);
+		}
+
+		_xfconf_settings_backend_debug("Snapshot of channel '%s' became stale", self->channelName);
+
+		_xfconf_settings_backend_snapshot_unref(self->snapshot);
+		self->snapshot=NULL;
+	}
+
+	/* Ensure all properties at path of key are loaded before looking up property
+	 * so the other keys of its schema are read from cache.
+	 */
+	if(!_xfconf_settings_backend_cache_is_loaded(self, inKey))
+	{
+		path=g_strndup(inKey, strrchr(inKey, '/')-inKey+1);
+		*ioRoundTrips+=_xfconf_settings_backend_cache_load_path(self, path);
+		g_free(path);
+	}
+
+	/* If property is not cached it does not exist */
+	entry=(XfconfSettingsBackendCacheEntry*)g_hash_table_lookup(self->entries, inKey);
+	if(entry)
+	{
+		/* Return the decoded variant if it is of expected type, otherwise
+		 * decode value from xfconf again and remember it for next lookup.
+		 */
+		if(entry->variant && g_variant_is_of_type(entry->variant, inExpectedType))
+		{
+			value=g_variant_ref(entry->variant);
+		}
+			else
+			{
+				value=_xfconf_settings_backend_variant_from_value(inKey,
+																	&entry->value,
+																	inExpectedType,
+																	self->storage,
+																	&needsRewrite);
+				if(value)
+				{
+					value=g_variant_take_ref(value);
+
+					if(entry->variant) g_variant_unref(entry->variant);
+					entry->variant=g_variant_ref(value);
+				}
+
+				/* If variant is stored in another format than the requested one
+				 * schedule a rewrite in requested format.
+				 */
+				if(value && needsRewrite)
+				{
+					g_hash_table_add(self->pendingRewrites, g_strdup(inKey));
+					if(!self->pendingRewritesSourceID)
+					{
+						self->pendingRewritesSourceID=g_idle_add_full(G_PRIORITY_LOW,
+																		_xfconf_settings_backend_cache_on_rewrite_values,
+																		self,
+																		NULL);
+					}
+				}
+			}
+	}
+
+	g_rec_mutex_unlock(&self->lock);
+
+	return(value);
+}
+
+/* Check if a property may exist. Only if its path is loaded into cache it is
+ * known for sure that a property does not exist, otherwise it must be assumed
+ * that it exists.
+ */
+static gboolean _xfconf_settings_backend_cache_may_contain(XfconfSettingsBackendCache *self,
+															const gchar *inKey)
+{
+	gboolean							mayContain;
+
+	g_rec_mutex_lock(&self->lock);
+	mayContain=(!_xfconf_settings_backend_cache_is_loaded(self, inKey) ||
+				g_hash_table_contains(self->entries, inKey));
+	g_rec_mutex_unlock(&self->lock);
+
+	return(mayContain);
+}
+
+/* Create permission with initial allowed state */
+static GPermission* _xfconf_settings_backend_permission_new(gboolean inAllowed)
+{
+	GPermission							*permission;
+
+	permission=G_PERMISSION(g_object_new(XFCONF_TYPE_SETTINGS_BACKEND_PERMISSION, NULL));
+	g_permission_impl_update(permission, inAllowed, FALSE, FALSE);
+
+	return(permission);
+}
+
+/* Set allowed state of permission and notify its owners if it changed */
+static void _xfconf_settings_backend_permission_set_allowed(XfconfSettingsBackendPermission *self,
+															gboolean inAllowed)
+{
+	g_permission_impl_update(G_PERMISSION(self), inAllowed, FALSE, FALSE);
+}
+
+/* Get lock state of a property. Each property is asked for once until lock
+ * states may have changed. The number of requests made to xfconf is added to
+ * the round-trip counter. Caller must hold lock of cache.
+ */
+static gboolean _xfconf_settings_backend_cache_get_lock_state(XfconfSettingsBackendCache *self,
+																const gchar *inKey,
+																guint *ioRoundTrips)
+{
+	gpointer							value;
+	gboolean							isLocked;
+
+	if(g_hash_table_lookup_extended(self->lockStates, inKey, NULL, &value))
+	{
+		isLocked=GPOINTER_TO_INT(value);
+	}
+		else
+		{
+			isLocked=self->engine->is_locked(self->store, inKey);
+			(*ioRoundTrips)++;
+
+			g_hash_table_insert(self->lockStates, g_strdup(inKey), GINT_TO_POINTER(isLocked));
+		}
+
+	return(isLocked);
+}
+
+/* Check if a path is locked. A path is locked if the property of the same
+ * name is locked. The root path cannot be locked. Caller must hold lock of cache.
+ */
+static gboolean _xfconf_settings_backend_cache_is_path_locked(XfconfSettingsBackendCache *self,
+																const gchar *inPath,
+																guint *ioRoundTrips)
+{
+	gchar								*property;
+	gsize								length;
+	gboolean							isLocked;
+
+	length=strlen(inPath);
+	while(length>0 && inPath[length-1]=='/') length--;
+
+	isLocked=FALSE;
+	if(length>0)
+	{
+		property=g_strndup(inPath, length);
+		isLocked=_xfconf_settings_backend_cache_get_lock_state(self, property, ioRoundTrips);
+		g_free(property);
+	}
+
+	return(isLocked);
+}
+
+/* Forget lock states if they may have changed since they were determined and
+ * update the permissions handed out already with the current lock states.
+ * The number of requests made to xfconf is added to the round-trip counter.
+ * Caller must hold lock of cache.
+ */
+static void _xfconf_settings_backend_cache_check_lock_states(XfconfSettingsBackendCache *self,
+																guint *ioRoundTrips)
+{
+	GHashTableIter						iter;
+	gpointer							key;
+	gpointer							value;
+	gint								generation;
+	gboolean							isLocked;
+
+	generation=g_atomic_int_get(&_xfconf_settings_backend_lock_states_generation);
+	if(generation==self->lockStatesGeneration) return;
+
+	g_hash_table_remove_all(self->lockStates);
+	self->lockStatesGeneration=generation;
+
+	/* Permissions are shared with their callers so they must be kept and
+	 * updated in place instead of being replaced by new ones.
+	 */
+	g_hash_table_iter_init(&iter, self->permissions);
+	while(g_hash_table_iter_next(&iter, &key, &value))
+	{
+		isLocked=_xfconf_settings_backend_cache_is_path_locked(self, (const gchar*)key, ioRoundTrips);
+		_xfconf_settings_backend_permission_set_allowed((XfconfSettingsBackendPermission*)value, !isLocked);
+	}
+}
+
+/* Check if a property is locked. The number of requests made to xfconf is
+ * added to the round-trip counter.
+ */
+static gboolean _xfconf_settings_backend_cache_is_locked(XfconfSettingsBackendCache *self,
+															const gchar *inKey,
+															guint *ioRoundTrips)
+{
+	gboolean							isLocked;
+
+	g_rec_mutex_lock(&self->lock);
+
+	_xfconf_settings_backend_cache_check_lock_states(self, ioRoundTrips);
+	isLocked=_xfconf_settings_backend_cache_get_lock_state(self, inKey, ioRoundTrips);
+
+	g_rec_mutex_unlock(&self->lock);
+
+	return(isLocked);
+}
+
+/* Get permission to change the keys below a path. All callers asking for the
+ * same path share one permission. The number of requests made to xfconf is
+ * added to the round-trip counter.
+ */
+static GPermission* _xfconf_settings_backend_cache_get_permission(XfconfSettingsBackendCache *self,
+																	const gchar *inPath,
+																	guint *ioRoundTrips)
+{
+	GPermission							*permission;
+	gboolean							isLocked;
+
+	g_rec_mutex_lock(&self->lock);
+
+	_xfconf_settings_backend_cache_check_lock_states(self, ioRoundTrips);
+
+	permission=(GPermission*)g_hash_table_lookup(self->permissions, inPath);
+	if(!permission)
+	{
+		isLocked=_xfconf_settings_backend_cache_is_path_locked(self, inPath, ioRoundTrips);
+		permission=_xfconf_settings_backend_permission_new(!isLocked);
+		g_hash_table_insert(self->permissions, g_strdup(inPath), permission);
+	}
+
+	g_object_ref(permission);
+
+	g_rec_mutex_unlock(&self->lock);
+
+	return(permission);
+}
+
+/* Get common path of keys including the trailing slash */
+static gsize _xfconf_settings_backend_get_common_path_length(gchar **inKeys)
+{
+	gsize								length;
+	gsize								i;
+	gchar								**iter;
+
+	g_return_val_if_fail(inKeys && *inKeys, 0);
+
+	/* Find longest common prefix of all keys ... */
+	length=strlen(*inKeys);
+	for(iter=inKeys+1; *iter; iter++)
+	{
+		for(i=0; i<length && (*iter)[i]==(*inKeys)[i]; i++);
+		length=i;
+	}
+
+	/* ... and cut it down to the last path separator */
+	while(length>0 && (*inKeys)[length-1]!='/') length--;
+
+	return(length);
+}
+
+/* Emit changes of keys at a backend relative to their common path. Keys must
+ * be unique.
+ */
+static void _xfconf_settings_backend_emit_changes(GSettingsBackend *inBackend,
+													gchar **inKeys,
+													guint inKeysCount,
+													gpointer inOriginTag)
+{
+	gsize								pathLength;
+	gchar								*path;
+	const gchar							**relativeKeys;
+	guint								i;
+
+	g_return_if_fail(inKeys && inKeysCount>0);
+
+	/* A single key changed */
+	if(inKeysCount==1)
+	{
+		g_settings_backend_changed(inBackend, inKeys[0], inOriginTag);
+		return;
+	}
+
+	/* Determine common path of all changed keys */
+	pathLength=_xfconf_settings_backend_get_common_path_length(inKeys);
+	path=g_strndup(inKeys[0], pathLength);
+
+	/* Announce whole path as changed if too many keys below it changed ... */
+	if(inKeysCount>XFCONF_SETTINGS_CHANGES_PATH_THRESHOLD)
+	{
+		g_settings_backend_path_changed(inBackend, path, inOriginTag);
+	}
+		/* ... otherwise list the changed keys relative to their common path */
+		else
+		{
+			relativeKeys=g_new0(const gchar*, inKeysCount+1);
+			for(i=0; i<inKeysCount; i++) relativeKeys[i]=inKeys[i]+pathLength;
+
+			g_settings_backend_keys_changed(inBackend, path, relativeKeys, inOriginTag);
+
+			g_free(relativeKeys);
+		}
+
+	/* Release allocated resources */
+	g_free(path);
+}
+
+/* Emit changes of keys at all backends using this cache. Caller must hold lock of cache. */
+static void _xfconf_settings_backend_cache_emit_changes(XfconfSettingsBackendCache *self,
+														gchar **inKeys,
+														guint inKeysCount)
+{
+	GList								*iter;
+
+	g_return_if_fail(inKeys && inKeysCount>0);
+
+	for(iter=self->backends; iter; iter=g_list_next(iter))
+	{
+		_xfconf_settings_backend_emit_changes(G_SETTINGS_BACKEND(iter->data), inKeys, inKeysCount, NULL);
+	}
+
+	_xfconf_settings_backend_debug("Emitted change of %u keys at channel '%s'",
+									inKeysCount,
+									self->channelName);
+}
+
+/* Emit all changes collected since last emission */
+static gboolean _xfconf_settings_backend_cache_emit_pending_changes(gpointer inUserData)
+{
+	XfconfSettingsBackendCache			*self=(XfconfSettingsBackendCache*)inUserData;
+	GHashTableIter						iter;
+	gpointer							key;
+	gchar								**keys;
+	guint								keysCount;
+
+	g_rec_mutex_lock(&self->lock);
+
+	/* This source will be removed */
+	self->pendingChangesSourceID=0;
+
+	/* Take all keys changed from list of pending changes */
+	keysCount=0;
+	keys=g_new0(gchar*, g_hash_table_size(self->pendingChanges)+1);
+
+	g_hash_table_iter_init(&iter, self->pendingChanges);
+	while(g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		keys[keysCount++]=(gchar*)key;
+		g_hash_table_iter_steal(&iter);
+	}
+
+	/* Emit changes */
+	if(keysCount>0) _xfconf_settings_backend_cache_emit_changes(self, keys, keysCount);
+
+	g_rec_mutex_unlock(&self->lock);
+
+	/* Release allocated resources */
+	g_strfreev(keys);
+
+	return(G_SOURCE_REMOVE);
+}
+
+/* Remember that xfconf will notify about a change of a property caused by
+ * this process. The change is already emitted by the backend so the
+ * notification must not be emitted again. An unset value means the property
+ * gets reset.
+ */
+static void _xfconf_settings_backend_cache_begin_echo(XfconfSettingsBackendCache *self,
+														const gchar *inKey,
+														const GValue *inValue)
+{
+	GValue								*value;
+
+	value=NULL;
+	if(inValue && G_IS_VALUE(inValue))
+	{
+		value=g_new0(GValue, 1);
+		_xfconf_settings_backend_copy_value(inValue, value);
+	}
+
+	g_rec_mutex_lock(&self->lock);
+	g_hash_table_replace(self->echoes, g_strdup(inKey), value);
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Forget about expected notification of a change caused by this process.
+ * If the notification did not arrive yet it will be dropped anyway because
+ * the cache already holds the value notified.
+ */
+static void _xfconf_settings_backend_cache_end_echo(XfconfSettingsBackendCache *self,
+													const gchar *inKey)
+{
+	g_rec_mutex_lock(&self->lock);
+	g_hash_table_remove(self->echoes, inKey);
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Free a node of prefix tree of watched paths including all its children */
+static void _xfconf_settings_backend_watch_free(XfconfSettingsBackendWatch *self)
+{
+	XfconfSettingsBackendWatch			*child;
+
+	while(self->children)
+	{
+		child=self->children;
+		self->children=child->next;
+		_xfconf_settings_backend_watch_free(child);
+	}
+
+	g_free(self->name);
+	g_free(self);
+}
+
+/* Find child node of a path component of given length */
+static XfconfSettingsBackendWatch* _xfconf_settings_backend_watch_find_child(XfconfSettingsBackendWatch *self,
+																				const gchar *inName,
+																				gsize inNameLength)
+{
+	XfconfSettingsBackendWatch			*child;
+
+	for(child=self->children; child; child=child->next)
+	{
+		if(child->nameLength==inNameLength &&
+			strncmp(child->name, inName, inNameLength)==0)
+		{
+			return(child);
+		}
+	}
+
+	return(NULL);
+}
+
+/* Add a subscription of a path to prefix tree */
+static void _xfconf_settings_backend_watch_add(XfconfSettingsBackendWatch *self,
+												const gchar *inPath)
+{
+	XfconfSettingsBackendWatch			*node;
+	XfconfSettingsBackendWatch			*child;
+	gsize								length;
+
+	node=self;
+	while(*inPath)
+	{
+		/* Skip path separators */
+		while(*inPath=='/') inPath++;
+		if(!*inPath) break;
+
+		/* Find or create node for next path component */
+		length=strcspn(inPath, "/");
+		child=_xfconf_settings_backend_watch_find_child(node, inPath, length);
+		if(!child)
+		{
+			child=g_new0(XfconfSettingsBackendWatch, 1);
+			child->name=g_strndup(inPath, length);
+			child->nameLength=length;
+			child->next=node->children;
+			node->children=child;
+		}
+
+		node=child;
+		inPath+=length;
+	}
+
+	node->refCount++;
+}
+
+/* Remove a subscription of a path from prefix tree. Returns TRUE if the node
+ * is not needed anymore and can be removed from its parent.
+ */
+static gboolean _xfconf_settings_backend_watch_remove(XfconfSettingsBackendWatch *self,
+														const gchar *inPath)
+{
+	XfconfSettingsBackendWatch			*child;
+	XfconfSettingsBackendWatch			**link;
+	gsize								length;
+
+	/* Skip path separators */
+	while(*inPath=='/') inPath++;
+
+	/* Release subscription if end of path is reached ... */
+	if(!*inPath)
+	{
+		if(self->refCount>0) self->refCount--;
+	}
+		/* ... otherwise release it at node of next path component */
+		else
+		{
+			length=strcspn(inPath, "/");
+			for(link=&self->children; *link; link=&(*link)->next)
+			{
+				child=*link;
+				if(child->nameLength==length && strncmp(child->name, inPath, length)==0)
+				{
+					if(_xfconf_settings_backend_watch_remove(child, inPath+length))
+					{
+						*link=child->next;
+						child->next=NULL;
+						_xfconf_settings_backend_watch_free(child);
+					}
+					break;
+				}
+			}
+		}
+
+	return(self->refCount==0 && !self->children);
+}
+
+/* Check if a key is at or below any subscribed path. Only the path components
+ * of the key are checked as the last component is the name of the key itself.
+ */
+static gboolean _xfconf_settings_backend_watch_matches(XfconfSettingsBackendWatch *self,
+														const gchar *inKey)
+{
+	XfconfSettingsBackendWatch			*node;
+	gsize								length;
+
+	node=self;
+	while(node)
+	{
+		if(node->refCount>0) return(TRUE);
+
+		while(*inKey=='/') inKey++;
+		length=strcspn(inKey, "/");
+		if(inKey[length]!='/') break;
+
+		node=_xfconf_settings_backend_watch_find_child(node, inKey, length);
+		inKey+=length;
+	}
+
+	return(FALSE);
+}
+
+/* A property at channel of cache has changed */
+static void _xfconf_settings_backend_cache_on_property_changed(const gchar *inProperty,
+																const GValue *inValue,
+																gpointer inUserData)
+{
+	XfconfSettingsBackendCache			*self=(XfconfSettingsBackendCache*)inUserData;
+	XfconfSettingsBackendCacheEntry		*entry;
+	gboolean							isReset;
+	gboolean							isUnchanged;
+	gboolean							isEcho;
+	gpointer							echoValue;
+	gboolean							isWatched;
+
+	/* If value is unset the property was reset otherwise it was changed */
+	isReset=(!inValue || !G_IS_VALUE(inValue));
+
+	g_rec_mutex_lock(&self->lock);
+
+	/* Any snapshot of the channel is stale now */
+	_xfconf_settings_backend_cache_invalidate_snapshot(self);
+
+	/* Values written by this process but not yet stored in xfconf win over
+	 * any change made by other processes in the meantime.
+	 */
+	if(g_hash_table_contains(self->pendingWrites, inProperty))
+	{
+		g_rec_mutex_unlock(&self->lock);
+		return;
+	}
+
+	/* If nobody in this process watches the property just keep the cache
+	 * up-to-date as no change has to be emitted. If a snapshot base is merged
+	 * into the next snapshot, changed values must be kept even for paths not
+	 * loaded as the base would bring back the stale value otherwise.
+	 */
+	G_LOCK(_xfconf_settings_backend_watches);
+	isWatched=(_xfconf_settings_backend_watches &&
+				_xfconf_settings_backend_watch_matches(_xfconf_settings_backend_watches, inProperty));
+	G_UNLOCK(_xfconf_settings_backend_watches);
+
+	if(!isWatched)
+	{
+		if(isReset) _xfconf_settings_backend_cache_remove(self, inProperty);
+			else if(self->snapshotBase ||
+						_xfconf_settings_backend_cache_is_loaded(self, inProperty) ||
+						g_hash_table_contains(self->entries, inProperty))
+			{
+				_xfconf_settings_backend_cache_store(self, inProperty, inValue, NULL);
+			}
+
+		g_rec_mutex_unlock(&self->lock);
+		return;
+	}
+
+	/* Check if value really changed. If path of property was not loaded yet,
+	 * it is unknown if a property existed before so the change must be assumed.
+	 */
+	entry=(XfconfSettingsBackendCacheEntry*)g_hash_table_lookup(self->entries, inProperty);
+	if(isReset) isUnchanged=(_xfconf_settings_backend_cache_is_loaded(self, inProperty) && !entry);
+		else isUnchanged=(entry && _xfconf_settings_backend_value_equal(&entry->value, inValue));
+
+	/* Check if this notification is the echo of a change by this process */
+	isEcho=FALSE;
+	if(g_hash_table_lookup_extended(self->echoes, inProperty, NULL, &echoValue))
+	{
+		if(isReset) isEcho=(echoValue==NULL);
+			else isEcho=(echoValue && _xfconf_settings_backend_value_equal((const GValue*)echoValue, inValue));
+	}
+
+	/* Update cache and queue the change for emission if it was not caused by this process */
+	if(!isUnchanged)
+	{
+		if(isReset) _xfconf_settings_backend_cache_remove(self, inProperty);
+			else _xfconf_settings_backend_cache_store(self, inProperty, inValue, NULL);
+
+		if(!isEcho && self->backends)
+		{
+			g_hash_table_add(self->pendingChanges, g_strdup(inProperty));
+			if(!self->pendingChangesSourceID)
+			{
+				self->pendingChangesSourceID=g_timeout_add(XFCONF_SETTINGS_CHANGES_COALESCE_INTERVAL,
+															_xfconf_settings_backend_cache_emit_pending_changes,
+															self);
+			}
+		}
+	}
+
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Free a pending write */
+static void _xfconf_settings_backend_pending_write_free(gpointer inData)
+{
+	XfconfSettingsBackendPendingWrite	*pendingWrite=(XfconfSettingsBackendPendingWrite*)inData;
+
+	if(G_IS_VALUE(&pendingWrite->value)) g_value_unset(&pendingWrite->value);
+	if(G_IS_VALUE(&pendingWrite->previousValue)) g_value_unset(&pendingWrite->previousValue);
+	if(pendingWrite->previousVariant) g_variant_unref(pendingWrite->previousVariant);
+	g_free(pendingWrite);
+}
+
+/* Store all pending writes in xfconf. Caller must not hold lock of cache.
+ * Returns the number of requests made to xfconf.
+ */
+static guint _xfconf_settings_backend_cache_flush_pending_writes(XfconfSettingsBackendCache *self)
+{
+	GHashTable							*pendingWrites;
+	GHashTableIter						iter;
+	gpointer							key;
+	gpointer							value;
+	XfconfSettingsBackendPendingWrite	*pendingWrite;
+	gboolean							success;
+	gchar								**failedKeys;
+	guint								failedKeysCount;
+	guint								roundTrips;
+
+	g_rec_mutex_lock(&self->lock);
+
+	/* Flushing now so remove scheduled flush */
+	if(self->pendingWritesSourceID)
+	{
+		g_source_remove(self->pendingWritesSourceID);
+		self->pendingWritesSourceID=0;
+	}
+
+	/* Take all pending writes */
+	pendingWrites=self->pendingWrites;
+	self->pendingWrites=g_hash_table_new_full(g_str_hash,
+												g_str_equal,
+												(GDestroyNotify)g_free,
+												_xfconf_settings_backend_pending_write_free);
+
+	/* Store each pending write in xfconf */
+	roundTrips=0;
+	failedKeysCount=0;
+	failedKeys=g_new0(gchar*, g_hash_table_size(pendingWrites)+1);
+
+	g_hash_table_iter_init(&iter, pendingWrites);
+	while(g_hash_table_iter_next(&iter, &key, &value))
+	{
+		pendingWrite=(XfconfSettingsBackendPendingWrite*)value;
+
+		/* The change was already emitted when the write was queued */
+		_xfconf_settings_backend_cache_begin_echo(self, (const gchar*)key, &pendingWrite->value);
+		if(G_IS_VALUE(&pendingWrite->value))
+		{
+			success=_xfconf_settings_backend_cache_engine_set(self, (const gchar*)key, &pendingWrite->value);
+		}
+			else
+			{
+				self->engine->reset(self->store, (const gchar*)key, TRUE);
+				success=TRUE;
+			}
+		_xfconf_settings_backend_cache_end_echo(self, (const gchar*)key);
+		roundTrips++;
+
+		/* If storing failed roll back the value in cache */
+		if(!success)
+		{
+			g_warning("Failed to store pending write of key '%s' at channel '%s'",
+						(const gchar*)key,
+						self->channelName);
+
+			if(G_IS_VALUE(&pendingWrite->previousValue))
+			{
+				_xfconf_settings_backend_cache_store(self,
+														(const gchar*)key,
+														&pendingWrite->previousValue,
+														pendingWrite->previousVariant);
+			}
+				else
+				{
+					_xfconf_settings_backend_cache_remove(self, (const gchar*)key);
+				}
+
+			failedKeys[failedKeysCount++]=g_strdup((const gchar*)key);
+		}
+	}
+
+	/* Emit changes for all keys rolled back */
+	if(failedKeysCount>0) _xfconf_settings_backend_cache_emit_changes(self, failedKeys, failedKeysCount);
+
+	/* Write snapshot of stored values */
+	if(g_hash_table_size(pendingWrites)>0) _xfconf_settings_backend_cache_schedule_snapshot(self);
+
+	g_rec_mutex_unlock(&self->lock);
+
+	_xfconf_settings_backend_debug("Flushed %u pending writes at channel '%s' with %u failures",
+									g_hash_table_size(pendingWrites),
+									self->channelName,
+									failedKeysCount);
+
+	/* Release allocated resources */
+	g_strfreev(failedKeys);
+	g_hash_table_destroy(pendingWrites);
+
+	return(roundTrips);
+}
+
+/* Scheduled flush of pending writes */
+static gboolean _xfconf_settings_backend_cache_on_flush_pending_writes(gpointer inUserData)
+{
+	XfconfSettingsBackendCache			*self=(XfconfSettingsBackendCache*)inUserData;
+
+	/* This source will be removed */
+	g_rec_mutex_lock(&self->lock);
+	self->pendingWritesSourceID=0;
+	g_rec_mutex_unlock(&self->lock);
+
+	/* Flush pending writes */
+	_xfconf_settings_backend_cache_flush_pending_writes(self);
+
+	return(G_SOURCE_REMOVE);
+}
+
+/* Queue a write of a property which will be stored in xfconf later. The cache
+ * is updated at once so this process reads its own writes. An unset value
+ * resets the property.
+ */
+static void _xfconf_settings_backend_cache_queue_write(XfconfSettingsBackendCache *self,
+														const gchar *inKey,
+														const GValue *inValue,
+														GVariant *inVariant)
+{
+	XfconfSettingsBackendPendingWrite	*pendingWrite;
+	XfconfSettingsBackendCacheEntry		*entry;
+
+	g_rec_mutex_lock(&self->lock);
+
+	_xfconf_settings_backend_cache_invalidate_snapshot(self);
+
+	/* Replace value of a pending write to this key or remember the current
+	 * value of property to roll back to if storing it in xfconf fails.
+	 */
+	pendingWrite=(XfconfSettingsBackendPendingWrite*)g_hash_table_lookup(self->pendingWrites, inKey);
+	if(pendingWrite)
+	{
+		if(G_IS_VALUE(&pendingWrite->value)) g_value_unset(&pendingWrite->value);
+	}
+		else
+		{
+			pendingWrite=g_new0(XfconfSettingsBackendPendingWrite, 1);
+
+			entry=(XfconfSettingsBackendCacheEntry*)g_hash_table_lookup(self->entries, inKey);
+			if(entry)
+			{
+				_xfconf_settings_backend_copy_value(&entry->value, &pendingWrite->previousValue);
+				if(entry->variant) pendingWrite->previousVariant=g_variant_ref(entry->variant);
+			}
+
+			g_hash_table_insert(self->pendingWrites, g_strdup(inKey), pendingWrite);
+		}
+
+	if(inValue && G_IS_VALUE(inValue)) _xfconf_settings_backend_copy_value(inValue, &pendingWrite->value);
+
+	/* Update cache */
+	if(inValue && G_IS_VALUE(inValue)) _xfconf_settings_backend_cache_store(self, inKey, inValue, inVariant);
+		else _xfconf_settings_backend_cache_remove(self, inKey);
+
+	/* Schedule flush */
+	if(!self->pendingWritesSourceID)
+	{
+		self->pendingWritesSourceID=g_timeout_add(XFCONF_SETTINGS_WRITE_BEHIND_INTERVAL,
+													_xfconf_settings_backend_cache_on_flush_pending_writes,
+													self);
+	}
+
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Store a value in xfconf or queue it if write-behind is enabled. The number
+ * of requests made to xfconf is added to the round-trip counter.
+ */
+static gboolean _xfconf_settings_backend_cache_write(XfconfSettingsBackendCache *self,
+														const gchar *inKey,
+														const GValue *inValue,
+														GVariant *inVariant,
+														guint *ioRoundTrips)
+{
+	gboolean							success;
+
+	/* If write-behind is enabled queue value to store it later ... */
+	if(self->writeBehind)
+	{
+		_xfconf_settings_backend_cache_queue_write(self, inKey, inValue, inVariant);
+		return(TRUE);
+	}
+
+	/* ... otherwise store value in xfconf now. The backend emits the change
+	 * itself so the notification of xfconf about this change must be ignored.
+	 */
+	g_rec_mutex_lock(&self->lock);
+	_xfconf_settings_backend_cache_invalidate_snapshot(self);
+	g_rec_mutex_unlock(&self->lock);
+
+	_xfconf_settings_backend_cache_begin_echo(self, inKey, inValue);
+	success=_xfconf_settings_backend_cache_engine_set(self, inKey, inValue);
+	(*ioRoundTrips)++;
+
+	/* Remember written value and its variant in cache */
+	if(success)
+	{
+		_xfconf_settings_backend_cache_store(self, inKey, inValue, inVariant);
+
+		g_rec_mutex_lock(&self->lock);
+		_xfconf_settings_backend_cache_schedule_snapshot(self);
+		g_rec_mutex_unlock(&self->lock);
+	}
+	_xfconf_settings_backend_cache_end_echo(self, inKey);
+
+	return(success);
+}
+
+/* Reset a property in xfconf or queue it if write-behind is enabled. Returns
+ * FALSE if the property is known not to exist. The number of requests made
+ * to xfconf is added to the round-trip counter.
+ */
+static gboolean _xfconf_settings_backend_cache_reset(XfconfSettingsBackendCache *self,
+														const gchar *inKey,
+														guint *ioRoundTrips)
+{
+	/* Existence is taken from cache without asking xfconf. If cache does not
+	 * know yet, the key is assumed to exist as resetting a non-existing key
+	 * does no harm and emitting a change for it just causes listeners to read
+	 * the default value.
+	 */
+	if(!_xfconf_settings_backend_cache_may_contain(self, inKey)) return(FALSE);
+
+	/* If write-behind is enabled queue reset to perform it later ... */
+	if(self->writeBehind)
+	{
+		_xfconf_settings_backend_cache_queue_write(self, inKey, NULL, NULL);
+	}
+		/* ... otherwise reset value in xfconf now and ignore the notification
+		 * of xfconf about it.
+		 */
+		else
+		{
+			g_rec_mutex_lock(&self->lock);
+			_xfconf_settings_backend_cache_invalidate_snapshot(self);
+			g_rec_mutex_unlock(&self->lock);
+
+			_xfconf_settings_backend_cache_begin_echo(self, inKey, NULL);
+			self->engine->reset(self->store, inKey, TRUE);
+			(*ioRoundTrips)++;
+
+			/* Forget value in cache */
+			_xfconf_settings_backend_cache_remove(self, inKey);
+			_xfconf_settings_backend_cache_end_echo(self, inKey);
+
+			g_rec_mutex_lock(&self->lock);
+			_xfconf_settings_backend_cache_schedule_snapshot(self);
+			g_rec_mutex_unlock(&self->lock);
+		}
+
+	return(TRUE);
+}
+
+/* Reset all properties below a path ending with a slash by one recursive
+ * request to xfconf if the keys given are all properties existing below this
+ * path. Returns FALSE if this is not known for sure or if write-behind is
+ * enabled, so the keys must be reset one by one. The number of requests made
+ * to xfconf is added to the round-trip counter.
+ */
+static gboolean _xfconf_settings_backend_cache_reset_path(XfconfSettingsBackendCache *self,
+															const gchar *inPath,
+															const gchar **inKeys,
+															guint inKeysCount,
+															guint *ioRoundTrips)
+{
+	GHashTable							*keys;
+	GHashTableIter						iter;
+	gpointer							key;
+	gchar								*property;
+	gboolean							isCovered;
+	guint								i;
+
+	/* Write-behind queues resets which do not cost any request now. Also the
+	 * root path is no property which can be reset.
+	 */
+	if(self->writeBehind || strcmp(inPath, "/")==0) return(FALSE);
+
+	property=g_strndup(inPath, strlen(inPath)-1);
+
+	g_rec_mutex_lock(&self->lock);
+
+	/* Only if path was loaded all properties below it are known. The property
+	 * named like the path would be reset as well.
+	 */
+	isCovered=(_xfconf_settings_backend_cache_is_loaded(self, inPath) &&
+				!g_hash_table_contains(self->entries, property));
+	if(isCovered)
+	{
+		keys=g_hash_table_new(g_str_hash, g_str_equal);
+		for(i=0; i<inKeysCount; i++) g_hash_table_add(keys, (gpointer)inKeys[i]);
+
+		g_hash_table_iter_init(&iter, self->entries);
+		while(isCovered && g_hash_table_iter_next(&iter, &key, NULL))
+		{
+			if(g_str_has_prefix((const gchar*)key, inPath) &&
+				!g_hash_table_contains(keys, key))
+			{
+				isCovered=FALSE;
+			}
+		}
+
+		g_hash_table_destroy(keys);
+	}
+
+	if(!isCovered)
+	{
+		g_rec_mutex_unlock(&self->lock);
+		g_free(property);
+		return(FALSE);
+	}
+
+	_xfconf_settings_backend_cache_invalidate_snapshot(self);
+
+	/* Reset the whole path and ignore the notifications of xfconf about it */
+	for(i=0; i<inKeysCount; i++) _xfconf_settings_backend_cache_begin_echo(self, inKeys[i], NULL);
+
+	self->engine->reset(self->store, property, TRUE);
+	(*ioRoundTrips)++;
+
+	/* Forget values in cache */
+	for(i=0; i<inKeysCount; i++)
+	{
+		_xfconf_settings_backend_cache_remove(self, inKeys[i]);
+		_xfconf_settings_backend_cache_end_echo(self, inKeys[i]);
+	}
+
+	_xfconf_settings_backend_cache_schedule_snapshot(self);
+
+	g_rec_mutex_unlock(&self->lock);
+
+	_xfconf_settings_backend_debug("Reset %u keys below path '%s' at channel '%s' at once",
+									inKeysCount,
+									inPath,
+									self->channelName);
+
+	/* Release allocated resources */
+	g_free(property);
+
+	return(TRUE);
+}
+
+/* Rewrite values stored in another format than the requested one */
+static gboolean _xfconf_settings_backend_cache_on_rewrite_values(gpointer inUserData)
+{
+	XfconfSettingsBackendCache			*self=(XfconfSettingsBackendCache*)inUserData;
+	GHashTableIter						iter;
+	gpointer							key;
+	XfconfSettingsBackendCacheEntry		*entry;
+	GVariant							*variant;
+	GValue								value=G_VALUE_INIT;
+	guint								roundTrips;
+
+	g_rec_mutex_lock(&self->lock);
+
+	/* This source will be removed */
+	self->pendingRewritesSourceID=0;
+
+	/* Rewrite value of each key by its decoded variant */
+	roundTrips=0;
+	g_hash_table_iter_init(&iter, self->pendingRewrites);
+	while(g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		entry=(XfconfSettingsBackendCacheEntry*)g_hash_table_lookup(self->entries, key);
+		if(entry && entry->variant)
+		{
+			variant=g_variant_ref(entry->variant);
+			if(_xfconf_settings_backend_value_from_variant((const gchar*)key, variant, self->storage, &value))
+			{
+				_xfconf_settings_backend_cache_write(self, (const gchar*)key, &value, variant, &roundTrips);
+				g_value_unset(&value);
+			}
+			g_variant_unref(variant);
+		}
+
+		g_hash_table_iter_remove(&iter);
+	}
+
+	g_rec_mutex_unlock(&self->lock);
+
+	_xfconf_settings_backend_debug("Rewrote values at channel '%s' in requested storage format with %u requests",
+									self->channelName,
+									roundTrips);
+
+	return(G_SOURCE_REMOVE);
+}
+
+/* Add backend to list of backends to notify about changes */
+static void _xfconf_settings_backend_cache_add_backend(XfconfSettingsBackendCache *self,
+														XfconfSettingsBackend *inBackend)
+{
+	g_rec_mutex_lock(&self->lock);
+	self->backends=g_list_prepend(self->backends, inBackend);
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Remove backend from list of backends to notify about changes */
+static void _xfconf_settings_backend_cache_remove_backend(XfconfSettingsBackendCache *self,
+															XfconfSettingsBackend *inBackend)
+{
+	g_rec_mutex_lock(&self->lock);
+	self->backends=g_list_remove(self->backends, inBackend);
+	g_rec_mutex_unlock(&self->lock);
+}
+
+/* Get cache for channel of an engine and take a reference on it */
+static XfconfSettingsBackendCache* _xfconf_settings_backend_cache_ref_for_channel(const XfconfSettingsBackendEngine *inEngine,
+																					const gchar *inChannelName)
+{
+	XfconfSettingsBackendCache			*cache;
+	gchar								*cacheKey;
+
+	g_return_val_if_fail(inEngine, NULL);
+	g_return_val_if_fail(inChannelName && *inChannelName, NULL);
+
+	G_LOCK(_xfconf_settings_backend_caches);
+
+	/* Create cache for channel if it does not exist yet */
+	if(!_xfconf_settings_backend_caches)
+	{
+		_xfconf_settings_backend_caches=g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	/* Backends falling back to another engine must not share caches of
+	 * the same channel with backends using the configured engine.
+	 */
+	cacheKey=g_strconcat(inEngine->name, ":", inChannelName, NULL);
+
+	cache=(XfconfSettingsBackendCache*)g_hash_table_lookup(_xfconf_settings_backend_caches, cacheKey);
+	if(!cache)
+	{
+		cache=g_new0(XfconfSettingsBackendCache, 1);
+		cache->refCount=0;
+		cache->channelName=g_strdup(inChannelName);
+		cache->cacheKey=cacheKey;
+		cache->engine=inEngine;
+		cache->store=NULL;
+		g_rec_mutex_init(&cache->lock);
+		cache->isSeeded=FALSE;
+		cache->loadedPaths=NULL;
+		cache->entries=g_hash_table_new_full(g_str_hash,
+												g_str_equal,
+												(GDestroyNotify)g_free,
+												_xfconf_settings_backend_cache_entry_free);
+		cache->backends=NULL;
+		cache->echoes=g_hash_table_new_full(g_str_hash,
+											g_str_equal,
+											(GDestroyNotify)g_free,
+											_xfconf_settings_backend_free_value);
+		cache->pendingChanges=g_hash_table_new_full(g_str_hash,
+													g_str_equal,
+													(GDestroyNotify)g_free,
+													NULL);
+		cache->pendingChangesSourceID=0;
+		cache->writeBehind=_xfconf_settings_backend_is_option_enabled(XFCONF_SETTINGS_ENV_WRITE_BEHIND);
+		cache->pendingWrites=g_hash_table_new_full(g_str_hash,
+													g_str_equal,
+													(GDestroyNotify)g_free,
+													_xfconf_settings_backend_pending_write_free);
+		cache->pendingWritesSourceID=0;
+		cache->storage=_xfconf_settings_backend_get_storage_option();
+		cache->pendingRewrites=g_hash_table_new_full(g_str_hash,
+														g_str_equal,
+														(GDestroyNotify)g_free,
+														NULL);
+		cache->pendingRewritesSourceID=0;
+		cache->snapshotPath=NULL;
+		cache->snapshot=NULL;
+		cache->snapshotBase=NULL;
+		cache->snapshotChangedKeys=NULL;
+		cache->snapshotGeneration=0;
+		cache->snapshotInvalidated=FALSE;
+		cache->snapshotSourceID=0;
+		cache->lockStates=g_hash_table_new_full(g_str_hash,
+												g_str_equal,
+												(GDestroyNotify)g_free,
+												NULL);
+		cache->permissions=g_hash_table_new_full(g_str_hash,
+													g_str_equal,
+													(GDestroyNotify)g_free,
+													(GDestroyNotify)g_object_unref);
+		cache->lockStatesGeneration=g_atomic_int_get(&_xfconf_settings_backend_lock_states_generation);
+
+		cache->store=cache->engine->open(inChannelName,
+											_xfconf_settings_backend_cache_on_property_changed,
+											cache);
+
+		/* Map snapshot of channel if enabled and the engine saves channels to files */
+		if(_xfconf_settings_backend_is_option_enabled(XFCONF_SETTINGS_ENV_SNAPSHOT))
+		{
+			gchar						*channelFile;
+			gint64						sourceTime;
+			guint64						sourceSize;
+
+			channelFile=cache->engine->get_channel_file(inChannelName);
+			if(channelFile)
+			{
+				cache->snapshotPath=_xfconf_settings_backend_snapshot_get_path(inChannelName);
+
+				_xfconf_settings_backend_snapshot_get_source_state(cache->engine, inChannelName, &sourceTime, &sourceSize);
+				cache->snapshot=_xfconf_settings_backend_snapshot_open(cache->snapshotPath, sourceTime, sourceSize);
+				if(cache->snapshot)
+				{
+					cache->snapshotGeneration=cache->snapshot->generation;
+
+					/* Keep snapshot to merge it with the values loaded and
+					 * changed since when the next snapshot is written.
+					 */
+					cache->snapshotBase=_xfconf_settings_backend_snapshot_ref(cache->snapshot);
+					cache->snapshotChangedKeys=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+				}
+			}
+			g_free(channelFile);
+		}
+
+		g_hash_table_insert(_xfconf_settings_backend_caches, cache->cacheKey, cache);
+	}
+		else g_free(cacheKey);
+
+	/* Take reference */
+	cache->refCount++;
+
+	G_UNLOCK(_xfconf_settings_backend_caches);
+
+	return(cache);
+}
+
+/* Release a reference on cache and destroy it if it was the last one */
+static void _xfconf_settings_backend_cache_unref(XfconfSettingsBackendCache *self)
+{
+	g_return_if_fail(self);
+
+	G_LOCK(_xfconf_settings_backend_caches);
+
+	/* Release reference and return if cache is still in use */
+	self->refCount--;
+	if(self->refCount>0)
+	{
+		G_UNLOCK(_xfconf_settings_backend_caches);
+		return;
+	}
+
+	g_hash_table_remove(_xfconf_settings_backend_caches, self->cacheKey);
+
+	G_UNLOCK(_xfconf_settings_backend_caches);
+
+	/* Store all pending writes before cache is gone */
+	_xfconf_settings_backend_cache_flush_pending_writes(self);
+
+	/* Release allocated resources */
+	if(self->store)
+	{
+		self->engine->close(self->store);
+		self->store=NULL;
+	}
+
+	if(self->pendingChangesSourceID)
+	{
+		g_source_remove(self->pendingChangesSourceID);
+		self->pendingChangesSourceID=0;
+	}
+
+	if(self->pendingRewritesSourceID)
+	{
+		g_source_remove(self->pendingRewritesSourceID);
+		self->pendingRewritesSourceID=0;
+	}
+
+	if(self->snapshotSourceID)
+	{
+		g_source_remove(self->snapshotSourceID);
+		self->snapshotSourceID=0;
+	}
+
+	if(self->snapshot)
+	{
+		_xfconf_settings_backend_snapshot_unref(self->snapshot);
+		self->snapshot=NULL;
+	}
+
+	if(self->snapshotBase)
+	{
+		_xfconf_settings_backend_snapshot_unref(self->snapshotBase);
+		self->snapshotBase=NULL;
+	}
+
+	if(self->snapshotChangedKeys)
+	{
+		g_hash_table_destroy(self->snapshotChangedKeys);
+		self->snapshotChangedKeys=NULL;
+	}
+
+	if(self->entries)
+	{
+		g_hash_table_destroy(self->entries);
+		self->entries=NULL;
+	}
+
+	if(self->echoes)
+	{
+		g_hash_table_destroy(self->echoes);
+		self->echoes=NULL;
+	}
+
+	if(self->pendingChanges)
+	{
+		g_hash_table_destroy(self->pendingChanges);
+		self->pendingChanges=NULL;
+	}
+
+	if(self->pendingWrites)
+	{
+		g_hash_table_destroy(self->pendingWrites);
+		self->pendingWrites=NULL;
+	}
+
+	if(self->pendingRewrites)
+	{
+		g_hash_table_destroy(self->pendingRewrites);
+		self->pendingRewrites=NULL;
+	}
+
+	if(self->lockStates)
+	{
+		g_hash_table_destroy(self->lockStates);
+		self->lockStates=NULL;
+	}
+
+	if(self->permissions)
+	{
+		g_hash_table_destroy(self->permissions);
+		self->permissions=NULL;
+	}
+
+	if(self->backends)
+	{
+		g_list_free(self->backends);
+		self->backends=NULL;
+	}
+
+	g_rec_mutex_clear(&self->lock);
+	if(self->loadedPaths) _xfconf_settings_backend_watch_free(self->loadedPaths);
+	g_free(self->snapshotPath);
+	g_free(self->cacheKey);
+	g_free(self->channelName);
+	g_free(self);
+}
+
+/* Update lock states and permissions of all caches if lock states may have
+ * changed, as the owners of permissions handed out will not ask again.
+ */
+static void _xfconf_settings_backend_cache_refresh_all_lock_states(void)
+{
+	GHashTableIter						iter;
+	gpointer							value;
+	GSList								*caches;
+	GSList								*iterCaches;
+	XfconfSettingsBackendCache			*cache;
+	guint								roundTrips;
+
+	/* Take a reference on each cache so they can be refreshed without
+	 * holding the lock of the list of caches.
+	 */
+	caches=NULL;
+
+	G_LOCK(_xfconf_settings_backend_caches);
+	if(_xfconf_settings_backend_caches)
+	{
+		g_hash_table_iter_init(&iter, _xfconf_settings_backend_caches);
+		while(g_hash_table_iter_next(&iter, NULL, &value))
+		{
+			cache=(XfconfSettingsBackendCache*)value;
+			cache->refCount++;
+			caches=g_slist_prepend(caches, cache);
+		}
+	}
+	G_UNLOCK(_xfconf_settings_backend_caches);
+
+	for(iterCaches=caches; iterCaches; iterCaches=g_slist_next(iterCaches))
+	{
+		cache=(XfconfSettingsBackendCache*)iterCaches->data;
+
+		roundTrips=0;
+		g_rec_mutex_lock(&cache->lock);
+		_xfconf_settings_backend_cache_check_lock_states(cache, &roundTrips);
+		g_rec_mutex_unlock(&cache->lock);
+
+		_xfconf_settings_backend_cache_unref(cache);
+	}
+
+	g_slist_free(caches);
+}
+
+/* Get name of channel storing a key, or the keys below a path if it ends with
+ * a slash, by sharding policy of backend. Only path components are used but
+ * not the name of the key. Returns NULL if the key is stored in the unsharded
+ * channel. The number of path components used is stored in outComponents.
+ */
+static gchar* _xfconf_settings_backend_get_shard_name(XfconfSettingsBackend *self,
+														const gchar *inKey,
+														guint *outComponents)
+{
+	GString								*name;
+	guint								maxComponents;
+	guint								components;
+	gsize								length;
+	gsize								i;
+
+	if(outComponents) *outComponents=0;
+	if(self->sharding==XFCONF_SETTINGS_BACKEND_SHARDING_NONE) return(NULL);
+
+	maxComponents=(self->sharding==XFCONF_SETTINGS_BACKEND_SHARDING_DEPTH ? self->shardingDepth : G_MAXUINT);
+
+	/* Append path components to base channel name. Characters not allowed
+	 * in channel names are replaced.
+	 */
+	name=g_string_new(XFCONF_SETTINGS_CHANNEL);
+	components=0;
+	while(components<maxComponents)
+	{
+		while(*inKey=='/') inKey++;
+		length=strcspn(inKey, "/");
+		if(length==0 || inKey[length]!='/') break;
+
+		g_string_append_c(name, components==0 ? '-' : '.');
+		for(i=0; i<length; i++)
+		{
+			if(g_ascii_isalnum(inKey[i]) || inKey[i]=='-' || inKey[i]=='_') g_string_append_c(name, inKey[i]);
+				else g_string_append_c(name, '_');
+		}
+
+		components++;
+		inKey+=length;
+	}
+
+	if(outComponents) *outComponents=components;
+
+	/* Keys at top-level are stored in unsharded channel */
+	if(components==0)
+	{
+		g_string_free(name, TRUE);
+		return(NULL);
+	}
+
+	return(g_string_free(name, FALSE));
+}
+
+/* Get cache of a shard and open it if it is not in use by this backend yet */
+static XfconfSettingsBackendCache* _xfconf_settings_backend_open_shard(XfconfSettingsBackend *self,
+																		const gchar *inChannelName)
+{
+	XfconfSettingsBackendCache			*cache;
+
+	g_mutex_lock(&self->shardsLock);
+
+	cache=(XfconfSettingsBackendCache*)g_hash_table_lookup(self->shards, inChannelName);
+	if(!cache)
+	{
+		cache=_xfconf_settings_backend_cache_ref_for_channel(self->engine, inChannelName);
+		_xfconf_settings_backend_cache_add_backend(cache, self);
+		g_hash_table_insert(self->shards, g_strdup(inChannelName), cache);
+
+		_xfconf_settings_backend_debug("Opened shard at channel '%s'", inChannelName);
+	}
+
+	g_mutex_unlock(&self->shardsLock);
+
+	return(cache);
+}
+
+/* Get cache of channel storing a key */
+static XfconfSettingsBackendCache* _xfconf_settings_backend_get_cache(XfconfSettingsBackend *self,
+																		const gchar *inKey)
+{
+	XfconfSettingsBackendCache			*cache;
+	gchar								*shardName;
+
+	shardName=_xfconf_settings_backend_get_shard_name(self, inKey, NULL);
+	if(!shardName) return(self->cache);
+
+	cache=_xfconf_settings_backend_open_shard(self, shardName);
+	g_free(shardName);
+
+	return(cache);
+}
+
+/* Select and initialize engine when a backend is created. Processes which
+ * only load this module but use another backend never connect to xfconf.
+ * The engine is only kept once it was initialized successfully. Until then
+ * each new backend tries again and falls back to keep its values in memory.
+ */
+static const XfconfSettingsBackendEngine* _xfconf_settings_backend_ensure_engine(void)
+{
+	const XfconfSettingsBackendEngine	*engine;
+
+	G_LOCK(_xfconf_settings_backend_engine);
+
+	if(!_xfconf_settings_backend_engine)
+	{
+		engine=_xfconf_settings_backend_get_engine_option();
+		if(engine->init())
+		{
+			_xfconf_settings_backend_engine=engine;
+			_xfconf_settings_backend_engine_initialized=TRUE;
+
+			_xfconf_settings_backend_debug("Initialized engine '%s'", engine->name);
+		}
+			else
+			{
+				g_critical("Could not initialize engine '%s' - keeping values of backend in memory only",
+							engine->name);
+
+				engine=&_xfconf_settings_backend_engines[XFCONF_SETTINGS_ENGINE_FALLBACK];
+				if(!_xfconf_settings_backend_engine_fallback_initialized)
+				{
+					_xfconf_settings_backend_engine_fallback_initialized=engine->init();
+				}
+			}
+	}
+		else engine=_xfconf_settings_backend_engine;
+
+	G_UNLOCK(_xfconf_settings_backend_engine);
+
+	return(engine);
+}
+
+/* Count requests made to xfconf by a virtual function */
+static void _xfconf_settings_backend_add_round_trips(XfconfSettingsBackend *self,
+														XfconfSettingsBackendVFunc inVFunc,
+														guint inRoundTrips)
+{
+	g_return_if_fail(inVFunc<XFCONF_SETTINGS_BACKEND_VFUNC_LAST);
+
+	if(inRoundTrips>0) g_atomic_int_add(&self->roundTrips[inVFunc], inRoundTrips);
+}
+
+/* Store a value in xfconf */
+static gboolean _xfconf_settings_backend_write_internal(XfconfSettingsBackend *self,
+														const gchar *inKey,
+														GVariant *inValue,
+														gpointer inOriginTag,
+														XfconfSettingsBackendVFunc inVFunc)
+{
+	XfconfSettingsBackendCache				*cache;
+	GValue									xfconfValue=G_VALUE_INIT;
+	gboolean								success;
+	guint									roundTrips;
+
+	/* Get channel to store key at */
+	cache=_xfconf_settings_backend_get_cache(self, inKey);
+
+	/* Convert variant to a value xfconf can store */
+	if(!_xfconf_settings_backend_value_from_variant(inKey, inValue, cache->storage, &xfconfValue)) return(FALSE);
+
+	/* Store value in xfconf */
+	roundTrips=0;
+	success=_xfconf_settings_backend_cache_write(cache, inKey, &xfconfValue, inValue, &roundTrips);
+	_xfconf_settings_backend_add_round_trips(self, inVFunc, roundTrips);
+
+	/* Release allocated resources */
+	g_value_unset(&xfconfValue);
+
+	/* Return success result */
+	_xfconf_settings_backend_debug("Wrote key '%s' %s",
+									inKey,
+									success ? "successfully" : "unsuccessfully");
+	return(success);
+}
+
+/* Reset a value in xfconf */
+static gboolean _xfconf_settings_backend_reset_internal(XfconfSettingsBackend *self,
+														const gchar *inKey,
+														gpointer inOriginTag,
+														XfconfSettingsBackendVFunc inVFunc)
+{
+	XfconfSettingsBackendCache				*cache;
+	gboolean								success;
+	guint									roundTrips;
 
-		/* Release allocated resources */
-		_xfconf_settings_backend_free_variant_struct(&variantStruct);
-#else
-		GValue								xfconfValue=G_VALUE_INIT;
-		GError								*error;
+	/* Reset value at channel storing the key. If it is a shard and keys are
+	 * read from unsharded channel as fallback, reset it also there as it would
+	 * be read from there otherwise.
+	 */
+	cache=_xfconf_settings_backend_get_cache(self, inKey);
 
-		error=NULL;
+	roundTrips=0;
+	success=_xfconf_settings_backend_cache_reset(cache, inKey, &roundTrips);
+	if(cache!=self->cache &&
+		self->shardingLegacy &&
+		_xfconf_settings_backend_cache_reset(self->cache, inKey, &roundTrips))
+	{
+		success=TRUE;
+	}
 
-		/* Get stored value of property */
-		if(!xfconf_channel_get_property(self->channel, inKey, &xfconfValue))
-		{
-			g_critical("Failed to get value for key '%s'", inKey);
+	_xfconf_settings_backend_add_round_trips(self, inVFunc, roundTrips);
 
-			/* Release allocated resources */
-			if(G_IS_VALUE(&xfconfValue)) g_value_unset(&xfconfValue);
+	/* Return success result */
+	if(!success)
+	{
+		_xfconf_settings_backend_debug("Cannot reset non-existing key '%s'", inKey);
+	}
 
-			return(NULL);
-		}
+	return(success);
+}
 
-		/* Property value must be a string */
-		if(!G_VALUE_HOLDS_STRING(&xfconfValue))
-		{
-			g_critical("Failed to parse variant for key '%s': %s",
-						inKey,
-						"Value is not a string");
+/* Reset all keys below a path at once if they are all keys existing below it.
+ * Returns FALSE if the keys must be reset one by one.
+ */
+static gboolean _xfconf_settings_backend_reset_path_internal(XfconfSettingsBackend *self,
+																const gchar *inPath,
+																const gchar **inKeys,
+																guint inKeysCount,
+																XfconfSettingsBackendVFunc inVFunc)
+{
+	XfconfSettingsBackendCache				*cache;
+	guint									roundTrips;
+	guint									i;
 
-			/* Release allocated resources */
-			g_value_unset(&xfconfValue);
+	/* Reset path at channel storing the keys. If it is a shard and keys are
+	 * read from unsharded channel as fallback, reset the keys also there as
+	 * they would be read from there otherwise.
+	 */
+	cache=_xfconf_settings_backend_get_cache(self, inPath);
 
-			return(NULL);
-		}
+	roundTrips=0;
+	if(!_xfconf_settings_backend_cache_reset_path(cache, inPath, inKeys, inKeysCount, &roundTrips)) return(FALSE);
 
-		/* Create variant from string representation for expected type */
-		value=g_variant_parse(inExpectedType,
-								g_value_get_string(&xfconfValue),
-								NULL,
-								NULL,
-								&error);
-		if(!value || error)
-		{
-			g_critical("Failed to parse variant for key '%s' from '%s': %s",
-						inKey,
-						g_value_get_string(&xfconfValue),
-						error ? error->message : "Unknown error");
+	if(cache!=self->cache &&
+		self->shardingLegacy &&
+		!_xfconf_settings_backend_cache_reset_path(self->cache, inPath, inKeys, inKeysCount, &roundTrips))
+	{
+		for(i=0; i<inKeysCount; i++) _xfconf_settings_backend_cache_reset(self->cache, inKeys[i], &roundTrips);
+	}
 
-			/* Release allocated resources */
-			g_value_unset(&xfconfValue);
-			if(value) g_variant_unref(value);
-			if(error) g_error_free(error);
+	_xfconf_settings_backend_add_round_trips(self, inVFunc, roundTrips);
 
-			return(NULL);
-		}
+	return(TRUE);
+}
 
-		/* Release allocated resources */
-		g_value_unset(&xfconfValue);
-#endif
-	}
-		/* ... otherwise check for array ... */
-		else if(valueType.type==G_TYPE_ARRAY && valueType.subType!=G_TYPE_INVALID)
-		{
-			GPtrArray						*array;
-			gsize							arraySize;
-			GVariant						**elements;
-			gsize							i;
 
-			/* Get array from xfconf */
-			array=xfconf_channel_get_arrayv(self->channel, inKey);
-			if(array)
-			{
-				/* Get size of array */
-				arraySize=array->len;
+/* IMPLEMENTATION: GSettingsBackend */
 
-				/* Set up array for storing GVariants */
-				elements=g_new0(GVariant*, arraySize);
-				for(i=0; i<arraySize; i++)
-				{
-					elements[i]=g_dbus_gvalue_to_gvariant((GValue*)g_ptr_array_index(array, i), valueType.variantSubtype);
-				}
+/* Read a value from xfconf */
+static GVariant* _xfconf_settings_backend_read(GSettingsBackend *inBackend,
+												const gchar *inKey,
+												const GVariantType *inExpectedType,
+												gboolean inDefaultValue)
+{
+	XfconfSettingsBackend					*self=(XfconfSettingsBackend*)inBackend;
+	XfconfSettingsBackendCache				*cache;
+	GVariant								*value;
+	guint									roundTrips;
+	XfconfSettingsBackendTrace				trace;
 
-				/* Get final GVariant array */
-				value=g_variant_new_array(valueType.variantSubtype, elements, arraySize);
+	/* If default value is requested return NULL */
+	if(inDefaultValue) return(NULL);
 
-				/* Release allocated resources */
-				xfconf_array_free(array);
-			}
-		}
-		/* ... otherwise it can be simply converted */
-		else
-		{
-			GValue							xfconfValue=G_VALUE_INIT;
+	_xfconf_settings_backend_trace_begin(self, XFCONF_SETTINGS_BACKEND_VFUNC_READ, &trace);
 
-			/* Get stored value of property */
-			if(!xfconf_channel_get_property(self->channel, inKey, &xfconfValue))
-			{
-				g_critical("Failed to get value for key '%s'", inKey);
+	/* Get value from cache which does not need any request to xfconf once its path is loaded */
+	cache=_xfconf_settings_backend_get_cache(self, inKey);
 
-				/* Release allocated resources */
-				if(G_IS_VALUE(&xfconfValue)) g_value_unset(&xfconfValue);
+	roundTrips=0;
+	value=_xfconf_settings_backend_cache_lookup(cache, inKey, inExpectedType, &roundTrips);
 
-				return(NULL);
-			}
+	/* Fall back to unsharded channel for keys stored before sharding was enabled
+	 * if requested. Its path is loaded once so only the first miss costs a request.
+	 */
+	if(!value && cache!=self->cache && self->shardingLegacy)
+	{
+		value=_xfconf_settings_backend_cache_lookup(self->cache, inKey, inExpectedType, &roundTrips);
+	}
 
-			/* Convert property value to variant */
-			value=g_dbus_gvalue_to_gvariant(&xfconfValue, inExpectedType);
+	_xfconf_settings_backend_add_round_trips(self, XFCONF_SETTINGS_BACKEND_VFUNC_READ, roundTrips);
 
-			/* Release allocated resources */
-			g_value_unset(&xfconfValue);
-		}
+	_xfconf_settings_backend_trace_end(self, XFCONF_SETTINGS_BACKEND_VFUNC_READ, &trace, inKey, value!=NULL);
 
 	/* Return variant created from property value */
 	_xfconf_settings_backend_debug("Read key '%s' %s",
@@ -644,7 +4507,11 @@ static gboolean _xfconf_settings_backend_write(GSettingsBackend *inBackend,
 												GVariant *inValue,
 												gpointer inOriginTag)
 {
-	gboolean		success;
+	XfconfSettingsBackend		*self=(XfconfSettingsBackend*)inBackend;
+	gboolean					success;
+	XfconfSettingsBackendTrace	trace;
+
+	_xfconf_settings_backend_trace_begin(self, XFCONF_SETTINGS_BACKEND_VFUNC_WRITE, &trace);
 
 	/* Write value to xfconf */
 	if(inValue)
@@ -652,93 +4519,57 @@ static gboolean _xfconf_settings_backend_write(GSettingsBackend *inBackend,
 		success=_xfconf_settings_backend_write_internal(XFCONF_SETTINGS_BACKEND(inBackend),
 														inKey,
 														inValue,
-														inOriginTag);
+														inOriginTag,
+														XFCONF_SETTINGS_BACKEND_VFUNC_WRITE);
 	}
 		else
 		{
 			success=_xfconf_settings_backend_reset_internal(XFCONF_SETTINGS_BACKEND(inBackend),
 															inKey,
-															inOriginTag);
+															inOriginTag,
+															XFCONF_SETTINGS_BACKEND_VFUNC_WRITE);
 		}
 
 	/* Emit 'changed' signal if writing was successful */
 	if(success) g_settings_backend_changed(inBackend, inKey, inOriginTag);
 
+	_xfconf_settings_backend_trace_end(self, XFCONF_SETTINGS_BACKEND_VFUNC_WRITE, &trace, inKey, success);
+
 	/* Return success result */
 	return(success);
 }
 
-/* Store a set of values (tree) to xfconf */
-static gboolean _xfconf_settings_backend_write_tree_callback(gpointer inKey,
-																gpointer inValue,
-																gpointer inUserData)
+/* Collect keys and values of tree in order */
+static gboolean _xfconf_settings_backend_write_tree_collect(gpointer inKey,
+															gpointer inValue,
+															gpointer inUserData)
 {
-	XfconfSettingsBackendTreeWriteData		*data;
-	const gchar								*key;
-	GVariant								*variant;
-	gboolean								success;
-
-	/* Get callback data */
-	data=(XfconfSettingsBackendTreeWriteData*)inUserData;
-
-	/* Get key and value to write */
-	key=(const gchar*)inKey;
-	variant=(GVariant*)inValue;
-
-	/* Write value to xfconf and store writing success result in callback data
-	 * if a variant is given for this key. If no variant is given (NULL pointer)
-	 * then a reset of the key is requested.
-	 */
-	if(variant)
-	{
-		success=_xfconf_settings_backend_write_internal(XFCONF_SETTINGS_BACKEND(data->backend),
-														key,
-														variant,
-														data->originTag);
-	}
-		else
-		{
-			success=_xfconf_settings_backend_reset_internal(XFCONF_SETTINGS_BACKEND(data->backend),
-															key,
-															data->originTag);
-		}
+	XfconfSettingsBackendTreeWriteData		*data=(XfconfSettingsBackendTreeWriteData*)inUserData;
 
-	/* If writing was successful remember the modified key */
-	if(success && data->writtenKeys)
-	{
-		g_hash_table_insert(data->writtenKeys, g_strdup(key), GINT_TO_POINTER(1));
-	}
+	g_ptr_array_add(data->keys, inKey);
+	g_ptr_array_add(data->values, inValue);
 
-	/* Return FALSE to continue tree traversal regardless if this write was
-	 * successful or not.
-	 */
+	/* Return FALSE to continue tree traversal */
 	return(FALSE);
 }
 
-static void _xfconf_settings_backend_write_tree_collect_modified_keys(gpointer inKey,
-																		gpointer inValue,
-																		gpointer inUserData)
-{
-	gchar										*key;
-	XfconfSettingsBackendTreeCollectKeysData	*data;
-
-	key=(gchar*)inKey;
-	data=(XfconfSettingsBackendTreeCollectKeysData*)inUserData;
-
-	/* Add key to string array */
-	data->keysList[data->index]=g_strdup(key);
-	data->index++;
-}
-
+/* Store a set of values (tree) to xfconf */
 static gboolean _xfconf_settings_backend_write_tree(GSettingsBackend *inBackend,
 													GTree *inTree,
 													gpointer inOriginTag)
 {
 	XfconfSettingsBackend						*self=(XfconfSettingsBackend*)inBackend;
-	XfconfSettingsBackendTreeWriteData			writeData;
+	XfconfSettingsBackendTreeWriteData			data;
 	gint										treeSize;
-	guint										modifiedKeysCount;
-	XfconfSettingsBackendTreeCollectKeysData	collectKeysData;
+	GPtrArray									*writtenKeys;
+	const gchar									*key;
+	GVariant									*variant;
+	gsize										pathLength;
+	gchar										*path;
+	gboolean									isPathReset;
+	guint										i;
+	guint										j;
+	XfconfSettingsBackendTrace					trace;
 
 	/* If tree is empty there is nothing to store and writing was successful */
 	treeSize=g_tree_nnodes(inTree);
@@ -748,51 +4579,108 @@ static gboolean _xfconf_settings_backend_write_tree(GSettingsBackend *inBackend,
 		return(TRUE);
 	}
 
-	/* Write each value to xfconf */
-	writeData.backend=self;
-	writeData.originTag=inOriginTag;
-	writeData.writtenKeys=g_hash_table_new_full(g_str_hash,
-												g_str_equal,
-												(GDestroyNotify)g_free,
-												NULL);
-	g_tree_foreach(inTree, _xfconf_settings_backend_write_tree_callback, &writeData);
+	_xfconf_settings_backend_trace_begin(self, XFCONF_SETTINGS_BACKEND_VFUNC_WRITE_TREE, &trace);
 
-	/* Emit 'path-changed' signal with all modified keys regardless if writing
-	 * all keys was successful or not.
+	/* Get keys and values sorted by key so keys of same path follow each other */
+	data.keys=g_ptr_array_sized_new(treeSize+1);
+	data.values=g_ptr_array_sized_new(treeSize);
+	g_tree_foreach(inTree, _xfconf_settings_backend_write_tree_collect, &data);
+
+	/* Write each value to xfconf and remember the modified keys. Keys are
+	 * unique in tree so each one is remembered once.
 	 */
-	modifiedKeysCount=g_hash_table_size(writeData.writtenKeys);
-	if(modifiedKeysCount>0)
+	writtenKeys=g_ptr_array_sized_new(treeSize+1);
+
+	i=0;
+	while(i<data.keys->len)
 	{
-		collectKeysData.keysList=(gchar**)g_new0(gchar*, modifiedKeysCount+1);
-		collectKeysData.index=0;
-		g_hash_table_foreach(writeData.writtenKeys,
-								_xfconf_settings_backend_write_tree_collect_modified_keys,
-								&collectKeysData);
+		key=(const gchar*)g_ptr_array_index(data.keys, i);
+		variant=(GVariant*)g_ptr_array_index(data.values, i);
+
+		/* If a variant is given for this key write it ... */
+		if(variant)
+		{
+			if(_xfconf_settings_backend_write_internal(self,
+														key,
+														variant,
+														inOriginTag,
+														XFCONF_SETTINGS_BACKEND_VFUNC_WRITE_TREE))
+			{
+				g_ptr_array_add(writtenKeys, (gpointer)key);
+			}
+
+			i++;
+			continue;
+		}
+
+		/* ... otherwise a reset of the key is requested (NULL pointer). Find
+		 * all resets of keys directly at the same path and reset them at
+		 * once if they are all keys below this path.
+		 */
+		pathLength=strrchr(key, '/')-key+1;
+		for(j=i+1; j<data.keys->len; j++)
+		{
+			const gchar							*nextKey;
+
+			nextKey=(const gchar*)g_ptr_array_index(data.keys, j);
+			if(g_ptr_array_index(data.values, j) ||
+				strncmp(nextKey, key, pathLength)!=0 ||
+				strchr(nextKey+pathLength, '/'))
+			{
+				break;
+			}
+		}
 
-		if(modifiedKeysCount==1)
+		isPathReset=FALSE;
+		if(j-i>1)
 		{
-			g_settings_backend_changed(inBackend,
-										*collectKeysData.keysList,
-										inOriginTag);
+			path=g_strndup(key, pathLength);
+			isPathReset=_xfconf_settings_backend_reset_path_internal(self,
+																		path,
+																		(const gchar**)&data.keys->pdata[i],
+																		j-i,
+																		XFCONF_SETTINGS_BACKEND_VFUNC_WRITE_TREE);
+			g_free(path);
 		}
-			else
+
+		for(; i<j; i++)
+		{
+			key=(const gchar*)g_ptr_array_index(data.keys, i);
+			if(isPathReset ||
+				_xfconf_settings_backend_reset_internal(self,
+														key,
+														inOriginTag,
+														XFCONF_SETTINGS_BACKEND_VFUNC_WRITE_TREE))
 			{
-				g_settings_backend_keys_changed(inBackend,
-												"/",
-												(const gchar **)collectKeysData.keysList,
-												inOriginTag);
+				g_ptr_array_add(writtenKeys, (gpointer)key);
 			}
+		}
+	}
 
-		g_strfreev(collectKeysData.keysList);
+	/* Emit changes of all modified keys relative to their common path
+	 * regardless if writing all keys was successful or not.
+	 */
+	if(writtenKeys->len>0)
+	{
+		g_ptr_array_add(writtenKeys, NULL);
+		_xfconf_settings_backend_emit_changes(inBackend,
+												(gchar**)writtenKeys->pdata,
+												writtenKeys->len-1,
+												inOriginTag);
 	}
 
-	/* Release allocated resources */
-	g_hash_table_unref(writeData.writtenKeys);
+	_xfconf_settings_backend_trace_end(self, XFCONF_SETTINGS_BACKEND_VFUNC_WRITE_TREE, &trace, NULL, TRUE);
 
 	/* Return success result */
-	_xfconf_settings_backend_debug("Wrote tree with %d nodes and modified %d keys",
+	_xfconf_settings_backend_debug("Wrote tree with %d nodes and modified %u keys",
 									treeSize,
-									modifiedKeysCount);
+									writtenKeys->len>0 ? writtenKeys->len-1 : 0);
+
+	/* Release allocated resources */
+	g_ptr_array_free(writtenKeys, TRUE);
+	g_ptr_array_free(data.keys, TRUE);
+	g_ptr_array_free(data.values, TRUE);
+
 	return(TRUE);
 }
 
@@ -803,12 +4691,17 @@ static void _xfconf_settings_backend_reset(GSettingsBackend *inBackend,
 {
 	XfconfSettingsBackend		*self=(XfconfSettingsBackend*)inBackend;
 	gboolean					success;
+	XfconfSettingsBackendTrace	trace;
+
+	_xfconf_settings_backend_trace_begin(self, XFCONF_SETTINGS_BACKEND_VFUNC_RESET, &trace);
 
 	/* Reset value in xfconf */
-	success=_xfconf_settings_backend_reset_internal(self, inKey, inOriginTag);
+	success=_xfconf_settings_backend_reset_internal(self, inKey, inOriginTag, XFCONF_SETTINGS_BACKEND_VFUNC_RESET);
 
 	/* Emit 'changed' signal if resetting was successful */
 	if(success) g_settings_backend_changed(inBackend, inKey, inOriginTag);
+
+	_xfconf_settings_backend_trace_end(self, XFCONF_SETTINGS_BACKEND_VFUNC_RESET, &trace, inKey, success);
 }
 
 /* Get writable state of a key at xfconf */
@@ -816,10 +4709,21 @@ static gboolean _xfconf_settings_backend_get_writable(GSettingsBackend *inBacken
 														const gchar *inKey)
 {
 	XfconfSettingsBackend		*self=(XfconfSettingsBackend*)inBackend;
+	XfconfSettingsBackendCache	*cache;
 	gboolean					isWritable;
+	guint						roundTrips;
+	XfconfSettingsBackendTrace	trace;
+
+	_xfconf_settings_backend_trace_begin(self, XFCONF_SETTINGS_BACKEND_VFUNC_GET_WRITABLE, &trace);
 
 	/* Determine if key is writable */
-	isWritable=!xfconf_channel_is_property_locked(self->channel, inKey);
+	cache=_xfconf_settings_backend_get_cache(self, inKey);
+
+	roundTrips=0;
+	isWritable=!_xfconf_settings_backend_cache_is_locked(cache, inKey, &roundTrips);
+	_xfconf_settings_backend_add_round_trips(self, XFCONF_SETTINGS_BACKEND_VFUNC_GET_WRITABLE, roundTrips);
+
+	_xfconf_settings_backend_trace_end(self, XFCONF_SETTINGS_BACKEND_VFUNC_GET_WRITABLE, &trace, inKey, isWritable);
 
 	/* Return result */
 	_xfconf_settings_backend_debug("Key '%s' is %s",
@@ -828,6 +4732,138 @@ static gboolean _xfconf_settings_backend_get_writable(GSettingsBackend *inBacken
 	return(isWritable);
 }
 
+/* Get permission to change keys below a path */
+static GPermission* _xfconf_settings_backend_get_permission(GSettingsBackend *inBackend,
+															const gchar *inPath)
+{
+	XfconfSettingsBackend		*self=(XfconfSettingsBackend*)inBackend;
+	XfconfSettingsBackendCache	*cache;
+	GPermission					*permission;
+	guint						roundTrips;
+	XfconfSettingsBackendTrace	trace;
+
+	_xfconf_settings_backend_trace_begin(self, XFCONF_SETTINGS_BACKEND_VFUNC_GET_PERMISSION, &trace);
+
+	/* Get shared permission of path from channel storing the keys below it */
+	cache=_xfconf_settings_backend_get_cache(self, inPath);
+
+	roundTrips=0;
+	permission=_xfconf_settings_backend_cache_get_permission(cache, inPath, &roundTrips);
+	_xfconf_settings_backend_add_round_trips(self, XFCONF_SETTINGS_BACKEND_VFUNC_GET_PERMISSION, roundTrips);
+
+	_xfconf_settings_backend_trace_end(self,
+										XFCONF_SETTINGS_BACKEND_VFUNC_GET_PERMISSION,
+										&trace,
+										inPath,
+										g_permission_get_allowed(permission));
+
+	/* Return permission */
+	_xfconf_settings_backend_debug("Path '%s' is %s",
+									inPath,
+									g_permission_get_allowed(permission) ? "writable" : "read-only");
+	return(permission);
+}
+
+/* Watch a path for changes made by other processes */
+static void _xfconf_settings_backend_subscribe(GSettingsBackend *inBackend,
+												const gchar *inPath)
+{
+	XfconfSettingsBackend		*self=(XfconfSettingsBackend*)inBackend;
+	XfconfSettingsBackendCache	*cache;
+	gchar						*shardName;
+	guint						components;
+	gchar						*prefix;
+	gchar						**channels;
+	gchar						**iter;
+
+	/* Add path to watched paths */
+	G_LOCK(_xfconf_settings_backend_watches);
+	if(!_xfconf_settings_backend_watches) _xfconf_settings_backend_watches=g_new0(XfconfSettingsBackendWatch, 1);
+	_xfconf_settings_backend_watch_add(_xfconf_settings_backend_watches, inPath);
+	G_UNLOCK(_xfconf_settings_backend_watches);
+
+	/* Open shard storing the keys below path to get notified about their changes */
+	shardName=_xfconf_settings_backend_get_shard_name(self, inPath, &components);
+	if(shardName) cache=_xfconf_settings_backend_open_shard(self, shardName);
+		else cache=self->cache;
+
+	/* GSettings reads all keys below path next so load them by one request */
+	g_rec_mutex_lock(&cache->lock);
+	_xfconf_settings_backend_cache_load_path(cache, inPath);
+	g_rec_mutex_unlock(&cache->lock);
+
+	/* If path is shorter than the paths shards are created for, open all
+	 * existing shards below this path.
+	 */
+	if(self->sharding==XFCONF_SETTINGS_BACKEND_SHARDING_DEPTH &&
+		components<self->shardingDepth)
+	{
+		if(shardName) prefix=g_strconcat(shardName, ".", NULL);
+			else prefix=g_strdup(XFCONF_SETTINGS_CHANNEL "-");
+
+		channels=self->cache->engine->list_channels();
+		for(iter=channels; iter && *iter; iter++)
+		{
+			if(g_str_has_prefix(*iter, prefix)) _xfconf_settings_backend_open_shard(self, *iter);
+		}
+
+		g_strfreev(channels);
+		g_free(prefix);
+	}
+
+	_xfconf_settings_backend_debug("Subscribed path '%s' at channel '%s'",
+									inPath,
+									shardName ? shardName : self->cache->channelName);
+
+	/* Release allocated resources */
+	g_free(shardName);
+}
+
+/* Stop watching a path for changes made by other processes. Shards stay
+ * open until backend is destroyed.
+ */
+static void _xfconf_settings_backend_unsubscribe(GSettingsBackend *inBackend,
+													const gchar *inPath)
+{
+	G_LOCK(_xfconf_settings_backend_watches);
+	if(_xfconf_settings_backend_watches &&
+		_xfconf_settings_backend_watch_remove(_xfconf_settings_backend_watches, inPath))
+	{
+		_xfconf_settings_backend_watch_free(_xfconf_settings_backend_watches);
+		_xfconf_settings_backend_watches=NULL;
+	}
+	G_UNLOCK(_xfconf_settings_backend_watches);
+
+	_xfconf_settings_backend_debug("Unsubscribed path '%s'", inPath);
+}
+
+/* Store all pending writes in xfconf */
+static void _xfconf_settings_backend_sync(GSettingsBackend *inBackend)
+{
+	XfconfSettingsBackend		*self=(XfconfSettingsBackend*)inBackend;
+	guint						roundTrips;
+	GHashTableIter				iter;
+	gpointer					cache;
+	XfconfSettingsBackendTrace	trace;
+
+	_xfconf_settings_backend_trace_begin(self, XFCONF_SETTINGS_BACKEND_VFUNC_SYNC, &trace);
+
+	/* Flush pending writes of all channels if write-behind is enabled */
+	roundTrips=_xfconf_settings_backend_cache_flush_pending_writes(self->cache);
+
+	g_mutex_lock(&self->shardsLock);
+	g_hash_table_iter_init(&iter, self->shards);
+	while(g_hash_table_iter_next(&iter, NULL, &cache))
+	{
+		roundTrips+=_xfconf_settings_backend_cache_flush_pending_writes((XfconfSettingsBackendCache*)cache);
+	}
+	g_mutex_unlock(&self->shardsLock);
+
+	_xfconf_settings_backend_add_round_trips(self, XFCONF_SETTINGS_BACKEND_VFUNC_SYNC, roundTrips);
+
+	_xfconf_settings_backend_trace_end(self, XFCONF_SETTINGS_BACKEND_VFUNC_SYNC, &trace, NULL, TRUE);
+}
+
 
 /* IMPLEMENTATION: GObject */
 
@@ -835,12 +4871,30 @@ static gboolean _xfconf_settings_backend_get_writable(GSettingsBackend *inBacken
 static void _xfconf_settings_backend_finalize(GObject *inObject)
 {
 	XfconfSettingsBackend		*self=(XfconfSettingsBackend*)inObject;
+	GHashTableIter				iter;
+	gpointer					cache;
 
 	/* Release allocated resources */
-	if(self->channel)
+	if(self->shards)
+	{
+		g_hash_table_iter_init(&iter, self->shards);
+		while(g_hash_table_iter_next(&iter, NULL, &cache))
+		{
+			_xfconf_settings_backend_cache_remove_backend((XfconfSettingsBackendCache*)cache, self);
+			_xfconf_settings_backend_cache_unref((XfconfSettingsBackendCache*)cache);
+		}
+
+		g_hash_table_destroy(self->shards);
+		self->shards=NULL;
+	}
+
+	g_mutex_clear(&self->shardsLock);
+
+	if(self->cache)
 	{
-		g_object_unref(self->channel);
-		self->channel=NULL;
+		_xfconf_settings_backend_cache_remove_backend(self->cache, self);
+		_xfconf_settings_backend_cache_unref(self->cache);
+		self->cache=NULL;
 	}
 
 	/* Call parent class virtual function */
@@ -856,6 +4910,12 @@ static void xfconf_settings_backend_class_init(XfconfSettingsBackendClass *klass
 	GSettingsBackendClass	*backendClass=G_SETTINGS_BACKEND_CLASS(klass);
 	GObjectClass			*gobjectClass=G_OBJECT_CLASS(klass);
 
+	/* Build registry of codecs to convert between variants and values */
+	_xfconf_settings_backend_codecs_init();
+
+	/* Enable tracing if requested */
+	_xfconf_settings_backend_trace_enabled=_xfconf_settings_backend_is_option_enabled(XFCONF_SETTINGS_ENV_TRACE);
+
 	/* Override functions */
 	gobjectClass->finalize=_xfconf_settings_backend_finalize;
 
@@ -864,6 +4924,63 @@ static void xfconf_settings_backend_class_init(XfconfSettingsBackendClass *klass
 	backendClass->write_tree=_xfconf_settings_backend_write_tree;
 	backendClass->reset=_xfconf_settings_backend_reset;
 	backendClass->get_writable=_xfconf_settings_backend_get_writable;
+	backendClass->get_permission=_xfconf_settings_backend_get_permission;
+	backendClass->sync=_xfconf_settings_backend_sync;
+	backendClass->subscribe=_xfconf_settings_backend_subscribe;
+	backendClass->unsubscribe=_xfconf_settings_backend_unsubscribe;
+}
+
+/* Permission cannot be acquired or released as it follows lock state only */
+static gboolean _xfconf_settings_backend_permission_acquire_or_release(GPermission *inPermission,
+																		GCancellable *inCancellable,
+																		GError **outError)
+{
+	g_set_error_literal(outError,
+						G_IO_ERROR,
+						G_IO_ERROR_NOT_SUPPORTED,
+						"Permission to change locked settings cannot be acquired or released");
+	return(FALSE);
+}
+
+static void _xfconf_settings_backend_permission_acquire_or_release_async(GPermission *inPermission,
+																			GCancellable *inCancellable,
+																			GAsyncReadyCallback inCallback,
+																			gpointer inUserData)
+{
+	g_task_report_new_error(inPermission,
+							inCallback,
+							inUserData,
+							NULL,
+							G_IO_ERROR,
+							G_IO_ERROR_NOT_SUPPORTED,
+							"Permission to change locked settings cannot be acquired or released");
+}
+
+static gboolean _xfconf_settings_backend_permission_acquire_or_release_finish(GPermission *inPermission,
+																				GAsyncResult *inResult,
+																				GError **outError)
+{
+	return(g_task_propagate_boolean(G_TASK(inResult), outError));
+}
+
+/* Class initialization of permission */
+static void xfconf_settings_backend_permission_class_init(XfconfSettingsBackendPermissionClass *klass)
+{
+	GPermissionClass		*permissionClass=G_PERMISSION_CLASS(klass);
+
+	/* Override functions */
+	permissionClass->acquire=_xfconf_settings_backend_permission_acquire_or_release;
+	permissionClass->acquire_async=_xfconf_settings_backend_permission_acquire_or_release_async;
+	permissionClass->acquire_finish=_xfconf_settings_backend_permission_acquire_or_release_finish;
+	permissionClass->release=_xfconf_settings_backend_permission_acquire_or_release;
+	permissionClass->release_async=_xfconf_settings_backend_permission_acquire_or_release_async;
+	permissionClass->release_finish=_xfconf_settings_backend_permission_acquire_or_release_finish;
+}
+
+/* Object initialization of permission */
+
+static void xfconf_settings_backend_permission_init(XfconfSettingsBackendPermission *self)
+{
 }
 
 /* Object initialization
@@ -871,57 +4988,200 @@ static void xfconf_settings_backend_class_init(XfconfSettingsBackendClass *klass
  */
 static void xfconf_settings_backend_init(XfconfSettingsBackend *self)
 {
+	gint						i;
+
+	/* Connect to engine if this is the first backend */
+	self->engine=_xfconf_settings_backend_ensure_engine();
+
 	/* Set default values */
-	self->channel=xfconf_channel_new(XFCONF_SETTINGS_CHANNEL);
+	self->cache=_xfconf_settings_backend_cache_ref_for_channel(self->engine, XFCONF_SETTINGS_CHANNEL);
+	_xfconf_settings_backend_cache_add_backend(self->cache, self);
+
+	self->sharding=_xfconf_settings_backend_get_sharding_option(&self->shardingDepth);
+	self->shardingLegacy=_xfconf_settings_backend_is_option_enabled(XFCONF_SETTINGS_ENV_SHARDING_LEGACY);
+	g_mutex_init(&self->shardsLock);
+	self->shards=g_hash_table_new_full(g_str_hash,
+										g_str_equal,
+										(GDestroyNotify)g_free,
+										NULL);
+
+	for(i=0; i<XFCONF_SETTINGS_BACKEND_VFUNC_LAST; i++) self->roundTrips[i]=0;
 }
 
 
-/* IMPLEMENTATION: GIOModule */
+/* IMPLEMENTATION: Public API */
 
-/* Module loading and initialization */
-void g_io_module_load(GIOModule *inModule)
+/* Get number of requests made to xfconf by a virtual function of backend
+ * (e.g. "read" or "write_tree") since creation or last reset of counters.
+ * If no virtual function name is given, the requests of all virtual
+ * functions are summed up.
+ */
+guint xfconf_settings_backend_get_round_trips(GSettingsBackend *inBackend,
+												const gchar *inVFuncName)
 {
-	GError		*error;
-#ifdef STORE_COMPLEX_VARIANTS
-	GType		xfconfVariantStruct[]={ G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING };
-#endif
+	XfconfSettingsBackend		*self;
+	guint						roundTrips;
+	gint						i;
 
-	error=NULL;
+	g_return_val_if_fail(G_IS_SETTINGS_BACKEND(inBackend), 0);
+	g_return_val_if_fail(g_type_is_a(G_OBJECT_TYPE(inBackend), XFCONF_TYPE_SETTINGS_BACKEND), 0);
 
-	/* Initialize xfconf */
-	if(!xfconf_init(&error))
+	self=XFCONF_SETTINGS_BACKEND(inBackend);
+
+	roundTrips=0;
+	for(i=0; i<XFCONF_SETTINGS_BACKEND_VFUNC_LAST; i++)
 	{
-		g_critical("Could not initialize xfconf: %s", error->message);
-		g_error_free(error);
-		return;
+		if(!inVFuncName || g_strcmp0(inVFuncName, _xfconf_settings_backend_vfunc_names[i])==0)
+		{
+			roundTrips+=g_atomic_int_get(&self->roundTrips[i]);
+		}
+	}
+
+	return(roundTrips);
+}
+
+/* Reset counters of requests made to xfconf of all virtual functions of backend */
+void xfconf_settings_backend_reset_round_trips(GSettingsBackend *inBackend)
+{
+	XfconfSettingsBackend		*self;
+	gint						i;
+
+	g_return_if_fail(G_IS_SETTINGS_BACKEND(inBackend));
+	g_return_if_fail(g_type_is_a(G_OBJECT_TYPE(inBackend), XFCONF_TYPE_SETTINGS_BACKEND));
+
+	self=XFCONF_SETTINGS_BACKEND(inBackend);
+
+	for(i=0; i<XFCONF_SETTINGS_BACKEND_VFUNC_LAST; i++)
+	{
+		g_atomic_int_set(&self->roundTrips[i], 0);
+	}
+}
+
+/* Print latency histograms of all virtual functions and the most recent events
+ * of each thread to standard error if tracing is enabled. Bucket "< N us"
+ * counts the calls which took less than N microseconds. Percentiles are
+ * reported as the upper bound of their bucket.
+ */
+void xfconf_settings_backend_dump_trace(void)
+{
+	guint						counts[XFCONF_SETTINGS_TRACE_BUCKETS];
+	guint						total;
+	guint						sum;
+	guint						p50, p99, p999;
+	gint						vfunc;
+	gint						bucket;
+	GSList						*iter;
+	XfconfSettingsBackendTraceRing	*ring;
+	XfconfSettingsBackendTraceEvent	*event;
+	gint						count;
+	gint						i;
+
+	if(!_xfconf_settings_backend_trace_enabled) return;
+
+	g_printerr("xfconf-gsettings: latency histograms\n");
+	for(vfunc=0; vfunc<XFCONF_SETTINGS_BACKEND_VFUNC_LAST; vfunc++)
+	{
+		/* Take snapshot of histogram */
+		total=0;
+		for(bucket=0; bucket<XFCONF_SETTINGS_TRACE_BUCKETS; bucket++)
+		{
+			counts[bucket]=(guint)g_atomic_int_get(&_xfconf_settings_backend_trace_histograms[vfunc][bucket]);
+			total+=counts[bucket];
+		}
+
+		if(total==0) continue;
+
+		/* Find buckets of percentiles */
+		sum=0;
+		p50=p99=p999=0;
+		for(bucket=0; bucket<XFCONF_SETTINGS_TRACE_BUCKETS; bucket++)
+		{
+			sum+=counts[bucket];
+			if(!p50 && sum*2>=total) p50=bucket;
+			if(!p99 && (guint64)sum*100>=(guint64)total*99) p99=bucket;
+			if(!p999 && (guint64)sum*1000>=(guint64)total*999) p999=bucket;
+		}
+
+		g_printerr("  %s: %u calls, p50 < %lu us, p99 < %lu us, p99.9 < %lu us\n",
+					_xfconf_settings_backend_vfunc_names[vfunc],
+					total,
+					1UL << p50,
+					1UL << p99,
+					1UL << p999);
+
+		for(bucket=0; bucket<XFCONF_SETTINGS_TRACE_BUCKETS; bucket++)
+		{
+			if(counts[bucket]>0) g_printerr("    < %lu us: %u\n", 1UL << bucket, counts[bucket]);
+		}
+	}
+
+	/* Print most recent events of each thread */
+	G_LOCK(_xfconf_settings_backend_trace_rings);
+	for(iter=_xfconf_settings_backend_trace_rings; iter; iter=g_slist_next(iter))
+	{
+		ring=(XfconfSettingsBackendTraceRing*)iter->data;
+		count=g_atomic_int_get(&ring->count);
+
+		g_printerr("xfconf-gsettings: last events of thread %p (%d recorded)\n", ring->thread, count);
+		for(i=MAX(0, count-XFCONF_SETTINGS_TRACE_DUMP_EVENTS); i<count; i++)
+		{
+			event=&ring->events[i % XFCONF_SETTINGS_TRACE_RING_SIZE];
+			g_printerr("  %" G_GINT64_FORMAT " %s key=%08x latency=%u us round-trips=%u result=%u\n",
+						event->time,
+						_xfconf_settings_backend_vfunc_names[event->vfunc],
+						event->keyHash,
+						event->latency,
+						event->roundTrips,
+						event->result);
+		}
 	}
+	G_UNLOCK(_xfconf_settings_backend_trace_rings);
+}
+
+
+/* IMPLEMENTATION: GIOModule */
 
-	/* Register GSettings backend */
+/* Module loading and initialization */
+void g_io_module_load(GIOModule *inModule)
+{
+	/* Register GSettings backend. The engine, e.g. xfconf, is initialized
+	 * when the first backend is created.
+	 */
 	g_type_module_use(G_TYPE_MODULE(inModule));
 	g_io_extension_point_implement(G_SETTINGS_BACKEND_EXTENSION_POINT_NAME,
 									xfconf_settings_backend_get_type(),
 									"xfconf",
 									-1);
 
-#ifdef STORE_COMPLEX_VARIANTS
-	/* Register named structs at xfconf */
-	xfconf_named_struct_register(XFCONF_VARIANT_STRUCT_NAME,
-									G_N_ELEMENTS(xfconfVariantStruct),
-									xfconfVariantStruct);
-#endif
-
-#ifdef STORE_COMPLEX_VARIANTS
-	_xfconf_settings_backend_debug("Module loaded: xfconf-gsettings (storing variants as complex arrays)");
-#else
-	_xfconf_settings_backend_debug("Module loaded: xfconf-gsettings (storing simple serialized variants)");
-#endif
+	_xfconf_settings_backend_debug("Module loaded: xfconf-gsettings");
 }
 
 /* Module unloading */
 void g_io_module_unload(GIOModule *inModule)
 {
-	/* Shutdown xfconf */
-	xfconf_shutdown();
+	/* Shutdown engine if it was initialized by a backend */
+	G_LOCK(_xfconf_settings_backend_engine);
+	if(_xfconf_settings_backend_engine)
+	{
+		if(_xfconf_settings_backend_engine_initialized) _xfconf_settings_backend_engine->shutdown();
+		_xfconf_settings_backend_engine_initialized=FALSE;
+		_xfconf_settings_backend_engine=NULL;
+	}
+	if(_xfconf_settings_backend_engine_fallback_initialized)
+	{
+		_xfconf_settings_backend_engines[XFCONF_SETTINGS_ENGINE_FALLBACK].shutdown();
+		_xfconf_settings_backend_engine_fallback_initialized=FALSE;
+	}
+	G_UNLOCK(_xfconf_settings_backend_engine);
+
+	/* Dump and stop tracing */
+	xfconf_settings_backend_dump_trace();
+	_xfconf_settings_backend_trace_enabled=FALSE;
+
+	G_LOCK(_xfconf_settings_backend_trace_rings);
+	g_slist_free_full(_xfconf_settings_backend_trace_rings, g_free);
+	_xfconf_settings_backend_trace_rings=NULL;
+	G_UNLOCK(_xfconf_settings_backend_trace_rings);
 
 	_xfconf_settings_backend_debug("Module unloaded: xfconf-gsettings");
 }